@@ -11,11 +11,24 @@
 
 #pragma once
 
+#include "gpio.h"
 #include "mcp2515.h"
 
 #define CAN_MODE_OFFSET 5
 #define CAN_MODE_MASK 0xE0
 
+#define CAN_RX_QUEUE_LEN 32     /**< Frames in the receive queue, must be a power of two */
+#define CAN_TX_QUEUE_LEN 4      /**< Frames queued per transmit class, must be a power of two */
+
+#define CAN_FIRE_TX_BUFFER 2    /**< Transmit buffer reserved for the preloaded fire frame */
+
+#define CAN_STD_ID_MASK 0x7FF   /**< All bits of an 11-bit identifier */
+#define CAN_ID_STATUS_BASE 0x20 /**< Status frames from node 2 use IDs 0x20-0x2F */
+#define CAN_ID_STATUS_MASK 0x7F0
+
+/**< MCP2515 INT output, wired to INT2 (PE0) on the ATmega162 */
+#define CAN_INT_PIN ((struct gpio_pin){'E', 0})
+
 
 /** ***************************************************************************
  * @brief CAN message identifiers
@@ -26,7 +39,24 @@ enum can_msg_id {
     CAN_ID_GAME_START = 0x03,
     CAN_ID_GAME_OVER = 0x04,
     CAN_ID_NODE1_RDY = 0x05,
-    CAN_ID_NODE2_RDY = 0x06
+    CAN_ID_NODE2_RDY = 0x06,
+    CAN_ID_INPUT_STATE = 0x07,
+    CAN_ID_LATENCY_ECHO = CAN_ID_STATUS_BASE, /**< Node 2 answer to a latency probe */
+    CAN_ID_TIME_SYNC = CAN_ID_STATUS_BASE + 1,
+    CAN_ID_TIME_FOLLOW_UP = CAN_ID_STATUS_BASE + 2
+};
+
+/** ***************************************************************************
+ * @brief Transmit priority classes
+ * 
+ * @details Higher classes get a higher TXP priority in the MCP2515 and are
+ *          served first when a transmit buffer becomes free
+*******************************************************************************/
+enum can_tx_class {
+    CAN_TX_CLASS_STATUS = 0,    /**< Game state and handshakes */
+    CAN_TX_CLASS_JOYSTICK,      /**< Joystick position */
+    CAN_TX_CLASS_BUTTON,        /**< Buttons, including fire */
+    CAN_NUM_TX_CLASSES
 };
 
 /** ***************************************************************************
@@ -46,6 +76,26 @@ struct __attribute__((packed)) can_config {
     };
 };
 
+/** ***************************************************************************
+ * @brief Acceptance filter
+*******************************************************************************/
+struct can_filter {
+    uint16_t id;        /**< 11-bit identifier to accept */
+    bool extended;      /**< True to accept extended frames, false for standard frames */
+};
+
+/** ***************************************************************************
+ * @brief Acceptance filter configuration of the MCP2515
+ * 
+ * @details A frame is accepted if its identifier matches one of the filters in
+ *          the bits set in the filter's mask. Mask 0 applies to filters 0-1
+ *          (RXB0), mask 1 to filters 2-5 (RXB1). Repeat a filter to leave a slot unused
+*******************************************************************************/
+struct can_filter_config {
+    uint16_t masks[MCP2515_NUM_MASKS];                  /**< RXM0 and RXM1 */
+    struct can_filter filters[MCP2515_NUM_FILTERS];     /**< RXF0 to RXF5 */
+};
+
 /** ***************************************************************************
  * @brief CAN message structure 
 *******************************************************************************/
@@ -58,6 +108,66 @@ struct __attribute__((packed)) can_msg {
     };
 };
 
+/** ***************************************************************************
+ * @brief CAN receive statistics
+ * 
+ * @details A frame is lost if it arrives while both receive buffers are full
+ *          (counted by the MCP2515 in EFLG), or while the receive queue is full.
+ *          All counters wrap around
+*******************************************************************************/
+struct can_rx_stats {
+    uint16_t rx0_frames;        /**< Frames read from RXB0 */
+    uint16_t rx1_frames;        /**< Frames read from RXB1 */
+    uint16_t rx0_overflows;     /**< Frames lost on RXB0 (EFLG.RX0OVR) */
+    uint16_t rx1_overflows;     /**< Frames lost on RXB1 (EFLG.RX1OVR) */
+    uint16_t queue_drops;       /**< Frames dropped because the receive queue was full */
+};
+
+/** ***************************************************************************
+ * @brief CAN transmit statistics for one priority class
+ * 
+ * @details Latency is measured from can_send() until the MCP2515 reports the
+ *          frame as transmitted
+*******************************************************************************/
+struct can_tx_class_stats {
+    uint16_t sent;              /**< Frames transmitted */
+    uint16_t queued;            /**< Frames that waited in the RAM queue for a buffer */
+    uint16_t drops;             /**< Frames dropped because the RAM queue was full, or lost in one-shot mode */
+    uint16_t replaced;          /**< Frames overwritten by a newer one before they were sent */
+    uint32_t max_latency_us;    /**< Longest latency */
+    uint32_t total_latency_us;  /**< Sum of all latencies, divide by sent for the mean */
+};
+
+/** ***************************************************************************
+ * @brief CAN transmit statistics
+*******************************************************************************/
+struct can_tx_stats {
+    struct can_tx_class_stats classes[CAN_NUM_TX_CLASSES]; /**< Indexed by enum can_tx_class */
+};
+
+/** ***************************************************************************
+ * @brief How the preloaded fire frame is triggered
+*******************************************************************************/
+enum can_fire_trigger {
+    CAN_FIRE_TRIGGER_SPI = 0,   /**< can_fire() sends a single-byte RTS instruction */
+    CAN_FIRE_TRIGGER_RTS_PIN    /**< A falling edge on the MCP2515 TXnRTS pin of the buffer, no SPI at all */
+};
+
+/** ***************************************************************************
+ * @brief Statistics for the preloaded fire frame
+ * 
+ * @details Latency is measured from can_fire() until the MCP2515 reports the
+ *          frame as transmitted. Pin-triggered frames are only counted
+*******************************************************************************/
+struct can_fire_stats {
+    uint16_t fired;             /**< Successful can_fire() calls */
+    uint16_t busy;              /**< can_fire() calls rejected because the bus or the buffer was busy */
+    uint16_t sent;              /**< Fire frames transmitted */
+    uint16_t failed;            /**< Fire frames lost in one-shot mode */
+    uint32_t max_latency_us;    /**< Longest latency */
+    uint32_t total_latency_us;  /**< Sum of the latencies of software-triggered frames */
+};
+
 /** ***************************************************************************
  * @brief CAN operating modes
 *******************************************************************************/
@@ -76,22 +186,143 @@ enum can_mode {
  * 
  * @param[in] _mcp2515_dev SPI device structure for the MCP2515
  * @param[in] mode CAN operating mode to set
+ * @param[in] cfg Bit timing configuration
+ * @param[in] filters Acceptance filters, or NULL to accept every frame
  * @return int 0 on success, negative error code on failure
+ * @details Enables receive buffer rollover (RXB0 -> RXB1), the receive, transmit and
+ *          error interrupts on the MCP2515 and the INT2 external interrupt on CAN_INT_PIN.
+ *          Starts the timebase used for transmit latency.
+ *          Global interrupts must be enabled by the caller
 *******************************************************************************/
-int can_init(const struct spi_device* mcp2515_dev, enum can_mode mode, struct can_config cfg);
+int can_init(const struct spi_device* mcp2515_dev, enum can_mode mode, struct can_config cfg, const struct can_filter_config* filters);
 
 /** ***************************************************************************
  * @brief Send a CAN message
  * 
  * @param[in] msg Pointer to the CAN message to send
- * @return int 0 on success, negative error code on failure
+ * @return int 0 on success, -EAGAIN if the frame was dropped, negative error code on failure
+ * @details Loads the frame into a free transmit buffer with the priority of its
+ *          class, or queues it in RAM until one becomes free. Frames of the same
+ *          class are sent in order.
+ *          Must not be called from an interrupt handler
 *******************************************************************************/
 int can_send(const struct can_msg* msg);
 
+/** ***************************************************************************
+ * @brief Send a CAN message that a replacing class must not overwrite
+ * 
+ * @param[in] msg Pointer to the CAN message to send
+ * @return int 0 on success, -EAGAIN if the frame was dropped, negative error code on failure
+ * @details As can_send(), but the next frame of the class queues behind this
+ *          one instead of replacing it, see can_set_tx_replace(). For frames
+ *          whose content matters beyond the newest value, like a latency probe
+*******************************************************************************/
+int can_send_pinned(const struct can_msg* msg);
+
 /** ***************************************************************************
  * @brief Receive a CAN message
  * 
  * @param[out] msg Pointer to the CAN message structure to store received message
+ * @return int 0 on success, -EAGAIN if no message is available, negative error code on failure
+ * @details Pops the oldest frame from the receive queue filled by the INT2 ISR.
+ *          Does not touch the SPI bus unless the ISR had to defer a drain
+*******************************************************************************/
+int can_receive(struct can_msg* msg);
+
+/** ***************************************************************************
+ * @brief Receive a CAN message together with its receive time
+ * 
+ * @param[out] msg Pointer to the CAN message structure to store received message
+ * @param[out] stamp timer_now() when the frame was read from the MCP2515, may be NULL
+ * @return int 0 on success, -EAGAIN if no message is available, negative error code on failure
+*******************************************************************************/
+int can_receive_stamped(struct can_msg* msg, uint32_t* stamp);
+
+/** ***************************************************************************
+ * @brief Get the receive statistics
+ * 
+ * @param[out] stats Pointer to structure to store a snapshot of the statistics
+ * @return int 0 on success, negative error code on failure
+*******************************************************************************/
+int can_get_rx_stats(struct can_rx_stats* stats);
+
+/** ***************************************************************************
+ * @brief Reset all receive statistics to zero
+*******************************************************************************/
+void can_reset_rx_stats(void);
+
+/** ***************************************************************************
+ * @brief Get the transmit class of a message identifier
+ * 
+ * @param[in] id Message identifier
+ * @return enum can_tx_class Class used to prioritize the message
+*******************************************************************************/
+enum can_tx_class can_tx_class_of(uint32_t id);
+
+/** ***************************************************************************
+ * @brief Set whether new frames of a class replace a pending one
+ * 
+ * @param[in] tx_class Transmit class
+ * @param[in] replace True to replace, false to queue (the default)
  * @return int 0 on success, negative error code on failure
+ * @details For latest-value signals like the joystick position. A frame that
+ *          has not left the MCP2515 yet is aborted and overwritten in its buffer,
+ *          and a frame waiting in the RAM queue is overwritten there
+*******************************************************************************/
+int can_set_tx_replace(enum can_tx_class tx_class, bool replace);
+
+/** ***************************************************************************
+ * @brief Enable or disable one-shot mode
+ * 
+ * @param[in] enable True to attempt each frame only once
+ * @return int 0 on success, negative error code on failure
+ * @details Applies to all transmit buffers. A frame that loses arbitration or
+ *          hits a bus error is dropped instead of retransmitted
+*******************************************************************************/
+int can_set_one_shot(bool enable);
+
+/** ***************************************************************************
+ * @brief Preload a frame into the reserved fire buffer
+ * 
+ * @param[in] msg Frame to send each time the buffer is triggered
+ * @param[in] trigger How the frame is triggered
+ * @return int 0 on success, -EBUSY if the buffer still holds a frame from
+ *         can_send(), negative error code on failure
+ * @details Takes CAN_FIRE_TX_BUFFER away from can_send() with the highest priority.
+ *          The frame stays in the buffer, so every trigger sends it again.
+ *          With CAN_FIRE_TRIGGER_RTS_PIN the button must be wired to the TXnRTS
+ *          pin of CAN_FIRE_TX_BUFFER
+*******************************************************************************/
+int can_fire_init(const struct can_msg* msg, enum can_fire_trigger trigger);
+
+/** ***************************************************************************
+ * @brief Send the preloaded fire frame
+ * 
+ * @return int 0 on success, -EBUSY if the SPI bus or the fire buffer is busy,
+ *         negative error code on failure
+ * @details Only one SPI byte, so it is meant to be called from the interrupt
+ *          that detects the button edge. It never waits for the bus; retry
+ *          on the next interrupt instead
+*******************************************************************************/
+int can_fire(void);
+
+/** ***************************************************************************
+ * @brief Get the fire frame statistics
+ * 
+ * @param[out] stats Pointer to structure to store a snapshot of the statistics
+ * @return int 0 on success, negative error code on failure
+*******************************************************************************/
+int can_get_fire_stats(struct can_fire_stats* stats);
+
+/** ***************************************************************************
+ * @brief Get the transmit statistics
+ * 
+ * @param[out] stats Pointer to structure to store a snapshot of the statistics
+ * @return int 0 on success, negative error code on failure
+*******************************************************************************/
+int can_get_tx_stats(struct can_tx_stats* stats);
+
+/** ***************************************************************************
+ * @brief Reset all transmit statistics to zero
 *******************************************************************************/
-int can_receive(struct can_msg* msg);
\ No newline at end of file
+void can_reset_tx_stats(void);
\ No newline at end of file
@@ -13,11 +13,18 @@
 
 #include <stdio.h>
 
+#include <avr/pgmspace.h>
+
 // Set to 1 to enable debug prints, 0 to disable
 #define DEBUG 1
 
+// printf() with the format string kept in flash. A plain string literal
+// would be copied to SRAM at boot. fmt must be a string literal
+#define LOG_PRINTF(fmt, ...) \
+            printf_P(PSTR(fmt), ##__VA_ARGS__)
+
 #define DEBUG_PRINTF(fmt, ...) \
-            do { if (DEBUG) printf(fmt, __VA_ARGS__); } while (0)
+            do { if (DEBUG) LOG_PRINTF(fmt, __VA_ARGS__); } while (0)
 
 #define DEBUG_PRINT(str) \
-            do { if (DEBUG) printf(str); } while (0)
+            do { if (DEBUG) LOG_PRINTF(str); } while (0)
@@ -44,7 +44,7 @@ enum gui_state {
  * @details Represents a single menu item with display text and associated action
 *******************************************************************************/
 struct __attribute__((packed)) menu_item{
-    const uint8_t* string;      /**< String to display */
+    const char* string;         /**< String to display, in program memory */
     void (*action)(void* arg);  /**< Function pointer to action with optional argument */
 };
 
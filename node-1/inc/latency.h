@@ -0,0 +1,105 @@
+/** ***************************************************************************
+ * @file latency.h
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief End-to-end input to actuation latency measurement
+ * @version 0.1
+ * @date 2025-11-24
+ * 
+ * @copyright Copyright (c) 2025 Byggarane
+ * 
+*******************************************************************************/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "can.h"
+
+#define LATENCY_PROBE_INTERVAL 16   /**< Every 16th input state frame is a probe, must be a power of two */
+#define LATENCY_OFFSET_WINDOW 16    /**< Probes per clock offset estimate */
+#define LATENCY_HIST_BINS 32        /**< Histogram bins, plus one for everything above */
+#define LATENCY_HIST_BIN_US 500     /**< Width of a histogram bin */
+#define LATENCY_CLOCK_MASK 0xFFFFFFUL /**< Node 2 sends 24-bit microsecond times */
+
+
+/** ***************************************************************************
+ * @brief Payload of the CAN_ID_LATENCY_ECHO frame from node 2
+*******************************************************************************/
+struct __attribute__((packed)) latency_echo_frame {
+    uint8_t seq;                /**< Sequence number of the probed input state frame */
+    uint8_t rx_us[3];           /**< Node 2 time at start of the probe frame, little endian */
+    uint16_t actuation_us;      /**< From receive until the new motor setpoint was applied */
+    uint16_t turnaround_us;     /**< From receive until the echo was queued */
+};
+
+/** ***************************************************************************
+ * @brief Latency statistics
+ * 
+ * @details Times are from sampling the joystick on node 1. Network latency is
+ *          until the probe frame started on the bus at node 2, actuation
+ *          latency until node 2 applied it to the motor
+*******************************************************************************/
+struct latency_stats {
+    uint16_t probes;            /**< Probes sent */
+    uint16_t echoes;            /**< Echoes matched to a probe */
+    uint16_t lost;              /**< Probes that got no echo before the next one */
+    uint32_t min_net_us;
+    uint32_t max_net_us;
+    uint32_t total_net_us;
+    uint32_t min_us;            /**< Minimum actuation latency */
+    uint32_t max_us;            /**< Maximum actuation latency */
+    uint32_t total_us;          /**< Sum of actuation latencies */
+    uint32_t best_rtt_us;       /**< Round trip the clock offset is taken from */
+    uint16_t hist[LATENCY_HIST_BINS + 1]; /**< Actuation latency histogram */
+};
+
+/** ***************************************************************************
+ * @brief Check whether an input state frame should carry a probe
+ * 
+ * @param[in] seq Sequence number of the frame
+ * @return true if the frame should be sent as a probe
+*******************************************************************************/
+bool latency_probe_due(uint8_t seq);
+
+/** ***************************************************************************
+ * @brief Record a probe that has been sent
+ * 
+ * @param[in] seq Sequence number of the probe frame
+ * @param[in] stamp timer_now() when the joystick was sampled for it
+*******************************************************************************/
+void latency_probe_sent(uint8_t seq, uint32_t stamp);
+
+/** ***************************************************************************
+ * @brief Process an echo from node 2
+ * 
+ * @param[in] msg Received CAN_ID_LATENCY_ECHO frame
+ * @param[in] stamp Receive time from can_receive_stamped()
+ * @return int 0 on success, -EINVAL for a malformed frame, -ENXIO if it does
+ *         not match the outstanding probe
+ * @details Once timesync_locked(), probes are measured on the node 2 time
+ *          axis. Until then the clock offset between the nodes is taken from
+ *          the probe with the shortest round trip in the last
+ *          LATENCY_OFFSET_WINDOW probes, half of that round trip is its one-way
+ *          latency. Other probes are measured against that offset, so
+ *          asymmetric delays show up. The window keeps the crystal drift
+ *          between the nodes small
+*******************************************************************************/
+int latency_echo_received(const struct can_msg* msg, uint32_t stamp);
+
+/** ***************************************************************************
+ * @brief Get the latency statistics
+ * 
+ * @param[out] stats Pointer to structure to store a snapshot of the statistics
+*******************************************************************************/
+void latency_get_stats(struct latency_stats* stats);
+
+/** ***************************************************************************
+ * @brief Reset all latency statistics
+*******************************************************************************/
+void latency_reset(void);
+
+/** ***************************************************************************
+ * @brief Print min/mean/p99 and the histogram of the latency over UART
+*******************************************************************************/
+void latency_print_report(void);
@@ -16,17 +16,37 @@
 
 #include "spi.h"
 
+#define MCP2515_NUM_TX_BUFFERS 3
+#define MCP2515_NUM_RX_BUFFERS 2
+#define MCP2515_NUM_FILTERS 6
+#define MCP2515_NUM_MASKS 2
+#define MCP2515_FRAME_HEADER_SIZE 5     /**< SIDH, SIDL, EID8, EID0, DLC */
+#define MCP2515_FRAME_MAX_SIZE 13       /**< Header and 8 data bytes */
+#define MCP2515_DLC_MASK 0x0F
+#define MCP2515_MAX_DLC 8
+
 
 enum mcp2515_instruction {
     MCP2515_WRITE = 0x02,       /**< Write instruction */
     MCP2515_READ = 0x03,        /**< Read instruction */
     MCP2515_BIT_MODIFY = 0x05,  /**< Bit modify instruction */
+    MCP2515_LOAD_TX_BASE = 0x40,/**< Load TX buffer base instruction, starting at TXBnSIDH */
+    MCP2515_READ_RX_BASE = 0x90,/**< Read RX buffer base instruction, starting at RXBnSIDH */
     MCP2515_RTS_BASE = 0x80,    /**< Request to Send base instruction */
     MCP2515_READ_STATUS = 0xA0, /**< Read Status instruction */
     MCP2515_RESET = 0xC0        /**< Reset instruction */
 };
 
 enum mcp2515_register {
+    MCP2515_RXF0SIDH = 0x00,    /**< Filter 0 Standard Identifier High */
+    MCP2515_RXF1SIDH = 0x04,    /**< Filter 1 Standard Identifier High */
+    MCP2515_RXF2SIDH = 0x08,    /**< Filter 2 Standard Identifier High */
+    MCP2515_TXRTSCTRL = 0x0D,   /**< TXnRTS Pin Control and Status Register */
+    MCP2515_RXF3SIDH = 0x10,    /**< Filter 3 Standard Identifier High */
+    MCP2515_RXF4SIDH = 0x14,    /**< Filter 4 Standard Identifier High */
+    MCP2515_RXF5SIDH = 0x18,    /**< Filter 5 Standard Identifier High */
+    MCP2515_RXM0SIDH = 0x20,    /**< Mask 0 Standard Identifier High */
+    MCP2515_RXM1SIDH = 0x24,    /**< Mask 1 Standard Identifier High */
     MCP2515_CANCTRL = 0x0F,     /**< CAN Control Register */
     MCP2515_CANSTAT = 0x0E,     /**< CAN Status Register */
     MCP2515_CNF1 = 0x2A,        /**< Configuration Register 1 */
@@ -55,7 +75,95 @@ enum mcp2515_register {
     MCP2515_RXB1EID0 = 0x74,    /**< Receive Buffer 1 Extended Identifier Low */
     MCP2515_RXB1DLC = 0x75,     /**< Receive Buffer 1 Data Length Code */
     MCP2515_RXB1DATA = 0x76,    /**< Receive Buffer 1 Data Start */
-    MCP2515_CANINTF = 0x2C      /**< CAN Interrupt Flag Register */
+    MCP2515_CANINTE = 0x2B,     /**< CAN Interrupt Enable Register */
+    MCP2515_CANINTF = 0x2C,     /**< CAN Interrupt Flag Register */
+    MCP2515_EFLG = 0x2D         /**< Error Flag Register */
+};
+
+/** ***************************************************************************
+ * @brief Bits in the CANINTE and CANINTF registers
+ * 
+ * @details The enable bits in CANINTE share positions with the flags in CANINTF
+*******************************************************************************/
+enum mcp2515_interrupt {
+    MCP2515_RX0IF = 0x01,       /**< Receive buffer 0 full */
+    MCP2515_RX1IF = 0x02,       /**< Receive buffer 1 full */
+    MCP2515_TX0IF = 0x04,       /**< Transmit buffer 0 empty */
+    MCP2515_TX1IF = 0x08,       /**< Transmit buffer 1 empty */
+    MCP2515_TX2IF = 0x10,       /**< Transmit buffer 2 empty */
+    MCP2515_ERRIF = 0x20,       /**< Error interrupt */
+    MCP2515_WAKIF = 0x40,       /**< Wake-up interrupt */
+    MCP2515_MERRF = 0x80        /**< Message error interrupt */
+};
+
+/** ***************************************************************************
+ * @brief Bits in the EFLG register
+*******************************************************************************/
+enum mcp2515_error_flag {
+    MCP2515_EWARN = 0x01,       /**< Error warning flag */
+    MCP2515_RXWAR = 0x02,       /**< Receive error warning flag */
+    MCP2515_TXWAR = 0x04,       /**< Transmit error warning flag */
+    MCP2515_RXEP = 0x08,        /**< Receive error-passive flag */
+    MCP2515_TXEP = 0x10,        /**< Transmit error-passive flag */
+    MCP2515_TXBO = 0x20,        /**< Bus-off error flag */
+    MCP2515_RX0OVR = 0x40,      /**< Receive buffer 0 overflow flag */
+    MCP2515_RX1OVR = 0x80       /**< Receive buffer 1 overflow flag */
+};
+
+/** ***************************************************************************
+ * @brief Bits in the CANCTRL register
+*******************************************************************************/
+enum mcp2515_can_ctrl {
+    MCP2515_CANCTRL_OSM = 0x08,     /**< One-shot mode: frames are attempted only once */
+    MCP2515_CANCTRL_ABAT = 0x10     /**< Abort all pending transmissions */
+};
+
+/** ***************************************************************************
+ * @brief Bits in the TXB0CTRL, TXB1CTRL and TXB2CTRL registers
+*******************************************************************************/
+enum mcp2515_tx_ctrl {
+    MCP2515_TXB_TXP_MASK = 0x03,    /**< Transmit buffer priority, 3 is highest */
+    MCP2515_TXB_TXREQ = 0x08,       /**< Transmission requested, clear to abort */
+    MCP2515_TXB_TXERR = 0x10,       /**< Bus error during transmission */
+    MCP2515_TXB_MLOA = 0x20,        /**< Arbitration lost */
+    MCP2515_TXB_ABTF = 0x40         /**< Transmission aborted */
+};
+
+/** ***************************************************************************
+ * @brief Bits in the TXRTSCTRL register
+*******************************************************************************/
+enum mcp2515_rts_ctrl {
+    MCP2515_B0RTSM = 0x01,      /**< TX0RTS pin requests transmission of TXB0 */
+    MCP2515_B1RTSM = 0x02,      /**< TX1RTS pin requests transmission of TXB1 */
+    MCP2515_B2RTSM = 0x04       /**< TX2RTS pin requests transmission of TXB2 */
+};
+
+/** ***************************************************************************
+ * @brief Bits in the byte returned by the READ STATUS instruction
+ * 
+ * @details The transmit bits of buffer n are the TXB0 bits shifted left by 2n
+*******************************************************************************/
+enum mcp2515_status {
+    MCP2515_STATUS_RX0IF = 0x01,    /**< CANINTF.RX0IF */
+    MCP2515_STATUS_RX1IF = 0x02,    /**< CANINTF.RX1IF */
+    MCP2515_STATUS_TX0REQ = 0x04,   /**< TXB0CTRL.TXREQ */
+    MCP2515_STATUS_TX0IF = 0x08     /**< CANINTF.TX0IF */
+};
+
+/** ***************************************************************************
+ * @brief Bits in the SIDL byte of frames, filters and masks
+*******************************************************************************/
+enum mcp2515_sidl {
+    MCP2515_SIDL_EXIDE = 0x08,      /**< Extended identifier (IDE in receive buffers) */
+    MCP2515_SIDL_SID_POS = 5        /**< Position of SID2:0 */
+};
+
+/** ***************************************************************************
+ * @brief Bits in the RXB0CTRL and RXB1CTRL registers
+*******************************************************************************/
+enum mcp2515_rx_ctrl {
+    MCP2515_RXB_BUKT = 0x04,    /**< RXB0 only: roll over to RXB1 when RXB0 is full */
+    MCP2515_RXB_RXM_MASK = 0x60 /**< Receive buffer operating mode bits */
 };
 
 
@@ -106,6 +214,27 @@ int mcp2515_write_multiple(uint8_t address, const uint8_t* data, uint8_t length)
 *******************************************************************************/
 int mcp2515_read_multiple(uint8_t address, uint8_t* data, uint8_t length);
 
+/** ***************************************************************************
+ * @brief Load a frame into a transmit buffer using the LOAD TX BUFFER instruction
+ * 
+ * @param[in] buffer Transmit buffer number (0-2)
+ * @param[in] frame Frame in register layout: SIDH, SIDL, EID8, EID0, DLC, DATA0-7
+ * @return int 0 on success, negative error code on failure
+ * @details Only the header and the number of data bytes given by the DLC are sent
+*******************************************************************************/
+int mcp2515_load_tx_buffer(uint8_t buffer, const uint8_t* frame);
+
+/** ***************************************************************************
+ * @brief Read a frame from a receive buffer using the READ RX BUFFER instruction
+ * 
+ * @param[in] buffer Receive buffer number (0-1)
+ * @param[out] frame Buffer of MCP2515_FRAME_MAX_SIZE bytes to store the frame in register layout
+ * @return int 0 on success, negative error code on failure
+ * @details Only the header and the number of data bytes given by the DLC are read.
+ *          The MCP2515 clears the RXnIF flag of the buffer when the read completes
+*******************************************************************************/
+int mcp2515_read_rx_buffer(uint8_t buffer, uint8_t* frame);
+
 /** ***************************************************************************
  * @brief Request to send a message from one or more transmit buffers
  * 
@@ -119,11 +248,35 @@ int mcp2515_request_to_send(bool txb0, bool txb1, bool txb2);
 /** ***************************************************************************
  * @brief Read the status of the MCP2515
  * 
- * @param[out] rx Buffer to store the read status bytes
+ * @param[out] rx Buffer of 2 bytes to store the read status bytes, see enum mcp2515_status
  * @return int 0 on success, negative error code on failure
 *******************************************************************************/
 int mcp2515_read_status(uint8_t* rx);
 
+/** ***************************************************************************
+ * @brief Set an acceptance filter
+ * 
+ * @param[in] filter Filter number (0-5). Filters 0-1 belong to RXB0, 2-5 to RXB1
+ * @param[in] id 11-bit standard identifier to compare with
+ * @param[in] extended True to match extended frames, false for standard frames
+ * @return int 0 on success, negative error code on failure
+ * @note Only writable in configuration mode. The extended identifier bits are
+ *       set to zero. Node 2 sends its 11-bit IDs in standard frames, so its
+ *       filters in main.c use extended = false
+*******************************************************************************/
+int mcp2515_set_filter(uint8_t filter, uint16_t id, bool extended);
+
+/** ***************************************************************************
+ * @brief Set an acceptance mask
+ * 
+ * @param[in] mask Mask number (0-1). Mask 0 belongs to RXB0, mask 1 to RXB1
+ * @param[in] id_mask Identifier bits to compare, 0 accepts any identifier
+ * @return int 0 on success, negative error code on failure
+ * @note Only writable in configuration mode. The extended identifier bits are
+ *       not compared, so standard frames are never matched on their data bytes
+*******************************************************************************/
+int mcp2515_set_mask(uint8_t mask, uint16_t id_mask);
+
 /** ***************************************************************************
  * @brief Modify specific bits in a MCP2515 register
  * 
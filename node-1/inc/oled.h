@@ -111,10 +111,22 @@ int oled_draw_char(uint8_t page, uint8_t column, char c, char font);
 *******************************************************************************/
 int oled_draw_string(const uint8_t page, const uint8_t column, const uint8_t* s, const uint8_t font);
 
+/** ***************************************************************************
+ * @brief Draw a string stored in flash on the OLED display
+ * 
+ * @param[in] page Page (row) to write in
+ * @param[in] column Column to write in
+ * @param[in] s String in program memory, e.g. from PSTR()
+ * @param[in] font Specifies the font of the character
+ * @return int 0 on success, negative error code on failure
+*******************************************************************************/
+int oled_draw_string_P(const uint8_t page, const uint8_t column, const char* s, const uint8_t font);
+
 /** ***************************************************************************
  * @brief Clear the OLED display
  * 
- * @details Writes 0x00 to all addresses
+ * @details Writes 0x00 to all addresses. Returns once the transfer is queued,
+ *          later OLED calls wait for it to complete
  * @return int 0 on success, negative error code on failure
 *******************************************************************************/
 int oled_clear(void);
\ No newline at end of file
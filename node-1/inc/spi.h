@@ -17,6 +17,45 @@
 #define timeout_loops 100
 #define timeout_delay_us 100
 
+#define SPI_BYTE_DELAY_STEP_US 10   /**< Resolution of the inter-byte delay */
+
+
+/** ***************************************************************************
+ * @brief SPI clock rate as a division of the CPU clock
+ * 
+ * @details The zero value is the fastest rate, so a zero-initialized
+ *          timing profile runs at fck/2
+ ******************************************************************************/
+enum spi_clock_div {
+    SPI_CLOCK_DIV_2 = 0,    /**< fck/2 */
+    SPI_CLOCK_DIV_4,        /**< fck/4 */
+    SPI_CLOCK_DIV_8,        /**< fck/8 */
+    SPI_CLOCK_DIV_16,       /**< fck/16 */
+    SPI_CLOCK_DIV_32,       /**< fck/32 */
+    SPI_CLOCK_DIV_64,       /**< fck/64 */
+    SPI_CLOCK_DIV_128       /**< fck/128 */
+};
+
+/** ***************************************************************************
+ * @brief SPI clock polarity and phase
+ ******************************************************************************/
+enum spi_mode {
+    SPI_MODE_0 = 0,         /**< CPOL = 0, CPHA = 0 */
+    SPI_MODE_1,             /**< CPOL = 0, CPHA = 1 */
+    SPI_MODE_2,             /**< CPOL = 1, CPHA = 0 */
+    SPI_MODE_3              /**< CPOL = 1, CPHA = 1 */
+};
+
+/** ***************************************************************************
+ * @brief Timing profile of an SPI device
+ * 
+ * @details Applied to the bus every time the device is selected
+ ******************************************************************************/
+struct __attribute__((packed)) spi_timing {
+    uint8_t clock_div;      /**< Clock rate, see enum spi_clock_div */
+    uint8_t mode;           /**< Clock polarity and phase, see enum spi_mode */
+    uint8_t byte_delay_us;  /**< Delay after each received byte, in steps of SPI_BYTE_DELAY_STEP_US */
+};
 
 /** ***************************************************************************
  * @brief Structure representing an SPI device
@@ -24,9 +63,54 @@
 struct __attribute__((packed)) spi_device {
     uint8_t id;               /**< Unique ID for the device */
     struct gpio_pin cs_pin;   /**< Chip select pin for the device */
+    struct spi_timing timing; /**< Bus settings for the device */
 };
 
 
+/** ***************************************************************************
+ * @brief One part of a scatter-gather SPI transfer
+ * 
+ * @details size bytes are clocked full-duplex: each byte is taken from tx_data
+ *          and the byte received at the same time is stored in rx_data
+ ******************************************************************************/
+struct spi_segment {
+    const uint8_t* tx_data;     /**< Bytes to send, or NULL to send zeros */
+    uint8_t* rx_data;           /**< Buffer for received bytes, or NULL to discard */
+    uint16_t size;              /**< Number of bytes in the segment */
+};
+
+/** ***************************************************************************
+ * @brief State of an asynchronous SPI transaction
+ * 
+ * @details The zero value is DONE, so a zero-initialized descriptor can be submitted
+ ******************************************************************************/
+enum spi_transaction_state {
+    SPI_TRANS_DONE = 0,     /**< Completed, or never submitted */
+    SPI_TRANS_QUEUED,       /**< Waiting for the bus */
+    SPI_TRANS_ACTIVE        /**< Currently clocking bytes */
+};
+
+/** ***************************************************************************
+ * @brief Descriptor for an asynchronous SPI transaction
+ * 
+ * @details tx_size bytes are sent from tx_data, then rx_size bytes are received
+ *          into rx_data, all under one chip select. The descriptor and buffers
+ *          must stay valid until the transaction is done.
+ *          The callbacks run in interrupt context
+ ******************************************************************************/
+struct spi_transaction {
+    const struct spi_device* device;    /**< Device to select */
+    const uint8_t* tx_data;             /**< Bytes to send, or NULL to send zeros */
+    uint16_t tx_size;                   /**< Number of bytes to send */
+    uint8_t* rx_data;                   /**< Buffer for received bytes, or NULL to discard */
+    uint16_t rx_size;                   /**< Number of bytes to receive after sending */
+    void (*pre)(struct spi_transaction* trans);      /**< Called before CS is asserted, may be NULL */
+    void (*callback)(struct spi_transaction* trans); /**< Called after CS is released, may be NULL */
+    void* arg;                          /**< User data for the callbacks */
+    volatile uint8_t state;             /**< See enum spi_transaction_state */
+    struct spi_transaction* next;       /**< Queue link, owned by the driver */
+};
+
 /** ***************************************************************************
  * @brief Initializes the SPI bus
  * 
@@ -41,6 +125,33 @@ void spi_master_init(struct gpio_pin _mosi_pin, struct gpio_pin _miso_pin, struc
 *******************************************************************************/
 int spi_device_init(const struct spi_device* device);
 
+/** ***************************************************************************
+ * @brief Check if the SPI bus is owned by a transaction
+ * 
+ * @return bool True if a synchronous or asynchronous transaction owns the bus
+ * @note Used by interrupt handlers to avoid corrupting an ongoing transaction
+*******************************************************************************/
+bool spi_is_busy(void);
+
+/** ***************************************************************************
+ * @brief Queue an asynchronous transaction
+ * 
+ * @param[in,out] trans Pointer to the transaction descriptor
+ * @return int 0 on success, negative error code on failure
+ * @details Returns immediately. The bytes are clocked out by the SPI interrupt,
+ *          and trans->state becomes SPI_TRANS_DONE when the transaction completes.
+ *          Devices with an inter-byte delay are not supported
+*******************************************************************************/
+int spi_submit(struct spi_transaction* trans);
+
+/** ***************************************************************************
+ * @brief Wait for an asynchronous transaction to complete
+ * 
+ * @param[in] trans Pointer to the transaction descriptor
+ * @note With interrupts disabled the transfer is polled to completion
+*******************************************************************************/
+void spi_wait(const struct spi_transaction* trans);
+
 /** ***************************************************************************
  * @brief Transmits a single data byte to an SPI device
  * 
@@ -70,6 +181,45 @@ int spi_master_transmit(const struct spi_device* device, uint8_t* data, uint8_t
 *******************************************************************************/
 int spi_receive(const struct spi_device* device, uint8_t* buffer, uint8_t size);
 
+/** ***************************************************************************
+ * @brief Transfers a list of segments to an SPI device under one chip select
+ * 
+ * @param[in] device Pointer to the SPI device structure
+ * @param[in] segments Array of segments, transferred in order
+ * @param[in] count Number of segments
+ * @return int 0 on success, negative error code on failure
+ * @details Bytes go straight between the segment buffers and the bus, so a
+ *          command header and a payload can be sent without copying them together.
+ *          The device's byte delay follows each byte of segments that receive
+*******************************************************************************/
+int spi_transfer_segments(const struct spi_device* device, const struct spi_segment* segments, uint8_t count);
+
+/** ***************************************************************************
+ * @brief Selects a device and claims the bus for a multi-part transaction
+ * 
+ * @param[in] device Pointer to the SPI device structure
+ * @return int 0 on success, negative error code on failure
+ * @details Use with spi_transfer_byte() when the length of a transfer is not
+ *          known up front. Must be ended with spi_end_transaction()
+*******************************************************************************/
+int spi_begin_transaction(const struct spi_device* device);
+
+/** ***************************************************************************
+ * @brief Exchanges a single byte with the currently selected device
+ * 
+ * @param[in] data Data byte to transmit
+ * @return uint8_t Data byte received while transmitting
+*******************************************************************************/
+uint8_t spi_transfer_byte(uint8_t data);
+
+/** ***************************************************************************
+ * @brief Deselects a device and releases the bus
+ * 
+ * @param[in] device Pointer to the SPI device structure
+ * @return int 0 on success, negative error code on failure
+*******************************************************************************/
+int spi_end_transaction(const struct spi_device* device);
+
 /** ***************************************************************************
  * @brief Performs a query operation (transmit then receive) on an SPI device
  * 
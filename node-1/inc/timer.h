@@ -0,0 +1,43 @@
+/** ***************************************************************************
+ * @file timer.h
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Free-running timebase header file
+ * @version 0.1
+ * @date 2025-10-23
+ * 
+ * @copyright Copyright (c) 2025 Byggarane
+ * 
+*******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#define TIMER_PRESCALER 8
+#define TIMER_TICK_HZ (4915200UL / TIMER_PRESCALER)    /**< 614.4 kHz, one tick is 1.628 us */
+
+
+/** ***************************************************************************
+ * @brief Start the timebase on Timer3
+ * 
+ * @details Timer3 runs freely at F_CPU/8 and the overflow interrupt extends it
+ *          to 32 bits. Calling it again does not reset the time
+*******************************************************************************/
+void timer_init(void);
+
+/** ***************************************************************************
+ * @brief Get the current time
+ * 
+ * @return uint32_t Ticks since timer_init(), wraps after about 1.9 hours
+ * @note Safe to call from interrupt handlers
+*******************************************************************************/
+uint32_t timer_now(void);
+
+/** ***************************************************************************
+ * @brief Convert a tick count to microseconds
+ * 
+ * @param[in] ticks Number of ticks
+ * @return uint32_t Microseconds, rounded down
+ * @note Valid for spans up to about 71 minutes, where the result reaches 32 bits
+*******************************************************************************/
+uint32_t timer_ticks_to_us(uint32_t ticks);
@@ -0,0 +1,100 @@
+/** ***************************************************************************
+ * @file timesync.h
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Time synchronisation to the node 2 clock over CAN
+ * @version 0.1
+ * @date 2025-11-26
+ * 
+ * @copyright Copyright (c) 2025 Byggarane
+ * 
+*******************************************************************************/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "can.h"
+
+// The 1 byte SYNC is a standard data frame: SOF 1, ID 11, RTR/IDE/r0 3, DLC 4,
+// data 8, CRC 15, CRC delimiter 1, ACK 2 and EOF 7 bits, 52 bits in total.
+// Stuff bits add up to 10 more, depending on the sequence number, and show up
+// as jitter the filter averages out
+#define TIMESYNC_RX_DELAY_US 208        /**< SYNC start of frame to receive, 52 bits at 250 kbit/s */
+#define TIMESYNC_OUTLIER_US 500         /**< Samples further off than this are ignored when locked */
+#define TIMESYNC_MAX_OUTLIERS 4         /**< Consecutive outliers before the lock is dropped */
+#define TIMESYNC_DRIFT_BASELINE 16      /**< Samples between drift measurements, 8 s at 500 ms */
+#define TIMESYNC_DRIFT_SHIFT 2          /**< Drift filter gain is 1/4 */
+#define TIMESYNC_PPM_SCALE 16           /**< Drift is kept in 1/16 ppm */
+
+
+/** ***************************************************************************
+ * @brief Payload of the CAN_ID_TIME_FOLLOW_UP frame from node 2
+ * 
+ * @note The CAN_ID_TIME_SYNC frame only carries the sequence number
+*******************************************************************************/
+struct __attribute__((packed)) timesync_follow_up_frame {
+    uint8_t seq;                /**< Sequence number of the SYNC frame */
+    uint8_t reserved[3];
+    uint32_t sync_us;           /**< Node 2 time at start of the SYNC frame */
+};
+
+/** ***************************************************************************
+ * @brief Time synchronisation statistics
+*******************************************************************************/
+struct timesync_stats {
+    uint16_t samples;           /**< SYNC/follow-up pairs used */
+    uint16_t outliers;          /**< Pairs ignored for being too far off */
+    uint16_t unmatched;         /**< Follow-ups without a matching SYNC */
+    int32_t last_error_us;      /**< Node 2 time minus our estimate at the last sample */
+    int32_t drift_ppm16;        /**< Node 2 clock rate relative to ours, in 1/16 ppm */
+};
+
+/** ***************************************************************************
+ * @brief Process a SYNC or follow-up frame from node 2
+ * 
+ * @param[in] msg Received CAN_ID_TIME_SYNC or CAN_ID_TIME_FOLLOW_UP frame
+ * @param[in] stamp Receive time from can_receive_stamped()
+ * @return int 0 on success, -EINVAL for a malformed or unrelated frame,
+ *         -ENXIO for a follow-up without its SYNC
+ * @details The receive time of the SYNC frame and node 2's send time from the
+ *          follow-up form one sample. The first sample sets the clock, later
+ *          ones correct half of the remaining error and, every
+ *          TIMESYNC_DRIFT_BASELINE samples, update the drift estimate
+*******************************************************************************/
+int timesync_handle(const struct can_msg* msg, uint32_t stamp);
+
+/** ***************************************************************************
+ * @brief Check whether the clock follows node 2
+ * 
+ * @return true once a sample has been received, until too many outliers
+*******************************************************************************/
+bool timesync_locked(void);
+
+/** ***************************************************************************
+ * @brief Convert a local time to the node 2 time axis
+ * 
+ * @param[in] ticks Time from timer_now()
+ * @return uint32_t Node 2 time in microseconds, 0 if not locked
+ * @note Corrections may move the result back by a few microseconds between calls
+*******************************************************************************/
+uint32_t timesync_to_remote_us(uint32_t ticks);
+
+/** ***************************************************************************
+ * @brief Get the current time on the node 2 time axis
+ * 
+ * @return uint32_t Node 2 time in microseconds, 0 if not locked
+*******************************************************************************/
+uint32_t timesync_now_us(void);
+
+/** ***************************************************************************
+ * @brief Get the synchronisation statistics
+ * 
+ * @param[out] stats Pointer to structure to store a snapshot of the statistics
+*******************************************************************************/
+void timesync_get_stats(struct timesync_stats* stats);
+
+/** ***************************************************************************
+ * @brief Drop the lock and reset all statistics
+*******************************************************************************/
+void timesync_reset(void);
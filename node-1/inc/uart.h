@@ -7,37 +7,107 @@
  * 
  * @copyright Copyright (c) 2025 Byggarane
  * 
+ * @details Interrupt driven. Transmitted bytes are queued in a ring that the
+ *          data register empty interrupt sends from, received bytes are queued
+ *          by the receive complete interrupt. With global interrupts disabled
+ *          the driver falls back to polling, so output before sei() and from
+ *          interrupts still works.
+ * 
  ******************************************************************************/
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdio.h>
 
 #include <avr/io.h>
 
+#define UART_CLOCK_HZ 4915200UL /**< Crystal, divides evenly into the standard baud rates */
 
+/** ***************************************************************************
+ * @brief UBRR value for a baud rate in normal speed mode
+ * 
+ * @details Exact for 4.9152 MHz / 16 / n: 9600, 19200, 38400, 76800,
+ *          153600 and 307200 baud. Check with UART_BAUD_EXACT()
+ ******************************************************************************/
+#define UART_UBRR(baud) (UART_CLOCK_HZ / 16 / (baud) - 1)
+
+/** ***************************************************************************
+ * @brief True if @p baud can be generated without error
+ ******************************************************************************/
+#define UART_BAUD_EXACT(baud) (UART_CLOCK_HZ % (16UL * (baud)) == 0)
+
+// Place the rings in external SRAM instead of internal. Note that the XMEM
+// tests and SRAM_test() overwrite the whole external SRAM
+#define UART_BUFFERS_IN_XMEM 0
+
+#if UART_BUFFERS_IN_XMEM
+#define UART_TX_BUFFER_SIZE 256 /**< Power of two, at most 256 */
+#define UART_RX_BUFFER_SIZE 64  /**< Power of two, at most 256 */
+#else
+#define UART_TX_BUFFER_SIZE 64
+#define UART_RX_BUFFER_SIZE 16
+#endif
+
+/** ***************************************************************************
+ * @brief What uart_transmit() does when the transmit ring is full
+ ******************************************************************************/
+enum uart_tx_policy {
+    UART_TX_BLOCK, /**< Wait for room, the default */
+    UART_TX_DROP   /**< Drop the byte and count it, never waits */
+};
 
 /** ***************************************************************************
  * @brief Initialize the UART with the given UBRR value
  * 
  * @param[in] ubrr The value written to the UBBR register to set the baud rate
+ * @note Bytes still queued from an earlier call are sent first, at the old rate
  ******************************************************************************/
 void uart_init(uint16_t ubrr);
 
 /** ***************************************************************************
- * @brief Transmit a single byte of data via UART
+ * @brief Queue a single byte of data for transmission
  * 
  * @param[in] data The byte to be transmitted
  ******************************************************************************/
 void uart_transmit(uint8_t data);
 
 /** ***************************************************************************
- * @brief Receive a single byte of data via UART
+ * @brief Receive a single byte of data via UART, waits for it
  * 
  * @return uint8_t The received byte
  ******************************************************************************/
 uint8_t uart_receive(void);
 
+/** ***************************************************************************
+ * @brief Check for received data without waiting
+ * 
+ * @return true if uart_receive() would return immediately
+ ******************************************************************************/
+bool uart_rx_available(void);
+
+/** ***************************************************************************
+ * @brief Wait until everything queued has left the transmitter
+ ******************************************************************************/
+void uart_flush(void);
+
+/** ***************************************************************************
+ * @brief Select what happens when the transmit ring is full
+ * 
+ * @param[in] policy New policy
+ ******************************************************************************/
+void uart_tx_policy(enum uart_tx_policy policy);
+
+/** ***************************************************************************
+ * @brief Number of bytes dropped by UART_TX_DROP since uart_init()
+ ******************************************************************************/
+uint16_t uart_tx_dropped(void);
+
+/** ***************************************************************************
+ * @brief Number of received bytes lost to a full receive ring since uart_init()
+ ******************************************************************************/
+uint16_t uart_rx_dropped(void);
+
 /** ***************************************************************************
  * @brief stdio wrapper for uart_transmit
  * 
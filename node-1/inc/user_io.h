@@ -27,6 +27,9 @@
 #define TOUCHPAD_ADC_OUTP_MAX 255
 #define TOUCHPAD_ADC_OUTP_MIN 0
 
+#define INPUT_STATE_RATE_HZ 100
+#define INPUT_STATE_TIMESTAMP_SHIFT 6 /**< Input state timestamps count 64 timer ticks, ~104 us */
+
 #define JOYSTICK_THRESHOLD_UPPER 55
 #define JOYSTICK_THRESHOLD_LOWER 45
 
@@ -108,6 +111,43 @@ struct __attribute__((packed)) buttons
     };
 };
 
+/** ***************************************************************************
+ * @brief Bit positions in input_state_frame.buttons
+ *******************************************************************************/
+enum input_state_btn
+{
+    INPUT_STATE_BTN_JOYSTICK = 0, /**< Joystick button */
+    INPUT_STATE_BTN_RIGHT = 1,    /**< R1-R6 in bits 1-6 */
+    INPUT_STATE_BTN_LEFT = 7,     /**< L1-L6 in bits 7-12 */
+    INPUT_STATE_BTN_PROBE = 15    /**< Not a button, asks node 2 to echo a latency probe */
+};
+
+/** ***************************************************************************
+ * @brief Payload of the CAN_ID_INPUT_STATE frame, sent at INPUT_STATE_RATE_HZ
+ *
+ * @details The sequence number increments by one per frame so node 2 can detect
+ *          lost and reordered frames. The timestamp is the send time in units of
+ *          64 timer ticks and wraps after ~6.8 s
+ *******************************************************************************/
+struct __attribute__((packed)) input_state_frame
+{
+    uint8_t x;          /**< Joystick x in percent */
+    uint8_t y;          /**< Joystick y in percent */
+    uint16_t buttons;   /**< See enum input_state_btn */
+    uint8_t slider;     /**< Touch slider position */
+    uint8_t seq;        /**< Sequence number */
+    uint16_t timestamp; /**< Send time, see INPUT_STATE_TIMESTAMP_SHIFT */
+};
+
+/** ***************************************************************************
+ * @brief Struct for storing touch slider data from SPI
+ *******************************************************************************/
+struct __attribute__((packed)) touch_slider
+{
+    uint8_t x;    /**< Slider position */
+    uint8_t size; /**< Size of the touched area */
+};
+
 /** ***************************************************************************
  * @brief Struct for storing joystick data from SPI
  *******************************************************************************/
@@ -183,6 +223,39 @@ int get_button_states(struct buttons *btn_states);
  *******************************************************************************/
 int get_joystick_states(struct joystick *joystick_states);
 
+/** ***************************************************************************
+ * @brief Get the touch slider state from the user I/O board via SPI
+ *
+ * @param[out] slider Pointer to structure to store the slider state
+ * @return int 0 on success, negative error code on failure
+ *******************************************************************************/
+int get_slider_state(struct touch_slider *slider);
+
+/** ***************************************************************************
+ * @brief Start the input state tick
+ *
+ * @details Timer2 interrupts at INPUT_STATE_RATE_HZ and marks a tick, which the
+ *          main loop picks up with input_state_tick()
+ *******************************************************************************/
+void input_state_init(void);
+
+/** ***************************************************************************
+ * @brief Check for and consume an input state tick
+ *
+ * @return true if a tick has occurred since the last call
+ *******************************************************************************/
+bool input_state_tick(void);
+
+/** ***************************************************************************
+ * @brief Send joystick, buttons and slider to node 2 in one input state frame
+ *
+ * @param[out] msg Buffer for the CAN message
+ * @param[out] btn_states Button states read for the frame, all released if
+ *                        they could not be read. May be NULL
+ * @return int 0 on success, negative error code on failure
+ *******************************************************************************/
+int send_input_state_to_can(struct can_msg *msg, struct buttons *btn_states);
+
 /** ***************************************************************************
  * @brief Send the joystick state to node 2
  *
@@ -195,4 +268,27 @@ int send_joystick_state_to_can(struct can_msg *msg);
  *
  * @return int
  *******************************************************************************/
-int send_js_btn_to_can(struct can_msg *msg);
\ No newline at end of file
+int send_js_btn_to_can(struct can_msg *msg);
+
+/** ***************************************************************************
+ * @brief Send the joystick button press straight from an interrupt
+ *
+ * @param[in] trigger How the preloaded press frame is triggered
+ * @return int 0 on success, negative error code on failure
+ * @details Preloads a pressed CAN_ID_JOYSTICK_BTN frame into the CAN fire buffer.
+ *          With CAN_FIRE_TRIGGER_SPI, Timer0 samples the button and its interrupt
+ *          triggers the frame on the press edge. Sampling starts disabled, see
+ *          js_btn_fire_enable(). Releases must still be sent, with
+ *          send_js_btn_to_can() or the input state frame
+ *******************************************************************************/
+int js_btn_fire_init(enum can_fire_trigger trigger);
+
+/** ***************************************************************************
+ * @brief Start or stop sampling the joystick button for the fire frame
+ *
+ * @param[in] enable True to start sampling, false to stop
+ * @details Only has an effect after js_btn_fire_init() with CAN_FIRE_TRIGGER_SPI.
+ *          Enable it while a game is running, so presses in the menus do not
+ *          send fire frames
+ *******************************************************************************/
+void js_btn_fire_enable(bool enable);
@@ -11,9 +11,23 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #define SRAM_BASE_ADDR 0x1800
 #define SRAM_SIZE 0x800
 
+// Layout of the external SRAM. Offsets are relative to SRAM_BASE_ADDR
+#define XMEM_CAN_RX_QUEUE_OFFSET 0x000  /**< CAN receive queue, see can.c */
+#define XMEM_CAN_RX_QUEUE_SIZE 0x200
+#define XMEM_CAN_TX_QUEUE_OFFSET 0x200  /**< CAN transmit overflow queues, see can.c */
+#define XMEM_CAN_TX_QUEUE_SIZE 0x100
+#define XMEM_CAN_RX_STAMP_OFFSET 0x300  /**< Receive times of the CAN receive queue, see can.c */
+#define XMEM_CAN_RX_STAMP_SIZE 0x080
+#define XMEM_UART_TX_OFFSET 0x380       /**< UART transmit ring with UART_BUFFERS_IN_XMEM, see uart.c */
+#define XMEM_UART_TX_SIZE 0x100
+#define XMEM_UART_RX_OFFSET 0x480       /**< UART receive ring with UART_BUFFERS_IN_XMEM, see uart.c */
+#define XMEM_UART_RX_SIZE 0x040
+
 
 /** ***************************************************************************
  * @brief Initialize the external memory interface
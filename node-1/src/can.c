@@ -10,8 +10,19 @@
 *******************************************************************************/
 
 #include <errno.h>
+
+#include <string.h>
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+
 #include "can.h"
 #include "debug.h"
+#include "gpio.h"
+#include "spi.h"
+#include "timer.h"
+#include "xmem.h"
 
 
 #define CNF1_BRP_POS 0
@@ -24,20 +35,91 @@
 #define CNF3_WAKFIL_POS 6
 #define CNF3_SOF_POS 7
 
+#define RX_QUEUE_MASK (CAN_RX_QUEUE_LEN - 1)
+#define TX_QUEUE_MASK (CAN_TX_QUEUE_LEN - 1)
+
+#define TX_FLAGS (MCP2515_TX0IF | MCP2515_TX1IF | MCP2515_TX2IF)
+#define TXB_CTRL_STRIDE 0x10    /**< Distance between the TXBnCTRL registers */
+#define TX_CLASS_TXP(tx_class) ((tx_class) + 1) /**< TXBnCTRL.TXP of a transmit class, 3 is the highest */
+#define ALL_TX_BUFFERS ((1 << MCP2515_NUM_TX_BUFFERS) - 1)
+#define STATUS_TXREQ(buffer) (MCP2515_STATUS_TX0REQ << (2 * (buffer)))
+#define STATUS_TXIF(buffer) (MCP2515_STATUS_TX0IF << (2 * (buffer)))
+#define NO_TX_CLASS 0xFF         /**< tx_buffer_class of the fire buffer */
+#define ABORT_POLL_LIMIT 100    /**< READ STATUS polls, covers a full frame at 250 kbps */
+
+/**< A frame waiting for a transmit buffer */
+struct tx_entry {
+    uint32_t stamp;             /**< timer_now() when can_send() was called */
+    struct can_msg msg;
+};
+
+_Static_assert((CAN_RX_QUEUE_LEN & RX_QUEUE_MASK) == 0, "CAN_RX_QUEUE_LEN must be a power of two");
+_Static_assert(CAN_RX_QUEUE_LEN * sizeof(struct can_msg) <= XMEM_CAN_RX_QUEUE_SIZE, "CAN receive queue does not fit in its XMEM region");
+_Static_assert(CAN_RX_QUEUE_LEN * sizeof(uint32_t) <= XMEM_CAN_RX_STAMP_SIZE, "CAN receive times do not fit in their XMEM region");
+_Static_assert((CAN_TX_QUEUE_LEN & TX_QUEUE_MASK) == 0, "CAN_TX_QUEUE_LEN must be a power of two");
+_Static_assert(CAN_NUM_TX_CLASSES * CAN_TX_QUEUE_LEN * sizeof(struct tx_entry) <= XMEM_CAN_TX_QUEUE_SIZE, "CAN transmit queues do not fit in their XMEM region");
+
 
 static int can_select_mode(enum can_mode mode);
 static int can_set_timing(struct can_config cfg);
+static int can_set_filters(const struct can_filter_config* filters);
+static void can_int_init(void);
+static int can_drain_rx(void);
+static int can_read_rx_buffer(uint8_t buffer);
+static int can_check_overflow(void);
+static int can_service_begin(void);
+static void can_service_end(void);
+static void can_build_frame(const struct can_msg* msg, uint8_t* frame);
+static int can_tx_load(uint8_t buffer, const struct can_msg* msg, uint8_t tx_class, uint32_t stamp);
+static int can_tx_complete(uint8_t intf);
+static int can_tx_schedule(void);
+static void can_tx_release(uint8_t buffer, uint32_t now);
+static int can_tx_replace(const struct can_msg* msg, uint8_t tx_class, uint32_t stamp);
+static int can_tx_reclaim(void);
+
+/**< Receive queue in external SRAM. Filled by the INT2 ISR, emptied by can_receive() */
+static volatile struct can_msg* const rx_queue = (volatile struct can_msg*)(SRAM_BASE_ADDR + XMEM_CAN_RX_QUEUE_OFFSET);
+/**< timer_now() when each queued frame was read from the MCP2515 */
+static volatile uint32_t* const rx_stamps = (volatile uint32_t*)(SRAM_BASE_ADDR + XMEM_CAN_RX_STAMP_OFFSET);
+static volatile uint8_t rx_head = 0;        /**< Next slot to write, owned by the drain */
+static volatile uint8_t rx_tail = 0;        /**< Next slot to read, owned by can_receive() */
+static volatile bool drain_pending = false; /**< Set when the ISR found the SPI bus busy */
+
+/**< Receive statistics, updated by the drain */
+static volatile struct can_rx_stats rx_stats = {0};
+
+// Transmit state. Only touched by the drain and by can_send() with INT2 disabled
+/**< Transmit overflow queues in external SRAM, one per class */
+static struct tx_entry (* const tx_queue)[CAN_TX_QUEUE_LEN] = (struct tx_entry (*)[CAN_TX_QUEUE_LEN])(SRAM_BASE_ADDR + XMEM_CAN_TX_QUEUE_OFFSET);
+static uint8_t tx_head[CAN_NUM_TX_CLASSES];
+static uint8_t tx_tail[CAN_NUM_TX_CLASSES];
+static uint8_t tx_busy_buffers = 0;         /**< Bit n set while TXBn holds a frame */
+static uint8_t tx_busy_classes = 0;         /**< Bit n set while a frame of class n is in a buffer */
+static uint8_t tx_buffer_class[MCP2515_NUM_TX_BUFFERS];
+static uint32_t tx_buffer_stamp[MCP2515_NUM_TX_BUFFERS];
+static uint8_t tx_replace_classes = 0;      /**< Bit n set if class n replaces pending frames */
+static uint8_t tx_pinned_classes = 0;       /**< Bit n set if the newest frame of class n must not be replaced */
+static bool tx_one_shot = false;
+
+// Fire buffer state. Its bit stays set in tx_busy_buffers, so can_send() never uses it
+static volatile bool fire_enabled = false;
+static volatile bool fire_in_flight = false;
+static volatile uint32_t fire_stamp;
+static volatile struct can_fire_stats fire_stats = {0};
 
-uint8_t rx_data[13] = {0};
+/**< Transmit statistics, updated by the drain */
+static volatile struct can_tx_stats tx_stats = {0};
 
 /** ***************************************************************************
  * @brief Initialize the CAN controller (MCP2515) and set operation mode
  * 
  * @param[in] mcp2515_dev Pointer to SPI device structure for the MCP2515
  * @param[in] mode CAN operating mode to set
+ * @param[in] cfg Bit timing configuration
+ * @param[in] filters Acceptance filters, or NULL to accept every frame
  * @return int 0 on success, negative error code on failure
 *******************************************************************************/
-int can_init(const struct spi_device* mcp2515_dev, enum can_mode mode, struct can_config cfg) {
+int can_init(const struct spi_device* mcp2515_dev, enum can_mode mode, struct can_config cfg, const struct can_filter_config* filters) {
     int ret = mcp2515_init(mcp2515_dev);
     if(ret) {
         return ret;
@@ -50,50 +132,126 @@ int can_init(const struct spi_device* mcp2515_dev, enum can_mode mode, struct ca
     if(ret) {
         return ret;
     }
-    return can_select_mode(mode);
+    // The reset cleared the masks, so without filters every frame is accepted
+    if (filters) {
+        ret = can_set_filters(filters);
+        if(ret) {
+            return ret;
+        }
+    }
+    // Let frames roll over into RXB1 while RXB0 is full, instead of being lost
+    ret = mcp2515_bit_modify(MCP2515_RXB0CTRL, MCP2515_RXB_BUKT, MCP2515_RXB_BUKT);
+    if(ret) {
+        return ret;
+    }
+    // The error interrupt reports receive buffer overflows, the transmit interrupts free buffers
+    ret = mcp2515_write(MCP2515_CANINTE, MCP2515_RX0IF | MCP2515_RX1IF | MCP2515_ERRIF | TX_FLAGS);
+    if(ret) {
+        return ret;
+    }
+    ret = can_select_mode(mode);
+    if(ret) {
+        return ret;
+    }
+
+    // The reset aborted anything that was in the transmit buffers
+    memset(tx_head, 0, sizeof(tx_head));
+    memset(tx_tail, 0, sizeof(tx_tail));
+    tx_busy_buffers = 0;
+    tx_busy_classes = 0;
+    tx_pinned_classes = 0;
+    tx_one_shot = false;
+    fire_enabled = false;
+    fire_in_flight = false;
+
+    timer_init();
+    can_int_init();
+    return 0;
 }
 
 /** ***************************************************************************
- * @brief Send a CAN message
+ * @brief Helper function to send a CAN message
  * 
  * @param[in] msg Pointer to the CAN message to send
- * @return int 0 on success, negative error code on failure
+ * @param[in] pinned True if a later frame of a replacing class must queue behind it
+ * @return int 0 on success, -EAGAIN if the frame was dropped, negative error code on failure
 *******************************************************************************/
-int can_send(const struct can_msg* msg) {
+static int can_send_frame(const struct can_msg* msg, bool pinned) {
     if (!msg || msg->dlc > 8) {
         return -EINVAL;
     }
-    
-    // Prepare transmit buffer data (13 bytes total)
-    // SIDH, SIDL, EID8, EID0, DLC, DATA0-7
-    uint8_t tx_data[13] = {0};
-    
-    // Standard Identifier High (bits 10-3 of ID)
-    tx_data[0] = (msg->id >> 3) & 0xFF;
-    
-    // Standard Identifier Low (bits 2-0 in bits 7-5)
-    tx_data[1] = (msg->id << 5) & 0xE0;
-    
-    // EID8 and EID0 are left as 0 (not using extended IDs)
-    tx_data[2] = 0; // EID8
-    tx_data[3] = 0; // EID0
-    
-    // Data Length Code (lower 4 bits)
-    tx_data[4] = msg->dlc & 0x0F;
-    
-    // Copy data bytes
-    for (uint8_t i = 0; i < msg->dlc; i++) {
-        tx_data[5 + i] = msg->bytes[i];
+
+    uint32_t stamp = timer_now();
+    uint8_t tx_class = can_tx_class_of(msg->id);
+
+    int ret = can_service_begin();
+    if (!ret && tx_one_shot) {
+        ret = can_tx_reclaim();
     }
-    
-    // Write all data to TXB0 starting at SIDH register
-    int ret = mcp2515_write_multiple(MCP2515_TXB0SIDH, tx_data, 13);
     if (ret) {
+        can_service_end();
         return ret;
     }
-    
-    // Request to send from TXB0
-    return mcp2515_request_to_send(true, false, false);
+
+    // Go straight to a buffer unless that would overtake an earlier frame of the class
+    uint8_t head = tx_head[tx_class];
+    bool class_idle = !(tx_busy_classes & (1 << tx_class)) && head == tx_tail[tx_class];
+    bool replace = (tx_replace_classes & ~tx_pinned_classes) & (1 << tx_class);
+    if (pinned) {
+        tx_pinned_classes |= (1 << tx_class);
+    } else {
+        tx_pinned_classes &= ~(1 << tx_class);
+    }
+    if (replace && head != tx_tail[tx_class]) {
+        // Overwrite the newest queued frame instead of adding another
+        struct tx_entry* entry = &tx_queue[tx_class][(head - 1) & TX_QUEUE_MASK];
+        entry->stamp = stamp;
+        memcpy(&entry->msg, msg, sizeof(*msg));
+        tx_stats.classes[tx_class].replaced++;
+    } else if (replace && (tx_busy_classes & (1 << tx_class))) {
+        ret = can_tx_replace(msg, tx_class, stamp);
+    } else if (class_idle && tx_busy_buffers != ALL_TX_BUFFERS) {
+        uint8_t buffer = 0;
+        while (tx_busy_buffers & (1 << buffer)) {
+            buffer++;
+        }
+        ret = can_tx_load(buffer, msg, tx_class, stamp);
+    } else {
+        uint8_t next = (head + 1) & TX_QUEUE_MASK;
+        if (next != tx_tail[tx_class]) {
+            struct tx_entry* entry = &tx_queue[tx_class][head];
+            entry->stamp = stamp;
+            memcpy(&entry->msg, msg, sizeof(*msg));
+            tx_head[tx_class] = next;
+            tx_stats.classes[tx_class].queued++;
+        } else {
+            tx_stats.classes[tx_class].drops++;
+            ret = -EAGAIN;
+        }
+    }
+
+    can_service_end();
+    return ret;
+}
+
+/** ***************************************************************************
+ * @brief Send a CAN message
+ * 
+ * @param[in] msg Pointer to the CAN message to send
+ * @return int 0 on success, -EAGAIN if the frame was dropped, negative error code on failure
+*******************************************************************************/
+int can_send(const struct can_msg* msg) {
+    return can_send_frame(msg, false);
+}
+
+/** ***************************************************************************
+ * @brief Send a CAN message that a replacing class must not overwrite
+ * 
+ * @param[in] msg Pointer to the CAN message to send
+ * @return int 0 on success, -EAGAIN if the frame was dropped, negative error code on failure
+*******************************************************************************/
+int can_send_pinned(const struct can_msg* msg) {
+    return can_send_frame(msg, true);
 }
 
 /** ***************************************************************************
@@ -103,63 +261,702 @@ int can_send(const struct can_msg* msg) {
  * @return int 0 on success, negative error code on failure
 *******************************************************************************/
 int can_receive(struct can_msg* msg) {
+    return can_receive_stamped(msg, NULL);
+}
+
+int can_receive_stamped(struct can_msg* msg, uint32_t* stamp) {
     if (!msg) {
         return -EINVAL;
     }
-    
-    // Check interrupt flags to see if a message is available
+
+    // The ISR could not use the bus, so drain the MCP2515 from here instead
+    if (drain_pending) {
+        int ret = can_service_begin();
+        can_service_end();
+        if (ret) {
+            return ret;
+        }
+    }
+
+    uint8_t tail = rx_tail;
+    if (tail == rx_head) {
+        return -EAGAIN; // No message available
+    }
+
+    volatile struct can_msg* slot = &rx_queue[tail];
+    msg->id = slot->id;
+    msg->dlc = slot->dlc;
+    for (uint8_t i = 0; i < msg->dlc; i++) {
+        msg->bytes[i] = slot->bytes[i];
+    }
+    if (stamp) {
+        *stamp = rx_stamps[tail];
+    }
+
+    rx_tail = (tail + 1) & RX_QUEUE_MASK;
+    return 0;
+}
+
+/** ***************************************************************************
+ * @brief MCP2515 interrupt handler
+ * 
+ * @details Drains the receive buffers into the receive queue and refills free
+ *          transmit buffers. If the main loop is in the middle of an SPI transaction
+ *          the drain is deferred to the next call to can_receive() or can_send()
+*******************************************************************************/
+ISR(INT2_vect) {
+    if (spi_is_busy()) {
+        drain_pending = true;
+        return;
+    }
+    (void)can_drain_rx();
+}
+
+/** ***************************************************************************
+ * @brief Helper function to get exclusive access to the MCP2515 from the main loop
+ * 
+ * @return int 0 on success, negative error code if a deferred drain failed
+ * @details Disables INT2 and runs a drain the ISR had to defer.
+ *          Must be followed by can_service_end(), also on failure
+*******************************************************************************/
+static int can_service_begin(void) {
+    GICR &= ~(1 << INT2);
+    if (drain_pending) {
+        drain_pending = false;
+        return can_drain_rx();
+    }
+    return 0;
+}
+
+/** ***************************************************************************
+ * @brief Helper function to hand the MCP2515 back to the ISR
+*******************************************************************************/
+static void can_service_end(void) {
+    GICR |= (1 << INT2);
+}
+
+/** ***************************************************************************
+ * @brief Helper function to set up the external interrupt for the MCP2515 INT pin
+ * 
+ * @details The INT pin is active low and stays low until all enabled flags are cleared,
+ *          so a falling edge is generated for every burst of received frames
+*******************************************************************************/
+static void can_int_init(void) {
+    gpio_init(CAN_INT_PIN, INPUT);
+    gpio_set(CAN_INT_PIN, HIGH); // Enable pull-up
+
+    // Disable INT2 while changing the sense control to avoid a spurious interrupt
+    GICR &= ~(1 << INT2);
+    EMCUCR &= ~(1 << ISC2); // Falling edge
+    GIFR = (1 << INTF2);
+    GICR |= (1 << INT2);
+}
+
+/** ***************************************************************************
+ * @brief Helper function to move all received frames from the MCP2515 to the receive queue,
+ *        and to refill transmit buffers that have been sent
+ * 
+ * @return int 0 on success, negative error code on failure
+ * @note Must not run concurrently with itself. Called from the ISR, or with INT2 disabled
+*******************************************************************************/
+static int can_drain_rx(void) {
     uint8_t intf;
     int ret = mcp2515_read(MCP2515_CANINTF, &intf);
     if (ret) {
         return ret;
     }
-    
-    // Check if RXB0 has a message (bit 0)
-    bool rxb0_full = intf & 0x01;
-    // Check if RXB1 has a message (bit 1)
-    bool rxb1_full = intf & 0x02;
-    
-    if (!rxb0_full && !rxb1_full) {
-        return -EAGAIN; // No message available
+
+    while (intf & (MCP2515_RX0IF | MCP2515_RX1IF | MCP2515_ERRIF | TX_FLAGS)) {
+        // Usually RXB0 holds the older frame, as rollover only fills RXB1 while
+        // RXB0 is full. If RXB0 was read and refilled while RXB1 still waited,
+        // RXB1 is older and the two are queued swapped
+        if (intf & MCP2515_RX0IF) {
+            ret = can_read_rx_buffer(0);
+            if (ret) {
+                return ret;
+            }
+        }
+        if (intf & MCP2515_RX1IF) {
+            ret = can_read_rx_buffer(1);
+            if (ret) {
+                return ret;
+            }
+        }
+        if (intf & MCP2515_ERRIF) {
+            ret = can_check_overflow();
+            if (ret) {
+                return ret;
+            }
+        }
+        if (intf & TX_FLAGS) {
+            ret = can_tx_complete(intf);
+            if (ret) {
+                return ret;
+            }
+        }
+
+        // Frames may have arrived while the buffers were read
+        ret = mcp2515_read(MCP2515_CANINTF, &intf);
+        if (ret) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+/** ***************************************************************************
+ * @brief Helper function to read one receive buffer into the receive queue
+ * 
+ * @param[in] buffer Receive buffer number (0-1)
+ * @return int 0 on success, negative error code on failure
+ * @details The frame is dropped if the queue is full. The MCP2515 clears the
+ *          buffer's flag either way, so the INT pin is released and later
+ *          frames still raise an interrupt
+*******************************************************************************/
+static int can_read_rx_buffer(uint8_t buffer) {
+    uint8_t rx_data[MCP2515_FRAME_MAX_SIZE];
+    uint32_t stamp = timer_now();
+    int ret = mcp2515_read_rx_buffer(buffer, rx_data);
+    if (ret) {
+        return ret;
+    }
+
+    uint8_t head = rx_head;
+    uint8_t next = (head + 1) & RX_QUEUE_MASK;
+    if (next != rx_tail) {
+        volatile struct can_msg* slot = &rx_queue[head];
+
+        // Extract Standard Identifier (11 bits)
+        // SIDH contains bits 10-3, SIDL bits 7-5 contain bits 2-0
+        slot->id = ((uint32_t)rx_data[0] << 3) | ((rx_data[1] >> 5) & 0x07);
+
+        // Extract Data Length Code (lower 4 bits)
+        uint8_t dlc = rx_data[4] & MCP2515_DLC_MASK;
+        if (dlc > MCP2515_MAX_DLC) {
+            dlc = MCP2515_MAX_DLC;
+        }
+        slot->dlc = dlc;
+
+        // Copy data bytes
+        for (uint8_t i = 0; i < dlc; i++) {
+            slot->bytes[i] = rx_data[5 + i];
+        }
+        rx_stamps[head] = stamp;
+
+        rx_head = next;
+    } else {
+        rx_stats.queue_drops++;
     }
-    
-    // Read from RXB0 if available, otherwise RXB1
-    uint8_t rx_base = rxb0_full ? MCP2515_RXB0SIDH : MCP2515_RXB1SIDH;
-    uint8_t flag_bit1 = 0x01;
-    uint8_t flag_bit2 = 0x02;
 
-    // Read receive buffer data (13 bytes: SIDH, SIDL, EID8, EID0, DLC, DATA0-7)
-    ret = mcp2515_read_multiple(rx_base, rx_data, 13);
+    if (buffer == 0) {
+        rx_stats.rx0_frames++;
+    } else {
+        rx_stats.rx1_frames++;
+    }
+
+    return 0;
+}
+
+/** ***************************************************************************
+ * @brief Helper function to count and clear receive buffer overflows
+ * 
+ * @return int 0 on success, negative error code on failure
+ * @details The overflow bits in EFLG are not cleared by the MCP2515 itself
+*******************************************************************************/
+static int can_check_overflow(void) {
+    uint8_t eflg;
+    int ret = mcp2515_read(MCP2515_EFLG, &eflg);
     if (ret) {
         return ret;
     }
+
+    if (eflg & MCP2515_RX0OVR) {
+        rx_stats.rx0_overflows++;
+    }
+    if (eflg & MCP2515_RX1OVR) {
+        rx_stats.rx1_overflows++;
+    }
+
+    uint8_t overflows = eflg & (MCP2515_RX0OVR | MCP2515_RX1OVR);
+    if (overflows) {
+        ret = mcp2515_bit_modify(MCP2515_EFLG, overflows, 0x00);
+        if (ret) {
+            return ret;
+        }
+    }
+
+    return mcp2515_bit_modify(MCP2515_CANINTF, MCP2515_ERRIF, 0x00);
+}
+
+/** ***************************************************************************
+ * @brief Helper function to convert a message to the MCP2515 buffer layout
+ * 
+ * @param[in] msg Pointer to the CAN message
+ * @param[out] frame Buffer of MCP2515_FRAME_MAX_SIZE bytes: SIDH, SIDL, EID8, EID0, DLC, DATA0-7
+*******************************************************************************/
+static void can_build_frame(const struct can_msg* msg, uint8_t* frame) {
+    // Standard Identifier High (bits 10-3 of ID)
+    frame[0] = (msg->id >> 3) & 0xFF;
     
-    // Extract Standard Identifier (11 bits)
-    // SIDH contains bits 10-3, SIDL bits 7-5 contain bits 2-0
-    msg->id = ((uint32_t)rx_data[0] << 3) | ((rx_data[1] >> 5) & 0x07);
+    // Standard Identifier Low (bits 2-0 in bits 7-5)
+    frame[1] = (msg->id << 5) & 0xE0;
     
-    // Extract Data Length Code (lower 4 bits)
-    msg->dlc = rx_data[4] & 0x0F;
-    if (msg->dlc > 8) {
-        msg->dlc = 8; // Clamp to maximum
-    }
+    // EID8 and EID0 are left as 0 (not using extended IDs)
+    frame[2] = 0; // EID8
+    frame[3] = 0; // EID0
+    
+    // Data Length Code (lower 4 bits)
+    frame[4] = msg->dlc & MCP2515_DLC_MASK;
     
     // Copy data bytes
     for (uint8_t i = 0; i < msg->dlc; i++) {
-        msg->bytes[i] = rx_data[5 + i];
+        frame[5 + i] = msg->bytes[i];
     }
-    
-    // Clear the receive interrupt flag
-    ret = mcp2515_bit_modify(MCP2515_CANINTF, flag_bit1, 0x00);
+}
 
-    ret = mcp2515_bit_modify(MCP2515_CANINTF, flag_bit2, 0x00);
+/** ***************************************************************************
+ * @brief Helper function to load a frame into a transmit buffer and send it
+ * 
+ * @param[in] buffer Free transmit buffer number (0-2)
+ * @param[in] msg Pointer to the CAN message
+ * @param[in] tx_class Transmit class of the message
+ * @param[in] stamp Time the message was passed to can_send()
+ * @return int 0 on success, negative error code on failure
+*******************************************************************************/
+static int can_tx_load(uint8_t buffer, const struct can_msg* msg, uint8_t tx_class, uint32_t stamp) {
+    uint8_t frame[MCP2515_FRAME_MAX_SIZE];
+    can_build_frame(msg, frame);
+
+    int ret = mcp2515_write(MCP2515_TXB0CTRL + buffer * TXB_CTRL_STRIDE, TX_CLASS_TXP(tx_class));
     if (ret) {
         return ret;
     }
-    
+    ret = mcp2515_load_tx_buffer(buffer, frame);
+    if (ret) {
+        return ret;
+    }
+    ret = mcp2515_request_to_send(buffer == 0, buffer == 1, buffer == 2);
+    if (ret) {
+        return ret;
+    }
+
+    tx_busy_buffers |= (1 << buffer);
+    tx_busy_classes |= (1 << tx_class);
+    tx_buffer_class[buffer] = tx_class;
+    tx_buffer_stamp[buffer] = stamp;
+    return 0;
+}
+
+/** ***************************************************************************
+ * @brief Helper function to release transmit buffers that have been sent
+ * 
+ * @param[in] intf Value of CANINTF
+ * @return int 0 on success, negative error code on failure
+*******************************************************************************/
+static int can_tx_complete(uint8_t intf) {
+    uint8_t flags = intf & TX_FLAGS;
+    int ret = mcp2515_bit_modify(MCP2515_CANINTF, flags, 0x00);
+    if (ret) {
+        return ret;
+    }
+
+    uint32_t now = timer_now();
+    for (uint8_t buffer = 0; buffer < MCP2515_NUM_TX_BUFFERS; buffer++) {
+        if (!(flags & (MCP2515_TX0IF << buffer)) || !(tx_busy_buffers & (1 << buffer))) {
+            continue;
+        }
+
+        if (fire_enabled && buffer == CAN_FIRE_TX_BUFFER) {
+            fire_stats.sent++;
+            if (fire_in_flight) {
+                uint32_t latency_us = timer_ticks_to_us(now - fire_stamp);
+                fire_stats.total_latency_us += latency_us;
+                if (latency_us > fire_stats.max_latency_us) {
+                    fire_stats.max_latency_us = latency_us;
+                }
+                fire_in_flight = false;
+            }
+        } else {
+            can_tx_release(buffer, now);
+        }
+    }
+
+    return can_tx_schedule();
+}
+
+/** ***************************************************************************
+ * @brief Helper function to free a transmit buffer whose frame has been sent
+ * 
+ * @param[in] buffer Transmit buffer number (0-2)
+ * @param[in] now Time the transmission was seen to complete
+*******************************************************************************/
+static void can_tx_release(uint8_t buffer, uint32_t now) {
+    uint8_t tx_class = tx_buffer_class[buffer];
+    uint32_t latency_us = timer_ticks_to_us(now - tx_buffer_stamp[buffer]);
+    volatile struct can_tx_class_stats* stats = &tx_stats.classes[tx_class];
+    stats->sent++;
+    stats->total_latency_us += latency_us;
+    if (latency_us > stats->max_latency_us) {
+        stats->max_latency_us = latency_us;
+    }
+
+    tx_busy_buffers &= ~(1 << buffer);
+    tx_busy_classes &= ~(1 << tx_class);
+}
+
+/** ***************************************************************************
+ * @brief Helper function to overwrite the pending frame of a class in its buffer
+ * 
+ * @param[in] msg Pointer to the new CAN message
+ * @param[in] tx_class Transmit class, must have a frame in a buffer
+ * @param[in] stamp Time the message was passed to can_send()
+ * @return int 0 on success, negative error code on failure
+ * @details Clearing TXREQ aborts the frame, unless it is already on the bus.
+ *          Then the abort takes effect when the frame completes, so wait for
+ *          TXREQ to clear and check TXnIF to see which of the two happened
+*******************************************************************************/
+static int can_tx_replace(const struct can_msg* msg, uint8_t tx_class, uint32_t stamp) {
+    uint8_t buffer = 0;
+    while (!(tx_busy_buffers & (1 << buffer)) || tx_buffer_class[buffer] != tx_class) {
+        buffer++;
+    }
+
+    int ret = mcp2515_bit_modify(MCP2515_TXB0CTRL + buffer * TXB_CTRL_STRIDE, MCP2515_TXB_TXREQ, 0x00);
+    if (ret) {
+        return ret;
+    }
+
+    uint8_t status[2];
+    uint8_t polls = 0;
+    do {
+        if (++polls > ABORT_POLL_LIMIT) {
+            return -EIO;
+        }
+        ret = mcp2515_read_status(status);
+        if (ret) {
+            return ret;
+        }
+    } while (status[0] & STATUS_TXREQ(buffer));
+
+    if (status[0] & STATUS_TXIF(buffer)) {
+        // Too late, the old frame was sent
+        ret = mcp2515_bit_modify(MCP2515_CANINTF, MCP2515_TX0IF << buffer, 0x00);
+        if (ret) {
+            return ret;
+        }
+        can_tx_release(buffer, timer_now());
+    } else {
+        tx_stats.classes[tx_class].replaced++;
+        tx_busy_buffers &= ~(1 << buffer);
+        tx_busy_classes &= ~(1 << tx_class);
+    }
+
+    return can_tx_load(buffer, msg, tx_class, stamp);
+}
+
+/** ***************************************************************************
+ * @brief Helper function to free buffers whose frame failed in one-shot mode
+ * 
+ * @return int 0 on success, negative error code on failure
+ * @details A failed one-shot frame clears TXREQ without setting TXnIF, so no
+ *          interrupt reports it. Checked with one READ STATUS before each send
+*******************************************************************************/
+static int can_tx_reclaim(void) {
+    if (!tx_busy_buffers) {
+        return 0;
+    }
+
+    uint8_t status[2];
+    int ret = mcp2515_read_status(status);
+    if (ret) {
+        return ret;
+    }
+
+    bool freed = false;
+    for (uint8_t buffer = 0; buffer < MCP2515_NUM_TX_BUFFERS; buffer++) {
+        uint8_t pending = STATUS_TXREQ(buffer) | STATUS_TXIF(buffer);
+        if (tx_buffer_class[buffer] == NO_TX_CLASS) {
+            continue;
+        }
+        if ((tx_busy_buffers & (1 << buffer)) && !(status[0] & pending)) {
+            uint8_t tx_class = tx_buffer_class[buffer];
+            tx_stats.classes[tx_class].drops++;
+            tx_busy_buffers &= ~(1 << buffer);
+            tx_busy_classes &= ~(1 << tx_class);
+            freed = true;
+        }
+    }
+
+    return freed ? can_tx_schedule() : 0;
+}
+
+/** ***************************************************************************
+ * @brief Helper function to move queued frames into free transmit buffers
+ * 
+ * @return int 0 on success, negative error code on failure
+ * @details The highest class is served first. A class only has one frame in
+ *          the buffers at a time, since the MCP2515 sends buffers of equal
+ *          priority by buffer number rather than in load order
+*******************************************************************************/
+static int can_tx_schedule(void) {
+    for (int8_t tx_class = CAN_NUM_TX_CLASSES - 1; tx_class >= 0; tx_class--) {
+        if (tx_busy_buffers == ALL_TX_BUFFERS) {
+            break;
+        }
+
+        uint8_t tail = tx_tail[tx_class];
+        if ((tx_busy_classes & (1 << tx_class)) || tail == tx_head[tx_class]) {
+            continue;
+        }
+
+        uint8_t buffer = 0;
+        while (tx_busy_buffers & (1 << buffer)) {
+            buffer++;
+        }
+
+        struct tx_entry* entry = &tx_queue[tx_class][tail];
+        int ret = can_tx_load(buffer, &entry->msg, tx_class, entry->stamp);
+        if (ret) {
+            return ret;
+        }
+        tx_tail[tx_class] = (tail + 1) & TX_QUEUE_MASK;
+    }
+
+    return 0;
+}
+
+/** ***************************************************************************
+ * @brief Get the transmit class of a message identifier
+ * 
+ * @param[in] id Message identifier
+ * @return enum can_tx_class Class used to prioritize the message
+*******************************************************************************/
+enum can_tx_class can_tx_class_of(uint32_t id) {
+    switch (id) {
+        case CAN_ID_JOYSTICK_BTN:
+            return CAN_TX_CLASS_BUTTON;
+        case CAN_ID_JOYSTICK:
+        case CAN_ID_INPUT_STATE:
+            return CAN_TX_CLASS_JOYSTICK;
+        default:
+            return CAN_TX_CLASS_STATUS;
+    }
+}
+
+/** ***************************************************************************
+ * @brief Set whether new frames of a class replace a pending one
+ * 
+ * @param[in] tx_class Transmit class
+ * @param[in] replace True to replace, false to queue
+ * @return int 0 on success, negative error code on failure
+*******************************************************************************/
+int can_set_tx_replace(enum can_tx_class tx_class, bool replace) {
+    if (tx_class >= CAN_NUM_TX_CLASSES) {
+        return -EINVAL;
+    }
+
+    // Frames already queued stay queued, only new frames replace
+    if (replace) {
+        tx_replace_classes |= (1 << tx_class);
+    } else {
+        tx_replace_classes &= ~(1 << tx_class);
+    }
     return 0;
 }
 
+/** ***************************************************************************
+ * @brief Enable or disable one-shot mode
+ * 
+ * @param[in] enable True to attempt each frame only once
+ * @return int 0 on success, negative error code on failure
+*******************************************************************************/
+int can_set_one_shot(bool enable) {
+    int ret = can_service_begin();
+    if (!ret) {
+        ret = mcp2515_bit_modify(MCP2515_CANCTRL, MCP2515_CANCTRL_OSM, enable ? MCP2515_CANCTRL_OSM : 0x00);
+    }
+    if (!ret) {
+        tx_one_shot = enable;
+    }
+    can_service_end();
+    return ret;
+}
+
+/** ***************************************************************************
+ * @brief Preload a frame into the reserved fire buffer
+ * 
+ * @param[in] msg Frame to send each time the buffer is triggered
+ * @param[in] trigger How the frame is triggered
+ * @return int 0 on success, -EBUSY if the buffer still holds a frame from
+ *         can_send(), negative error code on failure
+*******************************************************************************/
+int can_fire_init(const struct can_msg* msg, enum can_fire_trigger trigger) {
+    if (!msg || msg->dlc > 8 || trigger > CAN_FIRE_TRIGGER_RTS_PIN) {
+        return -EINVAL;
+    }
+
+    int ret = can_service_begin();
+    if (ret) {
+        can_service_end();
+        return ret;
+    }
+
+    // can_send() may still have a frame in the buffer. Waiting for it here
+    // would hang before sei(), as only the interrupt frees it
+    if (tx_buffer_class[CAN_FIRE_TX_BUFFER] != NO_TX_CLASS &&
+        (tx_busy_buffers & (1 << CAN_FIRE_TX_BUFFER))) {
+        can_service_end();
+        return -EBUSY;
+    }
+    tx_busy_buffers |= (1 << CAN_FIRE_TX_BUFFER);
+    tx_buffer_class[CAN_FIRE_TX_BUFFER] = NO_TX_CLASS;
+
+    uint8_t frame[MCP2515_FRAME_MAX_SIZE];
+    can_build_frame(msg, frame);
+    ret = mcp2515_write(MCP2515_TXB0CTRL + CAN_FIRE_TX_BUFFER * TXB_CTRL_STRIDE, MCP2515_TXB_TXP_MASK);
+    if (!ret) {
+        ret = mcp2515_load_tx_buffer(CAN_FIRE_TX_BUFFER, frame);
+    }
+
+    // TXRTSCTRL can only be written in configuration mode
+    if (!ret && trigger == CAN_FIRE_TRIGGER_RTS_PIN) {
+        uint8_t canstat;
+        ret = mcp2515_read(MCP2515_CANSTAT, &canstat);
+        if (!ret) {
+            ret = can_select_mode(CAN_MODE_CONFIG);
+        }
+        if (!ret) {
+            ret = mcp2515_write(MCP2515_TXRTSCTRL, MCP2515_B0RTSM << CAN_FIRE_TX_BUFFER);
+        }
+        if (!ret) {
+            ret = can_select_mode((canstat & CAN_MODE_MASK) >> CAN_MODE_OFFSET);
+        }
+    }
+
+    if (!ret) {
+        fire_in_flight = false;
+        fire_enabled = true;
+    }
+
+    can_service_end();
+    return ret;
+}
+
+/** ***************************************************************************
+ * @brief Send the preloaded fire frame
+ * 
+ * @return int 0 on success, -EBUSY if the SPI bus or the fire buffer is busy,
+ *         negative error code on failure
+*******************************************************************************/
+int can_fire(void) {
+    if (!fire_enabled) {
+        return -EINVAL;
+    }
+
+    int ret = -EBUSY;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        // A failed one-shot frame clears TXREQ without setting TX2IF, so the
+        // interrupt never ends the flight. Ask the buffer instead
+        if (fire_in_flight && tx_one_shot && !spi_is_busy()) {
+            uint8_t ctrl;
+            if (!mcp2515_read(MCP2515_TXB0CTRL + CAN_FIRE_TX_BUFFER * TXB_CTRL_STRIDE, &ctrl) &&
+                !(ctrl & MCP2515_TXB_TXREQ) &&
+                (ctrl & (MCP2515_TXB_TXERR | MCP2515_TXB_MLOA | MCP2515_TXB_ABTF))) {
+                fire_stats.failed++;
+                fire_in_flight = false;
+            }
+        }
+
+        // Claiming the bus from here could mean waiting for a whole OLED transfer
+        if (!fire_in_flight && !spi_is_busy()) {
+            fire_stamp = timer_now();
+            fire_in_flight = true;
+            ret = mcp2515_request_to_send(CAN_FIRE_TX_BUFFER == 0, CAN_FIRE_TX_BUFFER == 1, CAN_FIRE_TX_BUFFER == 2);
+            if (ret) {
+                fire_in_flight = false;
+            }
+        }
+    }
+
+    if (ret == -EBUSY) {
+        fire_stats.busy++;
+    } else if (!ret) {
+        fire_stats.fired++;
+    }
+    return ret;
+}
+
+/** ***************************************************************************
+ * @brief Get the fire frame statistics
+ * 
+ * @param[out] stats Pointer to structure to store a snapshot of the statistics
+ * @return int 0 on success, negative error code on failure
+*******************************************************************************/
+int can_get_fire_stats(struct can_fire_stats* stats) {
+    if (!stats) {
+        return -EINVAL;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        memcpy(stats, (const void*)&fire_stats, sizeof(*stats));
+    }
+    return 0;
+}
+
+/** ***************************************************************************
+ * @brief Get the transmit statistics
+ * 
+ * @param[out] stats Pointer to structure to store a snapshot of the statistics
+ * @return int 0 on success, negative error code on failure
+*******************************************************************************/
+int can_get_tx_stats(struct can_tx_stats* stats) {
+    if (!stats) {
+        return -EINVAL;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        memcpy(stats, (const void*)&tx_stats, sizeof(*stats));
+    }
+    return 0;
+}
+
+/** ***************************************************************************
+ * @brief Reset all transmit statistics to zero
+*******************************************************************************/
+void can_reset_tx_stats(void) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        memset((void*)&tx_stats, 0, sizeof(tx_stats));
+        memset((void*)&fire_stats, 0, sizeof(fire_stats));
+    }
+}
+
+/** ***************************************************************************
+ * @brief Get the receive statistics
+ * 
+ * @param[out] stats Pointer to structure to store a snapshot of the statistics
+ * @return int 0 on success, negative error code on failure
+*******************************************************************************/
+int can_get_rx_stats(struct can_rx_stats* stats) {
+    if (!stats) {
+        return -EINVAL;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        memcpy(stats, (const void*)&rx_stats, sizeof(*stats));
+    }
+    return 0;
+}
+
+/** ***************************************************************************
+ * @brief Reset all receive statistics to zero
+*******************************************************************************/
+void can_reset_rx_stats(void) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        memset((void*)&rx_stats, 0, sizeof(rx_stats));
+    }
+}
+
 /** ***************************************************************************
  * @brief Helper function to set the CAN controller's operation mode
  * 
@@ -221,3 +1018,26 @@ static int can_set_timing(struct can_config cfg) {
     
     return 0;
 }
+
+/** ***************************************************************************
+ * @brief Helper function to write the acceptance masks and filters
+ * 
+ * @param[in] filters Acceptance filter configuration
+ * @return int 0 on success, negative error code on failure
+ * @note The MCP2515 must be in configuration mode
+*******************************************************************************/
+static int can_set_filters(const struct can_filter_config* filters) {
+    for (uint8_t i = 0; i < MCP2515_NUM_MASKS; i++) {
+        int ret = mcp2515_set_mask(i, filters->masks[i]);
+        if (ret) {
+            return ret;
+        }
+    }
+    for (uint8_t i = 0; i < MCP2515_NUM_FILTERS; i++) {
+        int ret = mcp2515_set_filter(i, filters->filters[i].id, filters->filters[i].extended);
+        if (ret) {
+            return ret;
+        }
+    }
+    return 0;
+}
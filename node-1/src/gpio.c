@@ -9,6 +9,8 @@
  * 
  ******************************************************************************/
 
+#include <util/atomic.h>
+
 #include "gpio.h"
 
 /** ***************************************************************************
@@ -19,38 +21,47 @@
  ******************************************************************************/
 void gpio_init(struct gpio_pin gpio, bool is_output) {
 
-    switch(gpio.port) {
-        case 'A':
-            if (is_output) {
-                DDRA |= (1 << gpio.pin);
-            } else {
-                DDRA &= ~(1 << gpio.pin);
-            }
-            break;
-        case 'B':
-            if (is_output) {
-                DDRB |= (1 << gpio.pin);
-            } else {
-                DDRB &= ~(1 << gpio.pin);
-            }
-            break;
-        case 'C':
-            if (is_output) {
-                DDRC |= (1 << gpio.pin);
-            } else {
-                DDRC &= ~(1 << gpio.pin);
-            }
-            break;
-        case 'D':
-            if (is_output) {
-                DDRD |= (1 << gpio.pin);
-            } else {
-                DDRD &= ~(1 << gpio.pin);
-            }
-            break;
-        default:
-            // Invalid port
-            break;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        switch(gpio.port) {
+            case 'A':
+                if (is_output) {
+                    DDRA |= (1 << gpio.pin);
+                } else {
+                    DDRA &= ~(1 << gpio.pin);
+                }
+                break;
+            case 'B':
+                if (is_output) {
+                    DDRB |= (1 << gpio.pin);
+                } else {
+                    DDRB &= ~(1 << gpio.pin);
+                }
+                break;
+            case 'C':
+                if (is_output) {
+                    DDRC |= (1 << gpio.pin);
+                } else {
+                    DDRC &= ~(1 << gpio.pin);
+                }
+                break;
+            case 'D':
+                if (is_output) {
+                    DDRD |= (1 << gpio.pin);
+                } else {
+                    DDRD &= ~(1 << gpio.pin);
+                }
+                break;
+            case 'E':
+                if (is_output) {
+                    DDRE |= (1 << gpio.pin);
+                } else {
+                    DDRE &= ~(1 << gpio.pin);
+                }
+                break;
+            default:
+                // Invalid port
+                break;
+        }
     }
 }
 
@@ -62,38 +73,48 @@ void gpio_init(struct gpio_pin gpio, bool is_output) {
  ******************************************************************************/
 void gpio_set(struct gpio_pin gpio, bool value) {
 
-    switch(gpio.port) {
-        case 'A':
-            if (value) {
-                PORTA |= (1 << gpio.pin);
-            } else {
-                PORTA &= ~(1 << gpio.pin);
-            }
-            break;
-        case 'B':
-            if (value) {
-                PORTB |= (1 << gpio.pin);
-            } else {
-                PORTB &= ~(1 << gpio.pin);
-            }
-            break;
-        case 'C':
-            if (value) {
-                PORTC |= (1 << gpio.pin);
-            } else {
-                PORTC &= ~(1 << gpio.pin);
-            }
-            break;
-        case 'D':
-            if (value) {
-                PORTD |= (1 << gpio.pin);
-            } else {
-                PORTD &= ~(1 << gpio.pin);
-            }
-            break;
-        default:
-            // Invalid port
-            break;
+    // Port registers are read-modify-write, so an ISR must not touch them in between
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        switch(gpio.port) {
+            case 'A':
+                if (value) {
+                    PORTA |= (1 << gpio.pin);
+                } else {
+                    PORTA &= ~(1 << gpio.pin);
+                }
+                break;
+            case 'B':
+                if (value) {
+                    PORTB |= (1 << gpio.pin);
+                } else {
+                    PORTB &= ~(1 << gpio.pin);
+                }
+                break;
+            case 'C':
+                if (value) {
+                    PORTC |= (1 << gpio.pin);
+                } else {
+                    PORTC &= ~(1 << gpio.pin);
+                }
+                break;
+            case 'D':
+                if (value) {
+                    PORTD |= (1 << gpio.pin);
+                } else {
+                    PORTD &= ~(1 << gpio.pin);
+                }
+                break;
+            case 'E':
+                if (value) {
+                    PORTE |= (1 << gpio.pin);
+                } else {
+                    PORTE &= ~(1 << gpio.pin);
+                }
+                break;
+            default:
+                // Invalid port
+                break;
+        }
     }
 }
 
@@ -114,6 +135,8 @@ bool gpio_get(struct gpio_pin gpio) {
             return (PINC & (1 << gpio.pin)) != 0;
         case 'D':
             return (PIND & (1 << gpio.pin)) != 0;
+        case 'E':
+            return (PINE & (1 << gpio.pin)) != 0;
         default:
             // Invalid port
             return false;
@@ -127,21 +150,26 @@ bool gpio_get(struct gpio_pin gpio) {
  ******************************************************************************/
 void gpio_toggle(struct gpio_pin gpio) {
 
-    switch(gpio.port) {
-        case 'A':
-            PORTA ^= (1 << gpio.pin);
-            break;
-        case 'B':
-            PORTB ^= (1 << gpio.pin);
-            break;
-        case 'C':
-            PORTC ^= (1 << gpio.pin);
-            break;
-        case 'D':
-            PORTD ^= (1 << gpio.pin);
-            break;
-        default:
-            // Invalid port
-            break;
-    }   
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        switch(gpio.port) {
+            case 'A':
+                PORTA ^= (1 << gpio.pin);
+                break;
+            case 'B':
+                PORTB ^= (1 << gpio.pin);
+                break;
+            case 'C':
+                PORTC ^= (1 << gpio.pin);
+                break;
+            case 'D':
+                PORTD ^= (1 << gpio.pin);
+                break;
+            case 'E':
+                PORTE ^= (1 << gpio.pin);
+                break;
+            default:
+                // Invalid port
+                break;
+        }
+    }
 }
\ No newline at end of file
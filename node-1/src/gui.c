@@ -13,6 +13,7 @@
 #include <stdio.h>
 
 #define F_CPU 4915200 // Hz
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 
 #include "debug.h"
@@ -24,7 +25,19 @@
 #define JS_SEL_DELAY_MS 100
 
 /**< Icon used to display the selected menu element */
-const uint8_t *selected_icon = "->";
+static const char selected_icon[] PROGMEM = "->";
+
+// Menu labels live in flash, draw_menu() reads them from there
+static const char label_play_game[] PROGMEM = "Play game";
+static const char label_scoreboard[] PROGMEM = "Scoreboard";
+static const char label_info[] PROGMEM = "Info";
+static const char label_calibrate[] PROGMEM = "Calibrate";
+static const char label_settings[] PROGMEM = "Settings";
+static const char label_sound[] PROGMEM = "Sound";
+static const char label_brightness[] PROGMEM = "Brightness";
+static const char label_back[] PROGMEM = "Back";
+static const char label_retry[] PROGMEM = "Retry";
+static const char label_main_menu[] PROGMEM = "Main Menu";
 
 static void action_play_game(void *arg)
 {
@@ -68,11 +81,11 @@ struct menu main_menu = {
     .sel = 0,
     .prev_sel = 0,
     .items = (struct menu_item[]){
-        {.string = "Play game", .action = action_play_game},
-        {.string = "Scoreboard", .action = 0},
-        {.string = "Info", .action = 0},
-        {.string = "Calibrate", .action = 0},
-        {.string = "Settings", .action = 0}}};
+        {.string = label_play_game, .action = action_play_game},
+        {.string = label_scoreboard, .action = 0},
+        {.string = label_info, .action = 0},
+        {.string = label_calibrate, .action = 0},
+        {.string = label_settings, .action = 0}}};
 
 /**< Settings menu object */
 struct menu settings_menu = {
@@ -80,9 +93,9 @@ struct menu settings_menu = {
     .sel = 0,
     .prev_sel = 0,
     .items = (struct menu_item[]){
-        {.string = "Sound", .action = 0},
-        {.string = "Brightness", .action = 0},
-        {.string = "Back", .action = 0}}};
+        {.string = label_sound, .action = 0},
+        {.string = label_brightness, .action = 0},
+        {.string = label_back, .action = 0}}};
 
 static void action_retry_game(void *arg)
 {
@@ -116,8 +129,8 @@ struct menu game_over_menu = {
     .sel = 0,
     .prev_sel = 0,
     .items = (struct menu_item[]){
-        {.string = "Retry", .action = action_retry_game},
-        {.string = "Main Menu", .action = action_return_to_main_menu}}};
+        {.string = label_retry, .action = action_retry_game},
+        {.string = label_main_menu, .action = action_return_to_main_menu}}};
 
 /** ***************************************************************************
  * @brief Draws a menu on the OLED display
@@ -134,12 +147,12 @@ void draw_menu(const struct menu *menu)
         if (menu->sel == i)
         {
             // Ignore errors for now - GUI code can be improved later
-            (void)oled_draw_string(i, 0, selected_icon, 's');
-            (void)oled_draw_string(i, SELECT_ICON_WIDTH, menu->items[i].string, 's');
+            (void)oled_draw_string_P(i, 0, selected_icon, 's');
+            (void)oled_draw_string_P(i, SELECT_ICON_WIDTH, menu->items[i].string, 's');
         }
         else
         {
-            (void)oled_draw_string(i, SELECT_ICON_WIDTH, menu->items[i].string, 's');
+            (void)oled_draw_string_P(i, SELECT_ICON_WIDTH, menu->items[i].string, 's');
         }
     }
 }
@@ -0,0 +1,196 @@
+/** ***************************************************************************
+ * @file latency.c
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief End-to-end input to actuation latency measurement
+ * @version 0.1
+ * @date 2025-11-24
+ * 
+ * @copyright Copyright (c) 2025 Byggarane
+ * 
+*******************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "debug.h"
+#include "latency.h"
+#include "timer.h"
+#include "timesync.h"
+
+
+/**< Outstanding probe */
+static bool probe_pending = false;
+static uint8_t probe_seq;
+static uint32_t probe_stamp;
+
+/**< Reference probe for the clock offset, the one with the shortest round trip */
+static bool ref_valid = false;
+static uint32_t ref_stamp;          /**< Node 1 sample time */
+static uint32_t ref_rx_us;          /**< Node 2 receive time */
+static uint32_t ref_one_way_us;     /**< Half the round trip */
+static uint32_t next_rtt_us;        /**< Shortest round trip in the current window */
+static uint8_t window_count = 0;
+
+static struct latency_stats stats = {.min_net_us = UINT32_MAX, .min_us = UINT32_MAX};
+
+static void latency_add(uint32_t net_us, uint32_t actuation_us);
+
+
+/** ***************************************************************************
+ * @brief Check whether an input state frame should carry a probe
+*******************************************************************************/
+bool latency_probe_due(uint8_t seq) {
+    return (seq & (LATENCY_PROBE_INTERVAL - 1)) == 0;
+}
+
+/** ***************************************************************************
+ * @brief Record a probe that has been sent
+*******************************************************************************/
+void latency_probe_sent(uint8_t seq, uint32_t stamp) {
+    if (probe_pending) {
+        stats.lost++;
+    }
+    probe_pending = true;
+    probe_seq = seq;
+    probe_stamp = stamp;
+    stats.probes++;
+}
+
+/** ***************************************************************************
+ * @brief Process an echo from node 2
+*******************************************************************************/
+int latency_echo_received(const struct can_msg* msg, uint32_t stamp) {
+    struct latency_echo_frame echo;
+    if (msg->dlc < sizeof(echo)) {
+        return -EINVAL;
+    }
+    memcpy(&echo, msg->bytes, sizeof(echo));
+    if (!probe_pending || echo.seq != probe_seq) {
+        return -ENXIO;
+    }
+    probe_pending = false;
+
+    uint32_t rx_us = echo.rx_us[0] | ((uint32_t)echo.rx_us[1] << 8) | ((uint32_t)echo.rx_us[2] << 16);
+    uint32_t round_trip_us = timer_ticks_to_us(stamp - probe_stamp);
+    uint32_t rtt_us = round_trip_us > echo.turnaround_us ? round_trip_us - echo.turnaround_us : 0;
+
+    // Start a new offset estimate every window, so drift between the crystals
+    // does not build up. Within a window the shortest round trip wins
+    if (window_count == 0) {
+        next_rtt_us = UINT32_MAX;
+    }
+    if (!ref_valid || rtt_us <= next_rtt_us) {
+        next_rtt_us = rtt_us;
+        ref_valid = true;
+        ref_stamp = probe_stamp;
+        ref_rx_us = rx_us;
+        ref_one_way_us = rtt_us / 2;
+        stats.best_rtt_us = rtt_us;
+    }
+    window_count = (window_count + 1) % LATENCY_OFFSET_WINDOW;
+
+    // One-way latency on the shared time axis if we follow the node 2 clock,
+    // otherwise against the reference probe. Node 2 times wrap at 24 bits
+    int32_t net_us;
+    if (timesync_locked()) {
+        uint32_t sent_us = timesync_to_remote_us(probe_stamp);
+        net_us = (int32_t)(((rx_us - sent_us) & LATENCY_CLOCK_MASK) << 8) >> 8;
+    } else {
+        int32_t rx_delta_us = (int32_t)(((rx_us - ref_rx_us) & LATENCY_CLOCK_MASK) << 8) >> 8;
+        int32_t tx_delta_us = (int32_t)timer_ticks_to_us(probe_stamp - ref_stamp);
+        net_us = (int32_t)ref_one_way_us + rx_delta_us - tx_delta_us;
+    }
+    if (net_us < 0) {
+        net_us = 0;
+    }
+
+    stats.echoes++;
+    latency_add(net_us, net_us + echo.actuation_us);
+    return 0;
+}
+
+/** ***************************************************************************
+ * @brief Get the latency statistics
+*******************************************************************************/
+void latency_get_stats(struct latency_stats* out) {
+    *out = stats;
+}
+
+/** ***************************************************************************
+ * @brief Reset all latency statistics
+*******************************************************************************/
+void latency_reset(void) {
+    memset(&stats, 0, sizeof(stats));
+    stats.min_net_us = UINT32_MAX;
+    stats.min_us = UINT32_MAX;
+    probe_pending = false;
+    ref_valid = false;
+    window_count = 0;
+}
+
+/** ***************************************************************************
+ * @brief Print min/mean/p99 and the histogram of the latency over UART
+*******************************************************************************/
+void latency_print_report(void) {
+    LOG_PRINTF("Latency probes: %u, echoes: %u, lost: %u, best rtt: %lu us\r\n",
+           stats.probes, stats.echoes, stats.lost, stats.best_rtt_us);
+    if (!stats.echoes) {
+        return;
+    }
+
+    // p99 is the upper edge of the bin holding the 99th percentile
+    uint16_t p99_count = stats.echoes - stats.echoes / 100;
+    uint16_t count = 0;
+    uint8_t p99_bin = LATENCY_HIST_BINS;
+    for (uint8_t i = 0; i <= LATENCY_HIST_BINS; i++) {
+        count += stats.hist[i];
+        if (count >= p99_count) {
+            p99_bin = i;
+            break;
+        }
+    }
+
+    LOG_PRINTF("Network: min %lu us, mean %lu us, max %lu us\r\n",
+           stats.min_net_us, stats.total_net_us / stats.echoes, stats.max_net_us);
+    LOG_PRINTF("Actuation: min %lu us, mean %lu us, p99 ", stats.min_us, stats.total_us / stats.echoes);
+    if (p99_bin < LATENCY_HIST_BINS) {
+        LOG_PRINTF("< %lu us", (uint32_t)(p99_bin + 1) * LATENCY_HIST_BIN_US);
+    } else {
+        LOG_PRINTF("> %lu us", (uint32_t)LATENCY_HIST_BINS * LATENCY_HIST_BIN_US);
+    }
+    LOG_PRINTF(", max %lu us\r\n", stats.max_us);
+
+    for (uint8_t i = 0; i <= LATENCY_HIST_BINS; i++) {
+        if (stats.hist[i]) {
+            LOG_PRINTF("  %5lu us: %u\r\n", (uint32_t)i * LATENCY_HIST_BIN_US, stats.hist[i]);
+        }
+    }
+}
+
+/** ***************************************************************************
+ * @brief Helper function to add one measurement to the statistics
+ * 
+ * @param[in] net_us Network latency
+ * @param[in] actuation_us Actuation latency
+*******************************************************************************/
+static void latency_add(uint32_t net_us, uint32_t actuation_us) {
+    if (net_us < stats.min_net_us) {
+        stats.min_net_us = net_us;
+    }
+    if (net_us > stats.max_net_us) {
+        stats.max_net_us = net_us;
+    }
+    stats.total_net_us += net_us;
+
+    if (actuation_us < stats.min_us) {
+        stats.min_us = actuation_us;
+    }
+    if (actuation_us > stats.max_us) {
+        stats.max_us = actuation_us;
+    }
+    stats.total_us += actuation_us;
+
+    uint32_t bin = actuation_us / LATENCY_HIST_BIN_US;
+    stats.hist[bin < LATENCY_HIST_BINS ? bin : LATENCY_HIST_BINS]++;
+}
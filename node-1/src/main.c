@@ -12,22 +12,26 @@
 #include <stdio.h>
 
 #define F_CPU 4915200 // Hz
+#include <avr/interrupt.h>
 #include <util/delay.h>
 
 #include "adc.h"
 #include "can.h"
+#include "debug.h"
 #include "gpio.h"
 #include "gui.h"
+#include "latency.h"
 #include "mcp2515.h"
 #include "oled.h"
+#include "timesync.h"
 #include "spi.h"
 #include "typar.h"
 #include "uart.h"
 #include "user_io.h"
 #include "xmem.h"
 
-#define BAUD_RATE 9600
-#define UBRR (F_CPU / 16 / BAUD_RATE - 1)
+#define BAUD_RATE 38400 // Highest rate that is exact here and in termios
+#define UBRR UART_UBRR(BAUD_RATE)
 #define BLINK_DELAY_MS 1000
 
 // NEVER USE PB4 FOR ANYTHING, IT HAS TO BE HIGH FOR SPI TO WORK
@@ -40,19 +44,24 @@ struct gpio_pin miso_pin = {'B', 6};
 struct gpio_pin sck_pin = {'B', 7};
 
 // SPI devices
+// The OLED and MCP2515 run at full speed. The user I/O board needs time
+// to prepare each byte it sends
 const struct oled_dev oled_device = {
     .spi = {
         .id = 0,
-        .cs_pin = {'D', 2}},
+        .cs_pin = {'D', 2},
+        .timing = {.clock_div = SPI_CLOCK_DIV_2, .mode = SPI_MODE_0, .byte_delay_us = 0}},
     .cmd_pin = {'D', 4}};
 
 const struct spi_device spi_dev_user_io = {
     .id = 1,
-    .cs_pin = {'B', 2}};
+    .cs_pin = {'B', 2},
+    .timing = {.clock_div = SPI_CLOCK_DIV_2, .mode = SPI_MODE_0, .byte_delay_us = 100}};
 
 const struct spi_device spi_dev_mcp2515 = {
     .id = 2,
-    .cs_pin = {'D', 3}};
+    .cs_pin = {'D', 3},
+    .timing = {.clock_div = SPI_CLOCK_DIV_2, .mode = SPI_MODE_0, .byte_delay_us = 0}};
 
 // Bit timing: 250 kbps @ 16 MHz
 // Sample point: 75%
@@ -66,14 +75,57 @@ struct can_config can_cfg = {
     .smp = 0     // Sampling mode
 };
 
-char test_str[] = "Byggarane";
+// Node 2 sends its 11-bit IDs in standard frames. RXB0 takes the game state
+// messages, RXB1 the block of node 2 status IDs. Everything else is dropped
+// by the MCP2515 before it costs an interrupt
+const struct can_filter_config can_filters = {
+    .masks = {CAN_STD_ID_MASK, CAN_ID_STATUS_MASK},
+    .filters = {
+        {CAN_ID_GAME_OVER, false},
+        {CAN_ID_NODE2_RDY, false},
+        {CAN_ID_STATUS_BASE, false},
+        {CAN_ID_STATUS_BASE, false},
+        {CAN_ID_STATUS_BASE, false},
+        {CAN_ID_STATUS_BASE, false}}};
+
+_Static_assert(UART_BAUD_EXACT(BAUD_RATE), "Baud rate cannot be generated exactly from the crystal");
+
+/** ***************************************************************************
+ * @brief Receive the next message for the game logic
+ *
+ * @param[out] msg Pointer to the CAN message structure to store received message
+ * @return int 0 on success, -EAGAIN if no message is available, negative error code on failure
+ * @details Time sync and latency echo frames are handled here in every GUI
+ *          state, and are not returned
+ *******************************************************************************/
+static int receive_msg(struct can_msg *msg)
+{
+    uint32_t stamp;
+    int ret;
+    while ((ret = can_receive_stamped(msg, &stamp)) == 0)
+    {
+        switch (msg->id)
+        {
+        case CAN_ID_TIME_SYNC:
+        case CAN_ID_TIME_FOLLOW_UP:
+            timesync_handle(msg, stamp);
+            break;
+        case CAN_ID_LATENCY_ECHO:
+            latency_echo_received(msg, stamp);
+            break;
+        default:
+            return 0;
+        }
+    }
+    return ret;
+}
 
 heiltal hovud(tomrom)
 {
 
-    // Initializations
-    uart_init(UBRR);
+    // Initializations, XMEM first as it can hold the UART rings
     xmem_init();
+    uart_init(UBRR);
     gpio_init(led_pin, OUTPUT);
     adc_clk_enable(clk_pin);
 
@@ -88,12 +140,26 @@ heiltal hovud(tomrom)
         // printf("Failed to initialize user I/O: %d\r\n", ret);
     }
 
-    ret = can_init(&spi_dev_mcp2515, CAN_MODE_NORMAL, can_cfg);
+    ret = can_init(&spi_dev_mcp2515, CAN_MODE_NORMAL, can_cfg, &can_filters);
     if (ret)
     {
         // printf("Failed to initialize CAN: %d\r\n", ret);
     }
 
+    // Only the newest joystick position matters, so do not queue stale ones
+    ret = can_set_tx_replace(CAN_TX_CLASS_JOYSTICK, true);
+    if (ret)
+    {
+        // printf("Failed to set joystick replace mode: %d\r\n", ret);
+    }
+
+    // Button presses go out from the sampling interrupt, releases with the input state
+    ret = js_btn_fire_init(CAN_FIRE_TRIGGER_SPI);
+    if (ret)
+    {
+        // printf("Failed to set up fire frame: %d\r\n", ret);
+    }
+
     ret = oled_init(&oled_device);
     if (ret)
     {
@@ -109,6 +175,12 @@ heiltal hovud(tomrom)
     // Redirect stdio to UART
     fdevopen(uart_transmit_stdio, uart_receive_stdio);
 
+    // Fixed rate input state frames to node 2
+    input_state_init();
+
+    // Enable interrupts (CAN receive)
+    sei();
+
     // Tests
     // SRAM_test();
     // oled_draw_string(0, 0, "Byggarane", 'l');
@@ -122,12 +194,10 @@ heiltal hovud(tomrom)
     ret = mcp2515_print_config();
     if (ret)
     {
-        printf("Error on reading CAN config: %d\r\n", ret);
+        LOG_PRINTF("Error on reading CAN config: %d\r\n", ret);
     }
 
     bool state_set = false;
-    bool js_btn_state = 0;
-    bool js_btn_prev_state = 0;
 
     struct can_msg msg;
 
@@ -142,7 +212,7 @@ heiltal hovud(tomrom)
 
             case GUI_STATE_MENU:
                 // Clear old received messages
-                return_code = can_receive(&msg);
+                return_code = receive_msg(&msg);
                 update_menu(current_menu, &current_state);
                 break;
 
@@ -150,8 +220,8 @@ heiltal hovud(tomrom)
                 if (state_set == false)
                 {
                     oled_clear();
-                    oled_draw_string(0, 0, "Waiting for", 'l');
-                    oled_draw_string(1, 0, "game start...", 'l');
+                    oled_draw_string_P(0, 0, PSTR("Waiting for"), 'l');
+                    oled_draw_string_P(1, 0, PSTR("game start..."), 'l');
                     state_set = true;
                 }
                 msg.id = CAN_ID_GAME_START;
@@ -159,11 +229,12 @@ heiltal hovud(tomrom)
                 msg.bytes[0] = 1;
                 can_send(&msg);
                 // Wait for game start message
-                return_code = can_receive(&msg);
+                return_code = receive_msg(&msg);
                 if (return_code == 0)
                 {
                     if (msg.id == CAN_ID_NODE2_RDY)
                     {
+                        latency_reset();
                         current_state = GUI_STATE_GAME;
                         state_set = false;
                     }
@@ -183,34 +254,39 @@ heiltal hovud(tomrom)
                 if (state_set == false)
                 {
                     oled_clear();
-                    oled_draw_string(0, 0, "Playing...", 'l');
+                    oled_draw_string_P(0, 0, PSTR("Playing..."), 'l');
                     state_set = true;
+                    // Debug output must not hold up joystick sampling
+                    uart_tx_policy(UART_TX_DROP);
+                    // Fire frames only while playing
+                    js_btn_fire_enable(true);
                 }
-                send_joystick_state_to_can(&msg);
-                //_delay_ms(10);
-                js_btn_state = get_joystick_btn_state();
-                _delay_ms(10);
-                if (js_btn_state != js_btn_prev_state)
-                {
-                    js_btn_prev_state = js_btn_state;
-                    send_js_btn_to_can(&msg);
-                }
-                get_button_states(&btn_states);
-                if (btn_states.L6)
+                // Joystick, buttons and slider go out together on every tick
+                if (input_state_tick())
                 {
-                    // Return to menu
-                    state_set = false;
-                    current_state = GUI_STATE_MENU;
-                    draw_menu(current_menu);
+                    send_input_state_to_can(&msg, &btn_states);
+                    if (btn_states.L6)
+                    {
+                        // Return to menu
+                        js_btn_fire_enable(false);
+                        uart_tx_policy(UART_TX_BLOCK);
+                        state_set = false;
+                        current_state = GUI_STATE_MENU;
+                        draw_menu(current_menu);
+                    }
                 }
 
-                return_code = can_receive(&msg);
+                return_code = receive_msg(&msg);
                 if (return_code == 0)
                 {
-                    printf("Received CAN message with ID: %X\r\n", msg.id);
+                    LOG_PRINTF("Received CAN message with ID: %X\r\n", msg.id);
                     switch (msg.id)
                     {
                     case CAN_ID_GAME_OVER:
+                        js_btn_fire_enable(false);
+                        uart_tx_policy(UART_TX_BLOCK);
+                        LOG_PRINTF("UART bytes dropped during game: %u\r\n", uart_tx_dropped());
+                        latency_print_report();
                         state_set = false;
                         current_state = GUI_STATE_GAME_OVER;
                         break;
@@ -225,7 +301,7 @@ heiltal hovud(tomrom)
                 if (state_set == false)
                 {
                     oled_clear();
-                    oled_draw_string(0, 0, "Game Over!", 'l');
+                    oled_draw_string_P(0, 0, PSTR("Game Over!"), 'l');
                     state_set = true;
                 }
                 get_button_states(&btn_states);
@@ -240,7 +316,7 @@ heiltal hovud(tomrom)
 
             case GUI_STATE_ERROR:
                 oled_clear();
-                oled_draw_string(0, 0, "Error!", 'l');
+                oled_draw_string_P(0, 0, PSTR("Error!"), 'l');
                 break;
 
             default:
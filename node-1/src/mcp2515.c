@@ -20,14 +20,22 @@
 #include "debug.h"
 #include "spi.h"
 
-#define TX_BUF_SIZE 15
-
-static uint8_t tx_buf[TX_BUF_SIZE] = {0};
+// Command buffers live on the stack so the driver can be called from the CAN ISR
+#define CMD_BUF_SIZE 4
 
 
 /**< SPI device structure for the MCP2515 */
 static const struct spi_device* mcp2515_dev;
 
+static const uint8_t filter_addresses[MCP2515_NUM_FILTERS] = {
+    MCP2515_RXF0SIDH, MCP2515_RXF1SIDH, MCP2515_RXF2SIDH,
+    MCP2515_RXF3SIDH, MCP2515_RXF4SIDH, MCP2515_RXF5SIDH
+};
+
+static const uint8_t mask_addresses[MCP2515_NUM_MASKS] = {
+    MCP2515_RXM0SIDH, MCP2515_RXM1SIDH
+};
+
 
 int mcp2515_init(const struct spi_device* _mcp2515_dev) {
     mcp2515_dev = _mcp2515_dev;
@@ -40,19 +48,7 @@ int mcp2515_init(const struct spi_device* _mcp2515_dev) {
 }
 
 int mcp2515_read(uint8_t address, uint8_t* data) {
-    if (!data) {
-        return -EINVAL;
-    }
-
-    tx_buf[0] = MCP2515_READ;
-    tx_buf[1] = address;
-
-    int ret = spi_query(mcp2515_dev, tx_buf, 2, data, 1);
-    if (ret) {
-        return ret;
-    }
-    
-    return 0;
+    return mcp2515_read_multiple(address, data, 1);
 }
 
 int mcp2515_read_multiple(uint8_t address, uint8_t* data, uint8_t length) {
@@ -60,21 +56,17 @@ int mcp2515_read_multiple(uint8_t address, uint8_t* data, uint8_t length) {
         return -EINVAL;
     }
 
-    tx_buf[0] = MCP2515_READ;
-    tx_buf[1] = address;
+    uint8_t tx_buf[CMD_BUF_SIZE] = {MCP2515_READ, address};
+    struct spi_segment segments[2] = {
+        {.tx_data = tx_buf, .rx_data = NULL, .size = 2},
+        {.tx_data = NULL, .rx_data = data, .size = length},
+    };
 
-    int ret = spi_query(mcp2515_dev, tx_buf, 2, data, length);
-    if (ret) {
-        return ret;
-    }
-    
-    return 0;
+    return spi_transfer_segments(mcp2515_dev, segments, 2);
 }
 
 int mcp2515_write(uint8_t address, uint8_t data) {
-    tx_buf[0] = MCP2515_WRITE;
-    tx_buf[1] = address;
-    tx_buf[2] = data;
+    uint8_t tx_buf[CMD_BUF_SIZE] = {MCP2515_WRITE, address, data};
     return spi_master_transmit(mcp2515_dev, tx_buf, 3);
 }
 
@@ -82,23 +74,68 @@ int mcp2515_write_multiple(uint8_t address, const uint8_t* data, uint8_t length)
     if (!data || length == 0) {
         return -EINVAL;
     }
-    
-    // Allocate buffer for command (1 byte) + address (1 byte) + data
-    uint8_t buffer_size = 2 + length;
-    
-    tx_buf[0] = MCP2515_WRITE;
-    tx_buf[1] = address;
-    
-    // Copy data bytes
-    for (uint8_t i = 0; i < length; i++) {
-        tx_buf[2 + i] = data[i];
-    }
-    
-    return spi_master_transmit(mcp2515_dev, tx_buf, buffer_size);
+
+    // Command and address go in front of the caller's bytes without copying them
+    uint8_t tx_buf[CMD_BUF_SIZE] = {MCP2515_WRITE, address};
+    struct spi_segment segments[2] = {
+        {.tx_data = tx_buf, .rx_data = NULL, .size = 2},
+        {.tx_data = data, .rx_data = NULL, .size = length},
+    };
+
+    return spi_transfer_segments(mcp2515_dev, segments, 2);
+}
+
+int mcp2515_load_tx_buffer(uint8_t buffer, const uint8_t* frame) {
+    if (!frame || buffer >= MCP2515_NUM_TX_BUFFERS) {
+        return -EINVAL;
+    }
+
+    uint8_t dlc = frame[MCP2515_FRAME_HEADER_SIZE - 1] & MCP2515_DLC_MASK;
+    if (dlc > MCP2515_MAX_DLC) {
+        return -EINVAL;
+    }
+
+    // The buffer number selects TXBnSIDH in bits 2-1 of the instruction
+    uint8_t tx_buf[CMD_BUF_SIZE] = {MCP2515_LOAD_TX_BASE | (buffer << 1)};
+    struct spi_segment segments[2] = {
+        {.tx_data = tx_buf, .rx_data = NULL, .size = 1},
+        {.tx_data = frame, .rx_data = NULL, .size = MCP2515_FRAME_HEADER_SIZE + dlc},
+    };
+
+    return spi_transfer_segments(mcp2515_dev, segments, 2);
+}
+
+int mcp2515_read_rx_buffer(uint8_t buffer, uint8_t* frame) {
+    if (!frame || buffer >= MCP2515_NUM_RX_BUFFERS) {
+        return -EINVAL;
+    }
+
+    int ret = spi_begin_transaction(mcp2515_dev);
+    if (ret) {
+        return ret;
+    }
+
+    // The buffer number selects RXBnSIDH in bit 2 of the instruction
+    spi_transfer_byte(MCP2515_READ_RX_BASE | (buffer << 2));
+    for (uint8_t i = 0; i < MCP2515_FRAME_HEADER_SIZE; i++) {
+        frame[i] = spi_transfer_byte(0x00);
+    }
+
+    // Read only as many data bytes as the frame carries
+    uint8_t dlc = frame[MCP2515_FRAME_HEADER_SIZE - 1] & MCP2515_DLC_MASK;
+    if (dlc > MCP2515_MAX_DLC) {
+        dlc = MCP2515_MAX_DLC;
+    }
+    for (uint8_t i = 0; i < dlc; i++) {
+        frame[MCP2515_FRAME_HEADER_SIZE + i] = spi_transfer_byte(0x00);
+    }
+
+    // Raising CS clears RXnIF
+    return spi_end_transaction(mcp2515_dev);
 }
 
 int mcp2515_request_to_send(bool txb0, bool txb1, bool txb2) {
-    tx_buf[0] = MCP2515_RTS_BASE | (txb0 << 0) | (txb1 << 1) | (txb2 << 2);
+    uint8_t tx_buf[CMD_BUF_SIZE] = {MCP2515_RTS_BASE | (txb0 << 0) | (txb1 << 1) | (txb2 << 2)};
     return spi_master_transmit(mcp2515_dev, tx_buf, 1);
 }
 
@@ -107,20 +144,51 @@ int mcp2515_read_status(uint8_t* rx) {
         return -EINVAL;
     }
 
-    tx_buf[0] = MCP2515_READ_STATUS;
-    return spi_query(mcp2515_dev, tx_buf, 1, rx, 2);
+    uint8_t tx_buf[CMD_BUF_SIZE] = {MCP2515_READ_STATUS};
+    struct spi_segment segments[2] = {
+        {.tx_data = tx_buf, .rx_data = NULL, .size = 1},
+        {.tx_data = NULL, .rx_data = rx, .size = 2},
+    };
+
+    return spi_transfer_segments(mcp2515_dev, segments, 2);
+}
+
+int mcp2515_set_filter(uint8_t filter, uint16_t id, bool extended) {
+    if (filter >= MCP2515_NUM_FILTERS) {
+        return -EINVAL;
+    }
+
+    // SIDH, SIDL, EID8, EID0
+    uint8_t regs[4] = {
+        (id >> 3) & 0xFF,
+        ((id << MCP2515_SIDL_SID_POS) & 0xE0) | (extended ? MCP2515_SIDL_EXIDE : 0),
+        0x00,
+        0x00
+    };
+    return mcp2515_write_multiple(filter_addresses[filter], regs, sizeof(regs));
+}
+
+int mcp2515_set_mask(uint8_t mask, uint16_t id_mask) {
+    if (mask >= MCP2515_NUM_MASKS) {
+        return -EINVAL;
+    }
+
+    uint8_t regs[4] = {
+        (id_mask >> 3) & 0xFF,
+        (id_mask << MCP2515_SIDL_SID_POS) & 0xE0,
+        0x00,
+        0x00
+    };
+    return mcp2515_write_multiple(mask_addresses[mask], regs, sizeof(regs));
 }
 
 int mcp2515_bit_modify(uint8_t address, uint8_t mask, uint8_t data) {
-    tx_buf[0] = MCP2515_BIT_MODIFY;
-    tx_buf[1] = address;
-    tx_buf[2] = mask;
-    tx_buf[3] = data;
+    uint8_t tx_buf[CMD_BUF_SIZE] = {MCP2515_BIT_MODIFY, address, mask, data};
     return spi_master_transmit(mcp2515_dev, tx_buf, 4);
 }
 
 int mcp2515_reset(void) {
-    tx_buf[0] = MCP2515_RESET;
+    uint8_t tx_buf[CMD_BUF_SIZE] = {MCP2515_RESET};
     return spi_master_transmit(mcp2515_dev, tx_buf, 1);
 }
 
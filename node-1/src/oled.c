@@ -15,8 +15,10 @@
 #include <string.h>
 
 #define F_CPU 4915200 // Hz
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 
+#include "debug.h"
 #include "fonts.h"
 #include "gpio.h"
 #include "oled.h"
@@ -30,6 +32,17 @@
 /**< OLED device structure */
 static const struct oled_dev* oled_device;
 
+static void oled_wait_idle(void);
+static void oled_select_command(struct spi_transaction* trans);
+static void oled_select_data(struct spi_transaction* trans);
+static uint8_t oled_font_width(char font);
+
+static const uint8_t horizontal_addressing[2] = {OLED_SET_MEM_ADDR_MODE, 0x00};
+static const uint8_t page_addressing[2] = {OLED_SET_MEM_ADDR_MODE, 0x02};
+
+/**< Transactions queued by oled_clear, completed in the background */
+static struct spi_transaction clear_trans[3];
+
 /** ***************************************************************************
  * @brief Draws a character on the OLED display
  * 
@@ -47,36 +60,34 @@ int oled_draw_char(uint8_t page, uint8_t column, char c, char font) {
         c='?';
     }
 
-    uint8_t byte;
-    int width;
+    uint8_t glyph[8];
+    uint8_t width = oled_font_width(font);
 
-    if (font == 's') {
-        width = 4;
-    } else if (font == 'l') {
-        width = 8;
-    } else {
-        width = 5;
+    for (uint8_t i = 0; i < width; i++) { // reading each column in the char from flash
+
+        if (font == 's') glyph[i] = pgm_read_byte(&font4[c - 32][i]);
+        else if (font == 'l') glyph[i] = pgm_read_byte(&font8[c - 32][i]);
+        else glyph[i] = pgm_read_byte(&font5[c - 32][i]);
     }
 
-    for ( int i = 0; i < width; i++) { // writing each column in the char to the display
+    // The column address auto-increments, so the whole glyph goes in one transfer
+    int ret = oled_goto_address(page, column + 1);
+    if (ret) {
+        return ret;
+    }
 
-        if (font == 's') byte = pgm_read_byte(&font4[c - 32][i]);
-        else if (font == 'l') byte = pgm_read_byte(&font8[c - 32][i]);
-        else byte = pgm_read_byte(&font5[c - 32][i]);
-        
+    // Columns past the right edge would wrap around, so they are cut off
+    bool clipped = (column + 1 + width > NUM_COLUMNS);
+    if (clipped) {
+        width = NUM_COLUMNS - column - 1;
+    }
 
-        int ret = oled_goto_address(page, column + i + 1);
-        if (ret) {
-            return ret;
-        }
-        
-        ret = oled_transmit_single(byte, false);
-        if (ret) {
-            return ret;
-        }
+    ret = oled_transmit(glyph, width, false);
+    if (ret) {
+        return ret;
     }
     
-    return 0;
+    return clipped ? -EINVAL : 0;
 }
 
 /** ***************************************************************************
@@ -90,11 +101,7 @@ int oled_draw_char(uint8_t page, uint8_t column, char c, char font) {
 *******************************************************************************/
 int oled_draw_string(const uint8_t page, const uint8_t column, const uint8_t* s, const uint8_t font) {
 
-    int column_number;
-
-    if (font == 's') column_number = 4;
-    else if (font == 'l') column_number = 8;
-    else column_number = 5;
+    int column_number = oled_font_width(font);
 
     for (int i = 0; i < strlen(s); i++) {
         int ret;
@@ -115,6 +122,31 @@ int oled_draw_string(const uint8_t page, const uint8_t column, const uint8_t* s,
     return 0;
 }
 
+/** ***************************************************************************
+ * @brief Draw a string stored in flash on the OLED display
+ * 
+ * @param[in] page Page (row) to write in
+ * @param[in] column Column to write in
+ * @param[in] s String in program memory, e.g. from PSTR()
+ * @param[in] font Specifies the font of the character
+ * @return int 0 on success, negative error code on failure
+ * @details Places the characters like oled_draw_string()
+*******************************************************************************/
+int oled_draw_string_P(const uint8_t page, const uint8_t column, const char* s, const uint8_t font) {
+
+    int column_number = oled_font_width(font);
+
+    char c;
+    for (int i = 0; (c = pgm_read_byte(&s[i])) != '\0'; i++) {
+        int ret = oled_draw_char(page + 1, column + i*(column_number + 1), c, font);
+        if (ret) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
 /** ***************************************************************************
  * @brief Initialize the OLED display
  * 
@@ -165,6 +197,7 @@ int oled_init(const struct oled_dev* _oled_device)
 *******************************************************************************/
 int oled_transmit_single(uint8_t data, bool command) 
 {
+    oled_wait_idle();
     gpio_set(oled_device->cmd_pin, !command);
     return spi_master_transmit_single(&oled_device->spi, data);
 }
@@ -179,8 +212,11 @@ int oled_transmit_single(uint8_t data, bool command)
 *******************************************************************************/
 int oled_transmit(uint8_t* data, uint8_t size, bool command) 
 {
+    oled_wait_idle();
     gpio_set(oled_device->cmd_pin, !command);
-    return spi_master_transmit(&oled_device->spi, data, size);
+
+    struct spi_segment segment = {.tx_data = data, .rx_data = NULL, .size = size};
+    return spi_transfer_segments(&oled_device->spi, &segment, 1);
 }
 
 /** ***************************************************************************
@@ -193,12 +229,12 @@ int oled_transmit(uint8_t* data, uint8_t size, bool command)
 int oled_goto_address(uint8_t page, uint8_t column)
 {
     if(page >= NUM_PAGES) {
-        printf("Invalid page\r\n");
+        LOG_PRINTF("Invalid page\r\n");
         return -EINVAL;
     }
 
     if(column >= NUM_COLUMNS) {
-        printf("Invalid column\r\n");
+        LOG_PRINTF("Invalid column\r\n");
         return -EINVAL;
     }
 
@@ -214,27 +250,90 @@ int oled_goto_address(uint8_t page, uint8_t column)
 /** ***************************************************************************
  * @brief Clear the OLED display
  * 
- * @details Writes 0x00 to all addresses
- * @todo Clean up :)
+ * @details Writes 0x00 to all addresses. The transfer is queued on the SPI bus
+ *          and the function returns immediately
  * @return int 0 on success, negative error code on failure
 *******************************************************************************/
 int oled_clear(void)
 {
-    enum oled_command horizontal_addressing[2] = {OLED_SET_MEM_ADDR_MODE, 0x00};
-    int ret = oled_transmit((uint8_t*)horizontal_addressing, sizeof(horizontal_addressing), true);
-    if (ret) {
-        return ret;
-    }
-    
-    for (int i = 0; i < NUM_PAGES; i++) {
-        for (int j = 0; j < NUM_COLUMNS; j++) {
-            ret = oled_transmit_single(0x00, false);
-            if (ret) {
-                return ret;
-            }
+    oled_wait_idle();
+
+    clear_trans[0] = (struct spi_transaction){
+        .device = &oled_device->spi,
+        .tx_data = horizontal_addressing,
+        .tx_size = sizeof(horizontal_addressing),
+        .pre = oled_select_command,
+    };
+    clear_trans[1] = (struct spi_transaction){
+        .device = &oled_device->spi,
+        .tx_data = NULL,
+        .tx_size = NUM_PAGES * NUM_COLUMNS,
+        .pre = oled_select_data,
+    };
+    clear_trans[2] = (struct spi_transaction){
+        .device = &oled_device->spi,
+        .tx_data = page_addressing,
+        .tx_size = sizeof(page_addressing),
+        .pre = oled_select_command,
+    };
+
+    for (uint8_t i = 0; i < sizeof(clear_trans) / sizeof(clear_trans[0]); i++) {
+        int ret = spi_submit(&clear_trans[i]);
+        if (ret) {
+            return ret;
         }
     }
-    
-    enum oled_command page_addressing[2] = {OLED_SET_MEM_ADDR_MODE, 0x02};
-    return oled_transmit((uint8_t*)page_addressing, sizeof(page_addressing), true);
-}
\ No newline at end of file
+
+    return 0;
+}
+
+/** ***************************************************************************
+ * @brief Wait for queued OLED transactions to complete
+ * 
+ * @details The command pin is shared by all OLED transfers, so it must not
+ *          change while a queued transaction is still running
+*******************************************************************************/
+static void oled_wait_idle(void)
+{
+    for (uint8_t i = 0; i < sizeof(clear_trans) / sizeof(clear_trans[0]); i++) {
+        spi_wait(&clear_trans[i]);
+    }
+}
+
+/** ***************************************************************************
+ * @brief Set the command pin for command bytes before a queued transaction
+ * 
+ * @param[in] trans Transaction about to start
+*******************************************************************************/
+static void oled_select_command(struct spi_transaction* trans)
+{
+    (void)trans;
+    gpio_set(oled_device->cmd_pin, LOW);
+}
+
+/** ***************************************************************************
+ * @brief Set the command pin for data bytes before a queued transaction
+ * 
+ * @param[in] trans Transaction about to start
+*******************************************************************************/
+static void oled_select_data(struct spi_transaction* trans)
+{
+    (void)trans;
+    gpio_set(oled_device->cmd_pin, HIGH);
+}
+
+/** ***************************************************************************
+ * @brief Width of a character in a font
+ * 
+ * @param[in] font 's', 'l', or anything else for the default font
+ * @return uint8_t Number of columns
+*******************************************************************************/
+static uint8_t oled_font_width(char font)
+{
+    if (font == 's') {
+        return 4;
+    } else if (font == 'l') {
+        return 8;
+    }
+    return 5;
+}
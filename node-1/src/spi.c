@@ -18,7 +18,9 @@
 #define F_CPU 4915200 // Hz
 #include <util/delay.h>
 
+#include <avr/interrupt.h>
 #include <avr/io.h>
+#include <util/atomic.h>
 
 #include "gpio.h"
 #include "spi.h"
@@ -31,8 +33,52 @@ static struct gpio_pin sck_pin;
 // Function prototypes for internal use
 static int spi_select_device(const struct spi_device* device);
 static int spi_deselect_device(const struct spi_device* device);
+static void spi_apply_timing(const struct spi_timing* timing);
+static void spi_byte_delay(void);
+static int spi_claim_bus(uint8_t owner);
+static void spi_release_bus(void);
+static void spi_async_start(struct spi_transaction* trans);
+static uint8_t spi_async_tx_byte(const struct spi_transaction* trans, uint16_t pos);
+static void spi_async_service(void);
+static void spi_async_poll(void);
 
-static bool spi_busy = false;
+/** ***************************************************************************
+ * @brief Owner of the SPI bus
+*******************************************************************************/
+enum spi_owner {
+    SPI_OWNER_NONE = 0,     /**< Bus is free */
+    SPI_OWNER_SYNC,         /**< A blocking transfer has selected a device */
+    SPI_OWNER_ASYNC         /**< The interrupt-driven engine is working through its queue */
+};
+
+#define SPCR_MODE_POS CPHA
+#define SPCR_MODE_MASK ((1 << CPOL) | (1 << CPHA))
+#define SPCR_CLOCK_MASK ((1 << SPR1) | (1 << SPR0))
+#define CLOCK_DIV_SPI2X 0x04    /**< Bit set in clock_div_bits when SPI2X is needed */
+
+/**< SPR1:0 and SPI2X settings for each enum spi_clock_div value */
+static const uint8_t clock_div_bits[] = {
+    [SPI_CLOCK_DIV_2] = CLOCK_DIV_SPI2X | 0x00,
+    [SPI_CLOCK_DIV_4] = 0x00,
+    [SPI_CLOCK_DIV_8] = CLOCK_DIV_SPI2X | 0x01,
+    [SPI_CLOCK_DIV_16] = 0x01,
+    [SPI_CLOCK_DIV_32] = CLOCK_DIV_SPI2X | 0x02,
+    [SPI_CLOCK_DIV_64] = 0x02,
+    [SPI_CLOCK_DIV_128] = 0x03
+};
+
+/**< Inter-byte delay of the selected device */
+static uint8_t byte_delay_us = 0;
+
+/**< Current bus owner, see enum spi_owner. Only changed with interrupts disabled */
+static volatile uint8_t bus_owner = SPI_OWNER_NONE;
+
+/**< Queue of asynchronous transactions. The head is the active one */
+static struct spi_transaction* volatile queue_head = NULL;
+static struct spi_transaction* volatile queue_tail = NULL;
+
+/**< Number of bytes clocked in the active asynchronous transaction */
+static volatile uint16_t async_pos = 0;
 
 
 /** ***************************************************************************
@@ -59,6 +105,8 @@ void spi_master_init(struct gpio_pin _mosi_pin, struct gpio_pin _miso_pin, struc
 	SPCR = (1 << SPE) | (1 << MSTR);
 
     SPSR |= (1 << SPI2X); // Set double speed
+
+    // Each device applies its own timing profile when selected
 }
 
 /** ***************************************************************************
@@ -91,15 +139,58 @@ static int spi_select_device(const struct spi_device* device)
         return -ENXIO;
     }
 
-    if(spi_busy) {
-        return -EBUSY;
+    // Claim the bus before asserting CS, so an ISR never sees a selected but free bus
+    int ret = spi_claim_bus(SPI_OWNER_SYNC);
+    if(ret) {
+        return ret;
     }
 
+    spi_apply_timing(&device->timing);
     gpio_set(device->cs_pin, LOW);
-    spi_busy = true;
     return 0;
 }
 
+/** ***************************************************************************
+ * @brief Reconfigures the bus for the timing profile of a device
+ * 
+ * @param[in] timing Pointer to the timing profile
+ * @note Must only be called while no device is selected
+*******************************************************************************/
+static void spi_apply_timing(const struct spi_timing* timing)
+{
+    uint8_t clock_div = timing->clock_div;
+    if (clock_div > SPI_CLOCK_DIV_128) {
+        clock_div = SPI_CLOCK_DIV_128;
+    }
+    uint8_t bits = clock_div_bits[clock_div];
+
+    // Clears SPIE, the asynchronous engine sets it again after selecting
+    SPCR = (SPCR & ~(SPCR_MODE_MASK | SPCR_CLOCK_MASK | (1 << SPIE)))
+         | ((timing->mode << SPCR_MODE_POS) & SPCR_MODE_MASK)
+         | (bits & SPCR_CLOCK_MASK);
+
+    if (bits & CLOCK_DIV_SPI2X) {
+        SPSR |= (1 << SPI2X);
+    } else {
+        SPSR &= ~(1 << SPI2X);
+    }
+
+    byte_delay_us = timing->byte_delay_us;
+}
+
+/** ***************************************************************************
+ * @brief Waits the inter-byte delay of the selected device
+ * 
+ * @details _delay_us() needs a compile time constant, so the delay is
+ *          made up of SPI_BYTE_DELAY_STEP_US steps
+*******************************************************************************/
+static void spi_byte_delay(void)
+{
+    for (uint8_t us = byte_delay_us; us >= SPI_BYTE_DELAY_STEP_US; us -= SPI_BYTE_DELAY_STEP_US) {
+        _delay_us(SPI_BYTE_DELAY_STEP_US);
+    }
+}
+
 /** ***************************************************************************
  * @brief Deselects a specific SPI slave device
  * 
@@ -112,10 +203,65 @@ static int spi_deselect_device(const struct spi_device* device)
     }
 
     gpio_set(device->cs_pin, HIGH);
-    spi_busy = false;
+    spi_release_bus();
     return 0;
 }
 
+/** ***************************************************************************
+ * @brief Claims the SPI bus
+ * 
+ * @param[in] owner New owner of the bus, see enum spi_owner
+ * @return int 0 on success, -EBUSY if the bus could not be claimed
+ * @details If the asynchronous engine owns the bus it will release it on its own,
+ *          so the caller waits for it
+*******************************************************************************/
+static int spi_claim_bus(uint8_t owner)
+{
+    while (1) {
+        bool claimed = false;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            if (bus_owner == SPI_OWNER_NONE) {
+                bus_owner = owner;
+                claimed = true;
+            }
+        }
+        if (claimed) {
+            return 0;
+        }
+        if (bus_owner != SPI_OWNER_ASYNC) {
+            return -EBUSY;
+        }
+        spi_async_poll();
+    }
+}
+
+/** ***************************************************************************
+ * @brief Releases the SPI bus after a blocking transfer
+ * 
+ * @details Hands the bus straight to the asynchronous engine if transactions
+ *          were queued while it was owned
+*******************************************************************************/
+static void spi_release_bus(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (queue_head) {
+            bus_owner = SPI_OWNER_ASYNC;
+            spi_async_start(queue_head);
+        } else {
+            bus_owner = SPI_OWNER_NONE;
+        }
+    }
+}
+
+/** ***************************************************************************
+ * @brief Check if the SPI bus is owned by a transaction
+ * 
+ * @return bool True if a synchronous or asynchronous transaction owns the bus
+*******************************************************************************/
+bool spi_is_busy(void) {
+    return bus_owner != SPI_OWNER_NONE;
+}
+
 /** ***************************************************************************
  * @brief Transmits a single data byte to an SPI device
  * 
@@ -151,96 +297,270 @@ int spi_master_transmit_single(const struct spi_device* device, uint8_t data) {
  * @return 0 on success, negative error code on failure
 *******************************************************************************/
 int spi_master_transmit(const struct spi_device* device, uint8_t* data, uint8_t size) {
+    struct spi_segment segment = {.tx_data = data, .rx_data = NULL, .size = size};
+    return spi_transfer_segments(device, &segment, 1);
+}
+
+/** ***************************************************************************
+ * @brief Receives multiple data bytes from an SPI device
+ * 
+ * @param[in] device Pointer to the SPI device structure
+ * @param[out] buffer Buffer to store received data bytes
+ * @param[in] size Number of bytes to receive
+ * @return int 0 on success, negative error code on failure
+*******************************************************************************/
+int spi_receive(const struct spi_device* device, uint8_t* buffer, uint8_t size) {
+    struct spi_segment segment = {.tx_data = NULL, .rx_data = buffer, .size = size};
+    return spi_transfer_segments(device, &segment, 1);
+}
+
+/** ***************************************************************************
+ * @brief Performs a query operation (transmit then receive) on an SPI device
+ * 
+ * @param[in] device Pointer to the SPI device structure
+ * @param[in] tx_data Array of data bytes to transmit
+ * @param[in] tx_size Number of bytes to transmit
+ * @param[out] rx_data Buffer to store received data bytes
+ * @param[in] rx_size Number of bytes to receive
+ * @return int 0 on success, negative error code on failure
+*******************************************************************************/
+int spi_query(const struct spi_device* device, uint8_t* tx_data, uint8_t tx_size, uint8_t* rx_data, uint8_t rx_size) {
+    struct spi_segment segments[2] = {
+        {.tx_data = tx_data, .rx_data = NULL, .size = tx_size},
+        {.tx_data = NULL, .rx_data = rx_data, .size = rx_size},
+    };
+    return spi_transfer_segments(device, segments, 2);
+}
+
+/** ***************************************************************************
+ * @brief Transfers a list of segments to an SPI device under one chip select
+ * 
+ * @param[in] device Pointer to the SPI device structure
+ * @param[in] segments Array of segments, transferred in order
+ * @param[in] count Number of segments
+ * @return int 0 on success, negative error code on failure
+*******************************************************************************/
+int spi_transfer_segments(const struct spi_device* device, const struct spi_segment* segments, uint8_t count) {
+    if (!segments && count) {
+        return -EINVAL;
+    }
 
     int ret = spi_select_device(device);
     if(ret) {
         return ret;
     }
 
-    for (uint8_t i = 0; i < size; i++) {
-
-        SPDR = data [i];
-        
-        // Wait for transmission complete
-	    while (!(SPSR & (1 << SPIF))) {
-            ;
-	    }   
+    for (uint8_t i = 0; i < count; i++) {
+        const uint8_t* tx_data = segments[i].tx_data;
+        uint8_t* rx_data = segments[i].rx_data;
+
+        for (uint16_t j = 0; j < segments[i].size; j++) {
+            SPDR = tx_data ? tx_data[j] : 0x00;
+            while (!(SPSR & (1 << SPIF))) {
+                ;
+            }
+
+            uint8_t rx = SPDR;
+            if (rx_data) {
+                rx_data[j] = rx;
+                spi_byte_delay();
+            }
+        }
     }
 
     spi_deselect_device(device);
-
     return 0;
 }
 
 /** ***************************************************************************
- * @brief Receives multiple data bytes from an SPI device
+ * @brief Selects a device and claims the bus for a multi-part transaction
  * 
  * @param[in] device Pointer to the SPI device structure
- * @param[out] buffer Buffer to store received data bytes
- * @param[in] size Number of bytes to receive
  * @return int 0 on success, negative error code on failure
 *******************************************************************************/
-int spi_receive(const struct spi_device* device, uint8_t* buffer, uint8_t size) {
-    if (!device) {
+int spi_begin_transaction(const struct spi_device* device) {
+    return spi_select_device(device);
+}
+
+/** ***************************************************************************
+ * @brief Exchanges a single byte with the currently selected device
+ * 
+ * @param[in] data Data byte to transmit
+ * @return uint8_t Data byte received while transmitting
+*******************************************************************************/
+uint8_t spi_transfer_byte(uint8_t data) {
+    SPDR = data;
+    while (!(SPSR & (1 << SPIF))) {
+        ;
+    }
+    uint8_t rx = SPDR;
+    spi_byte_delay();
+    return rx;
+}
+
+/** ***************************************************************************
+ * @brief Deselects a device and releases the bus
+ * 
+ * @param[in] device Pointer to the SPI device structure
+ * @return int 0 on success, negative error code on failure
+*******************************************************************************/
+int spi_end_transaction(const struct spi_device* device) {
+    return spi_deselect_device(device);
+}
+
+/** ***************************************************************************
+ * @brief Queue an asynchronous transaction
+ * 
+ * @param[in,out] trans Pointer to the transaction descriptor
+ * @return int 0 on success, negative error code on failure
+*******************************************************************************/
+int spi_submit(struct spi_transaction* trans) {
+    if (!trans || !trans->device) {
         return -ENXIO;
     }
 
-    int ret = spi_select_device(device);
-    if(ret) {
-        return ret;
+    // The interrupt cannot wait between bytes, and empty transactions never complete
+    if (trans->device->timing.byte_delay_us || (trans->tx_size + trans->rx_size) == 0) {
+        return -EINVAL;
     }
 
-    for (uint8_t i = 0; i < size; i++) {
+    if (trans->state != SPI_TRANS_DONE) {
+        return -EBUSY;
+    }
 
-        SPDR = 0x00; // Send dummy byte to generate clock
+    trans->next = NULL;
+    trans->state = SPI_TRANS_QUEUED;
 
-        // Wait for reception complete
-        while (!(SPSR & (1 << SPIF))) {
-            ;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (queue_tail) {
+            queue_tail->next = trans;
+        } else {
+            queue_head = trans;
         }
+        queue_tail = trans;
 
-        buffer[i] = SPDR;
-        _delay_us(100);
+        // Start right away if the bus is free, otherwise the current owner hands it over
+        if (bus_owner == SPI_OWNER_NONE) {
+            bus_owner = SPI_OWNER_ASYNC;
+            spi_async_start(trans);
+        }
     }
-    
-    spi_deselect_device(device);
+
     return 0;
 }
 
 /** ***************************************************************************
- * @brief Performs a query operation (transmit then receive) on an SPI device
+ * @brief Wait for an asynchronous transaction to complete
  * 
- * @param[in] device Pointer to the SPI device structure
- * @param[in] tx_data Array of data bytes to transmit
- * @param[in] tx_size Number of bytes to transmit
- * @param[out] rx_data Buffer to store received data bytes
- * @param[in] rx_size Number of bytes to receive
- * @return int 0 on success, negative error code on failure
+ * @param[in] trans Pointer to the transaction descriptor
 *******************************************************************************/
-int spi_query(const struct spi_device* device, uint8_t* tx_data, uint8_t tx_size, uint8_t* rx_data, uint8_t rx_size) {
-    int ret = spi_select_device(device);
-    if(ret) {
-        return ret;
+void spi_wait(const struct spi_transaction* trans) {
+    if (!trans) {
+        return;
     }
-    
-    // Transmit data without managing CS (already selected)
-    for (uint8_t i = 0; i < tx_size; i++) {
-        SPDR = tx_data[i];
-        while (!(SPSR & (1 << SPIF))) {
-            ;
-        }   
+    while (trans->state != SPI_TRANS_DONE) {
+        spi_async_poll();
     }
-    
-    // Receive data without managing CS (already selected)
-    for (uint8_t i = 0; i < rx_size; i++) {
-        SPDR = 0x00; // Send dummy byte to generate clock
-        while (!(SPSR & (1 << SPIF))) {
-            ;
-        }
-        rx_data[i] = SPDR;
-        _delay_us(100);
+}
+
+/** ***************************************************************************
+ * @brief Advance the asynchronous engine while interrupts are disabled
+ * 
+ * @details The SPI interrupt cannot run then, so waiting callers service the
+ *          transfer complete flag themselves instead of spinning forever
+*******************************************************************************/
+static void spi_async_poll(void) {
+    if (!(SREG & (1 << SREG_I)) && (SPSR & (1 << SPIF))) {
+        spi_async_service();
     }
-    
-    spi_deselect_device(device);
-    return 0;
-}
\ No newline at end of file
+}
+
+/** ***************************************************************************
+ * @brief Selects the device of a transaction and clocks out its first byte
+ * 
+ * @param[in,out] trans Pointer to the transaction descriptor
+ * @note Must be called with interrupts disabled, or from the SPI ISR
+*******************************************************************************/
+static void spi_async_start(struct spi_transaction* trans) {
+    trans->state = SPI_TRANS_ACTIVE;
+    if (trans->pre) {
+        trans->pre(trans);
+    }
+
+    spi_apply_timing(&trans->device->timing);
+    SPCR |= (1 << SPIE);
+    gpio_set(trans->device->cs_pin, LOW);
+
+    async_pos = 0;
+    SPDR = spi_async_tx_byte(trans, 0);
+}
+
+/** ***************************************************************************
+ * @brief Get the byte to send at a position in a transaction
+ * 
+ * @param[in] trans Pointer to the transaction descriptor
+ * @param[in] pos Byte position in the transaction
+ * @return uint8_t Byte to send, zero when receiving
+*******************************************************************************/
+static uint8_t spi_async_tx_byte(const struct spi_transaction* trans, uint16_t pos) {
+    if (pos < trans->tx_size && trans->tx_data) {
+        return trans->tx_data[pos];
+    }
+    return 0x00;
+}
+
+/** ***************************************************************************
+ * @brief SPI serial transfer complete interrupt
+*******************************************************************************/
+ISR(SPI_STC_vect) {
+    spi_async_service();
+}
+
+/** ***************************************************************************
+ * @brief Handle a completed byte of the active asynchronous transaction
+ * 
+ * @details Stores the received byte and sends the next one. When a transaction
+ *          completes, its device is deselected and the next queued transaction
+ *          is started, or the bus is released
+ * @note Must be called with interrupts disabled
+*******************************************************************************/
+static void spi_async_service(void) {
+    struct spi_transaction* trans = queue_head;
+    uint8_t rx = SPDR;
+    uint16_t pos = async_pos;
+
+    if (!trans) {
+        SPCR &= ~(1 << SPIE);
+        return;
+    }
+
+    if (pos >= trans->tx_size && trans->rx_data) {
+        trans->rx_data[pos - trans->tx_size] = rx;
+    }
+
+    pos++;
+    async_pos = pos;
+    if (pos < trans->tx_size + trans->rx_size) {
+        SPDR = spi_async_tx_byte(trans, pos);
+        return;
+    }
+
+    gpio_set(trans->device->cs_pin, HIGH);
+    queue_head = trans->next;
+    if (!queue_head) {
+        queue_tail = NULL;
+    }
+    trans->state = SPI_TRANS_DONE;
+
+    // The callback may queue a follow-up transaction
+    if (trans->callback) {
+        trans->callback(trans);
+    }
+
+    if (queue_head) {
+        spi_async_start(queue_head);
+    } else {
+        SPCR &= ~(1 << SPIE);
+        bus_owner = SPI_OWNER_NONE;
+    }
+}
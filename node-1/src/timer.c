@@ -0,0 +1,80 @@
+/** ***************************************************************************
+ * @file timer.c
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Free-running timebase on Timer3
+ * @version 0.1
+ * @date 2025-10-23
+ * 
+ * @copyright Copyright (c) 2025 Byggarane
+ * 
+*******************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <util/atomic.h>
+
+#include "timer.h"
+
+
+/**< Upper 16 bits of the time, counted by the overflow interrupt */
+static volatile uint16_t overflows = 0;
+
+/** ***************************************************************************
+ * @brief Start the timebase on Timer3
+*******************************************************************************/
+void timer_init(void) {
+    if (TCCR3B & ((1 << CS32) | (1 << CS31) | (1 << CS30))) {
+        return; // Already running
+    }
+
+    // Normal mode, prescaler 8
+    TCCR3A = 0;
+    TCNT3 = 0;
+    ETIFR = (1 << TOV3);
+    ETIMSK |= (1 << TOIE3);
+    TCCR3B = (1 << CS31);
+}
+
+/** ***************************************************************************
+ * @brief Get the current time
+ * 
+ * @return uint32_t Ticks since timer_init()
+*******************************************************************************/
+uint32_t timer_now(void) {
+    uint16_t high;
+    uint16_t low;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        high = overflows;
+        low = TCNT3;
+
+        // An overflow that has not been handled yet belongs to this reading
+        // unless the counter was read before it wrapped
+        if ((ETIFR & (1 << TOV3)) && low < 0x8000) {
+            high++;
+        }
+    }
+
+    return ((uint32_t)high << 16) | low;
+}
+
+/** ***************************************************************************
+ * @brief Convert a tick count to microseconds
+ * 
+ * @param[in] ticks Number of ticks
+ * @return uint32_t Microseconds, rounded down
+*******************************************************************************/
+uint32_t timer_ticks_to_us(uint32_t ticks) {
+    // One tick is 8 / 4.9152 MHz = 625/384 us. Split to avoid overflowing 32 bits
+    return (ticks / 384) * 625 + ((ticks % 384) * 625) / 384;
+}
+
+/** ***************************************************************************
+ * @brief Timer3 overflow interrupt
+*******************************************************************************/
+ISR(TIMER3_OVF_vect) {
+    overflows++;
+}
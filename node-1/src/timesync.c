@@ -0,0 +1,168 @@
+/** ***************************************************************************
+ * @file timesync.c
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Time synchronisation to the node 2 clock over CAN
+ * @version 0.1
+ * @date 2025-11-26
+ * 
+ * @copyright Copyright (c) 2025 Byggarane
+ * 
+*******************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+
+#include "timer.h"
+#include "timesync.h"
+
+
+/**< Last SYNC frame waiting for its follow-up */
+static bool sync_pending = false;
+static uint8_t sync_seq;
+static uint32_t sync_stamp;
+
+/**< The clock: node 2 time is anchor_us at anchor_ticks and runs at 1 + drift */
+static bool locked = false;
+static uint32_t anchor_ticks;
+static uint32_t anchor_us;
+static uint8_t outlier_run = 0;
+
+/**< Start of the current drift measurement */
+static uint32_t baseline_ticks;
+static uint32_t baseline_us;
+static uint8_t baseline_samples = 0;
+
+static struct timesync_stats stats;
+
+static void timesync_sample(uint32_t stamp, uint32_t remote_us);
+
+
+/** ***************************************************************************
+ * @brief Process a SYNC or follow-up frame from node 2
+*******************************************************************************/
+int timesync_handle(const struct can_msg* msg, uint32_t stamp) {
+    if (msg->id == CAN_ID_TIME_SYNC && msg->dlc >= 1) {
+        sync_pending = true;
+        sync_seq = msg->bytes[0];
+        sync_stamp = stamp;
+        return 0;
+    }
+    
+    struct timesync_follow_up_frame follow_up;
+    if (msg->id != CAN_ID_TIME_FOLLOW_UP || msg->dlc < sizeof(follow_up)) {
+        return -EINVAL;
+    }
+    memcpy(&follow_up, msg->bytes, sizeof(follow_up));
+    if (!sync_pending || follow_up.seq != sync_seq) {
+        stats.unmatched++;
+        return -ENXIO;
+    }
+    sync_pending = false;
+
+    // The stamp is taken when the frame is read, after it has ended on the bus
+    timesync_sample(sync_stamp, follow_up.sync_us + TIMESYNC_RX_DELAY_US);
+    return 0;
+}
+
+/** ***************************************************************************
+ * @brief Check whether the clock follows node 2
+*******************************************************************************/
+bool timesync_locked(void) {
+    return locked;
+}
+
+/** ***************************************************************************
+ * @brief Convert a local time to the node 2 time axis
+*******************************************************************************/
+uint32_t timesync_to_remote_us(uint32_t ticks) {
+    if (!locked) {
+        return 0;
+    }
+
+    // Times before the anchor are converted as negative spans
+    int32_t span_us;
+    if ((int32_t)(ticks - anchor_ticks) >= 0) {
+        span_us = timer_ticks_to_us(ticks - anchor_ticks);
+    } else {
+        span_us = -(int32_t)timer_ticks_to_us(anchor_ticks - ticks);
+    }
+    int32_t drift_us = ((int64_t)span_us * stats.drift_ppm16) / (1000000L * TIMESYNC_PPM_SCALE);
+    return anchor_us + span_us + drift_us;
+}
+
+/** ***************************************************************************
+ * @brief Get the current time on the node 2 time axis
+*******************************************************************************/
+uint32_t timesync_now_us(void) {
+    return timesync_to_remote_us(timer_now());
+}
+
+/** ***************************************************************************
+ * @brief Get the synchronisation statistics
+*******************************************************************************/
+void timesync_get_stats(struct timesync_stats* out) {
+    *out = stats;
+}
+
+/** ***************************************************************************
+ * @brief Drop the lock and reset all statistics
+*******************************************************************************/
+void timesync_reset(void) {
+    memset(&stats, 0, sizeof(stats));
+    sync_pending = false;
+    locked = false;
+    outlier_run = 0;
+}
+
+/** ***************************************************************************
+ * @brief Helper function to discipline the clock with one sample
+ * 
+ * @param[in] stamp Local time of the sample
+ * @param[in] remote_us Node 2 time of the sample
+*******************************************************************************/
+static void timesync_sample(uint32_t stamp, uint32_t remote_us) {
+    if (!locked) {
+        locked = true;
+        anchor_ticks = stamp;
+        anchor_us = remote_us;
+        baseline_ticks = stamp;
+        baseline_us = remote_us;
+        baseline_samples = 0;
+        stats.samples++;
+        stats.last_error_us = 0;
+        return;
+    }
+
+    uint32_t estimate_us = timesync_to_remote_us(stamp);
+    int32_t error_us = (int32_t)(remote_us - estimate_us);
+    if (error_us > TIMESYNC_OUTLIER_US || error_us < -TIMESYNC_OUTLIER_US) {
+        // Usually a receive delayed by a deferred drain. Many in a row mean
+        // the clock has been lost, so start over
+        stats.outliers++;
+        if (++outlier_run >= TIMESYNC_MAX_OUTLIERS) {
+            locked = false;
+            outlier_run = 0;
+        }
+        return;
+    }
+    outlier_run = 0;
+    stats.samples++;
+    stats.last_error_us = error_us;
+
+    // Correct half the phase error, so single noisy samples are damped
+    anchor_ticks = stamp;
+    anchor_us = estimate_us + error_us / 2;
+
+    // Drift over a long baseline, where the receive jitter matters little
+    if (++baseline_samples >= TIMESYNC_DRIFT_BASELINE) {
+        int32_t local_us = timer_ticks_to_us(stamp - baseline_ticks);
+        int32_t offset_us = (int32_t)(remote_us - baseline_us) - local_us;
+        if (local_us > 0) {
+            int32_t measured = ((int64_t)offset_us * 1000000L * TIMESYNC_PPM_SCALE) / local_us;
+            stats.drift_ppm16 += (measured - stats.drift_ppm16) >> TIMESYNC_DRIFT_SHIFT;
+        }
+        baseline_ticks = stamp;
+        baseline_us = remote_us;
+        baseline_samples = 0;
+    }
+}
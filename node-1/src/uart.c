@@ -9,7 +9,76 @@
  * 
  ******************************************************************************/
 
+#include <stdint.h>
+
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
 #include "uart.h"
+#include "xmem.h"
+
+#define TX_MASK (UART_TX_BUFFER_SIZE - 1)
+#define RX_MASK (UART_RX_BUFFER_SIZE - 1)
+
+_Static_assert((UART_TX_BUFFER_SIZE & TX_MASK) == 0 && UART_TX_BUFFER_SIZE <= 256, "UART transmit ring size must be a power of two up to 256");
+_Static_assert((UART_RX_BUFFER_SIZE & RX_MASK) == 0 && UART_RX_BUFFER_SIZE <= 256, "UART receive ring size must be a power of two up to 256");
+
+#if UART_BUFFERS_IN_XMEM
+_Static_assert(UART_TX_BUFFER_SIZE <= XMEM_UART_TX_SIZE, "UART transmit ring does not fit in its XMEM region");
+_Static_assert(UART_RX_BUFFER_SIZE <= XMEM_UART_RX_SIZE, "UART receive ring does not fit in its XMEM region");
+
+// Rings in external SRAM, xmem_init() must run before uart_init()
+static volatile uint8_t* const tx_buf = (volatile uint8_t*)(SRAM_BASE_ADDR + XMEM_UART_TX_OFFSET);
+static volatile uint8_t* const rx_buf = (volatile uint8_t*)(SRAM_BASE_ADDR + XMEM_UART_RX_OFFSET);
+#else
+static volatile uint8_t tx_buf[UART_TX_BUFFER_SIZE];
+static volatile uint8_t rx_buf[UART_RX_BUFFER_SIZE];
+#endif
+
+// One slot is kept free to tell a full ring from an empty one
+static volatile uint8_t tx_head = 0;    /**< Next slot to write, owned by uart_transmit() */
+static volatile uint8_t tx_tail = 0;    /**< Next slot to send, owned by the UDRE interrupt */
+static volatile uint8_t rx_head = 0;    /**< Next slot to write, owned by the RXC interrupt */
+static volatile uint8_t rx_tail = 0;    /**< Next slot to read, owned by uart_receive() */
+static volatile uint16_t tx_dropped = 0;
+static volatile uint16_t rx_dropped = 0;
+static volatile bool tx_started = false; /**< Set once a byte has been written to UDR0 */
+static enum uart_tx_policy tx_policy = UART_TX_BLOCK;
+
+/** ***************************************************************************
+ * @brief Check the global interrupt flag
+ * 
+ * @return true if the interrupts can drain and fill the rings
+ ******************************************************************************/
+static bool interrupts_enabled(void) {
+    return SREG & (1 << SREG_I);
+}
+
+/** ***************************************************************************
+ * @brief Send the oldest queued byte from the transmit ring
+ * 
+ * @details Used by the UDRE interrupt, and by polling when interrupts are
+ *          disabled. The data register must be empty
+ ******************************************************************************/
+static void tx_send_next(void) {
+    uint8_t tail = tx_tail;
+    UDR0 = tx_buf[tail];
+    // Clear transmit complete, uart_flush() waits for it. The error flags in
+    // UCSR0A must be written as zero, so only U2X0 and MPCM0 are kept
+    UCSR0A = (UCSR0A & ((1 << U2X0) | (1 << MPCM0))) | (1 << TXC0);
+    tx_started = true;
+    tx_tail = (tail + 1) & TX_MASK;
+}
+
+/** ***************************************************************************
+ * @brief Make room in a full transmit ring without the interrupt
+ ******************************************************************************/
+static void tx_send_polled(void) {
+    while (!(UCSR0A & (1 << UDRE0))) {
+        // Do nothing, just wait
+    }
+    tx_send_next();
+}
 
 /** ***************************************************************************
  * @brief Initialize the UART with the given UBRR value
@@ -18,44 +87,143 @@
  ******************************************************************************/
 void uart_init(uint16_t ubrr) {
 
+    // Let queued bytes out at the rate they were queued for
+    if (UCSR0B & (1 << TXEN0)) {
+        uart_flush();
+    }
+    UCSR0B = 0;
+
+    tx_head = 0;
+    tx_tail = 0;
+    rx_head = 0;
+    rx_tail = 0;
+    tx_dropped = 0;
+    rx_dropped = 0;
+    tx_policy = UART_TX_BLOCK;
+
     // Set baud rate
     UBRR0H = (uint8_t)(ubrr >> 8);
     UBRR0L = (uint8_t)ubrr;
 
-    // Enable receiver and transmitter
-    UCSR0B = (1 << RXEN0) | (1 << TXEN0);
+    // Enable receiver and transmitter, and the receive interrupt. The data
+    // register empty interrupt is enabled while there is something to send
+    UCSR0B = (1 << RXEN0) | (1 << TXEN0) | (1 << RXCIE0);
     
     // Set frame format: 8 data bits, 1 stop bit
     UCSR0C = (1 << URSEL0) | (1 << USBS0) | (3 << UCSZ00);
 }
 
 /** ***************************************************************************
- * @brief Transmit a single byte of data via UART
+ * @brief Queue a single byte of data for transmission
  * 
  * @param[in] data The byte to be transmitted
+ * @details Returns as soon as the byte is queued. When the ring is full the
+ *          policy decides between waiting and dropping. Waiting with interrupts
+ *          disabled sends the oldest byte by polling to make room
  ******************************************************************************/
 void uart_transmit(uint8_t data) {
+    bool polled = !interrupts_enabled();
+    bool queued = false;
 
-    // Wait for empty transmit buffer
-    while (!(UCSR0A & (1 << UDRE0))) {
-        // Do nothing, just wait
+    while (!queued) {
+        // Also called from interrupts, so the producer side is not lock free
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            uint8_t head = tx_head;
+            uint8_t next = (head + 1) & TX_MASK;
+            if (next != tx_tail) {
+                tx_buf[head] = data;
+                tx_head = next;
+                UCSR0B |= (1 << UDRIE0);
+                queued = true;
+            } else if (tx_policy == UART_TX_DROP) {
+                tx_dropped++;
+                queued = true;
+            }
+        }
+        if (!queued && polled) {
+            tx_send_polled();
+        }
     }
-    // Put data into buffer, sends the data
-    UDR0 = data;
 }
 
 /** ***************************************************************************
- * @brief Receive a single byte of data via UART
+ * @brief Receive a single byte of data via UART, waits for it
  * 
  * @return uint8_t The received byte
  ******************************************************************************/
 uint8_t uart_receive(void) {
-    // Wait for data to be received
-    while (!(UCSR0A & (1 << RXC0))) {
-        // Do nothing, just wait
+    while (!uart_rx_available()) {
+        if (!interrupts_enabled()) {
+            // Keep both directions going by polling, a prompt may be queued
+            if (tx_head != tx_tail && (UCSR0A & (1 << UDRE0))) {
+                tx_send_next();
+            }
+            if (UCSR0A & (1 << RXC0)) {
+                return UDR0;
+            }
+        }
     }
-    // Get and return received data from buffer
-    return UDR0;
+    // Get and return received data from the ring
+    uint8_t tail = rx_tail;
+    uint8_t data = rx_buf[tail];
+    rx_tail = (tail + 1) & RX_MASK;
+    return data;
+}
+
+/** ***************************************************************************
+ * @brief Check for received data without waiting
+ * 
+ * @return true if uart_receive() would return immediately
+ ******************************************************************************/
+bool uart_rx_available(void) {
+    return rx_head != rx_tail;
+}
+
+/** ***************************************************************************
+ * @brief Wait until everything queued has left the transmitter
+ ******************************************************************************/
+void uart_flush(void) {
+    while (tx_head != tx_tail) {
+        if (!interrupts_enabled()) {
+            tx_send_polled();
+        }
+    }
+    if (tx_started) {
+        while (!(UCSR0A & (1 << TXC0))) {
+            // Do nothing, just wait for the last stop bit
+        }
+    }
+}
+
+/** ***************************************************************************
+ * @brief Select what happens when the transmit ring is full
+ * 
+ * @param[in] policy New policy
+ ******************************************************************************/
+void uart_tx_policy(enum uart_tx_policy policy) {
+    tx_policy = policy;
+}
+
+/** ***************************************************************************
+ * @brief Number of bytes dropped by UART_TX_DROP since uart_init()
+ ******************************************************************************/
+uint16_t uart_tx_dropped(void) {
+    uint16_t dropped;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        dropped = tx_dropped;
+    }
+    return dropped;
+}
+
+/** ***************************************************************************
+ * @brief Number of received bytes lost to a full receive ring since uart_init()
+ ******************************************************************************/
+uint16_t uart_rx_dropped(void) {
+    uint16_t dropped;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        dropped = rx_dropped;
+    }
+    return dropped;
 }
 
 /** ***************************************************************************
@@ -80,4 +248,34 @@ int uart_transmit_stdio(char c, FILE *stream) {
 int uart_receive_stdio(FILE *stream) {
     (void)stream;  // Avoid unused parameter warning
     return uart_receive();
+}
+
+/** ***************************************************************************
+ * @brief Data register empty interrupt, sends the next queued byte
+ ******************************************************************************/
+ISR(USART0_UDRE_vect) {
+    if (tx_tail == tx_head) {
+        // Emptied by polling, nothing left to send
+        UCSR0B &= ~(1 << UDRIE0);
+        return;
+    }
+    tx_send_next();
+    if (tx_tail == tx_head) {
+        UCSR0B &= ~(1 << UDRIE0);
+    }
+}
+
+/** ***************************************************************************
+ * @brief Receive complete interrupt, queues the received byte
+ ******************************************************************************/
+ISR(USART0_RXC_vect) {
+    uint8_t data = UDR0;
+    uint8_t head = rx_head;
+    uint8_t next = (head + 1) & RX_MASK;
+    if (next == rx_tail) {
+        rx_dropped++;
+        return;
+    }
+    rx_buf[head] = data;
+    rx_head = next;
 }
\ No newline at end of file
@@ -13,16 +13,40 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+
+#define F_CPU 4915200 // Hz
+#include <avr/interrupt.h>
+#include <avr/io.h>
 
 #include "adc.h"
 #include "user_io.h"
 #include "gpio.h"
 #include "spi.h"
 #include "can.h"
+#include "latency.h"
+#include "timer.h"
+
+// PB1 has no external interrupt, so Timer0 samples the button instead.
+// 4.9152 MHz / 64 / (15 + 1) = 4.8 kHz, 208 us between samples
+#define FIRE_SAMPLE_OCR 15
+#define FIRE_HOLDOFF_SAMPLES 48 /**< Ignore bounces for 10 ms after a press or release */
+
+// Timer2 in CTC mode, prescaler 1024: 4.9152 MHz / 1024 / 100 = 48 counts per tick
+#define INPUT_STATE_OCR (F_CPU / 1024 / INPUT_STATE_RATE_HZ - 1)
 
 static const struct spi_device *user_io_dev;
 static struct gpio_pin js_btn_pin;
 
+static volatile bool input_state_pending = false;
+static uint8_t input_state_seq = 0;
+
+// Button sampling state, only touched by the Timer0 interrupt while it is enabled
+static bool fire_timer_ready = false;
+static bool fire_prev_pressed = false;
+static bool fire_pending = false;
+static uint8_t fire_holdoff = 0;
+
 /** ***************************************************************************
  * @brief Initialize user I/O board
  *
@@ -150,8 +174,13 @@ int get_button_states(struct buttons *btn_states)
         return -EINVAL;
     }
 
-    uint8_t input[1] = {USER_IO_CMD_BTNS};
-    return spi_query(user_io_dev, input, 1, (uint8_t *)btn_states, sizeof(*btn_states));
+    const uint8_t command = USER_IO_CMD_BTNS;
+    struct spi_segment segments[2] = {
+        {.tx_data = &command, .rx_data = NULL, .size = 1},
+        {.tx_data = NULL, .rx_data = (uint8_t *)btn_states, .size = sizeof(*btn_states)},
+    };
+
+    return spi_transfer_segments(user_io_dev, segments, 2);
 }
 
 /** ***************************************************************************
@@ -167,8 +196,125 @@ int get_joystick_states(struct joystick *joystick_states)
         return -EINVAL;
     }
 
-    uint8_t input[1] = {USER_IO_CMD_JOYSTICK};
-    return spi_query(user_io_dev, input, 1, (uint8_t *)joystick_states, sizeof(*joystick_states));
+    const uint8_t command = USER_IO_CMD_JOYSTICK;
+    struct spi_segment segments[2] = {
+        {.tx_data = &command, .rx_data = NULL, .size = 1},
+        {.tx_data = NULL, .rx_data = (uint8_t *)joystick_states, .size = sizeof(*joystick_states)},
+    };
+
+    return spi_transfer_segments(user_io_dev, segments, 2);
+}
+
+/** ***************************************************************************
+ * @brief Get the touch slider state from the user I/O board via SPI
+ *
+ * @param[out] slider Pointer to structure to store the slider state
+ * @return int 0 on success, negative error code on failure
+ *******************************************************************************/
+int get_slider_state(struct touch_slider *slider)
+{
+    if (!slider)
+    {
+        return -EINVAL;
+    }
+
+    const uint8_t command = USER_IO_CMD_TOUCH_SLIDER;
+    struct spi_segment segments[2] = {
+        {.tx_data = &command, .rx_data = NULL, .size = 1},
+        {.tx_data = NULL, .rx_data = (uint8_t *)slider, .size = sizeof(*slider)},
+    };
+
+    return spi_transfer_segments(user_io_dev, segments, 2);
+}
+
+/** ***************************************************************************
+ * @brief Start the input state tick
+ *******************************************************************************/
+void input_state_init(void)
+{
+    timer_init();
+    input_state_pending = false;
+
+    // CTC mode, prescaler 1024
+    OCR2 = INPUT_STATE_OCR;
+    TCCR2 = (1 << WGM21) | (1 << CS22) | (1 << CS21) | (1 << CS20);
+    TIMSK |= (1 << OCIE2);
+}
+
+/** ***************************************************************************
+ * @brief Check for and consume an input state tick
+ *
+ * @return true if a tick has occurred since the last call
+ *******************************************************************************/
+bool input_state_tick(void)
+{
+    if (!input_state_pending)
+    {
+        return false;
+    }
+    input_state_pending = false;
+    return true;
+}
+
+/** ***************************************************************************
+ * @brief Send joystick, buttons and slider to node 2 in one input state frame
+ *
+ * @param[out] msg Buffer for the CAN message
+ * @param[out] btn_states Button states read for the frame, all released if
+ *                        they could not be read. May be NULL
+ * @return int 0 on success, negative error code on failure
+ *******************************************************************************/
+int send_input_state_to_can(struct can_msg *msg, struct buttons *btn_states)
+{
+    struct buttons buttons = {0};
+    struct touch_slider slider;
+
+    int res = get_button_states(&buttons);
+    if (res != 0)
+    {
+        buttons = (struct buttons){0};
+    }
+    if (btn_states)
+    {
+        *btn_states = buttons;
+    }
+    if (res == 0)
+    {
+        res = get_slider_state(&slider);
+    }
+    if (res != 0)
+    {
+        return res;
+    }
+
+    uint8_t seq = input_state_seq++;
+    bool probe = latency_probe_due(seq);
+    uint32_t stamp = timer_now();
+
+    x_y_coords coords = get_joystick_x_y_percentage();
+    struct input_state_frame frame = {
+        .x = coords.x,
+        .y = coords.y,
+        .buttons = ((uint16_t)get_joystick_btn_state() << INPUT_STATE_BTN_JOYSTICK) |
+                   ((uint16_t)(buttons.right & 0x3F) << INPUT_STATE_BTN_RIGHT) |
+                   ((uint16_t)(buttons.left & 0x3F) << INPUT_STATE_BTN_LEFT) |
+                   ((uint16_t)probe << INPUT_STATE_BTN_PROBE),
+        .slider = slider.x,
+        .seq = seq,
+        .timestamp = stamp >> INPUT_STATE_TIMESTAMP_SHIFT,
+    };
+
+    msg->id = CAN_ID_INPUT_STATE;
+    msg->dlc = sizeof(frame);
+    memcpy(msg->bytes, &frame, sizeof(frame));
+
+    // Replacing a probe frame with a newer one would lose the probe silently
+    res = probe ? can_send_pinned(msg) : can_send(msg);
+    if (res == 0 && probe)
+    {
+        latency_probe_sent(seq, stamp);
+    }
+    return res;
 }
 
 /** ***************************************************************************
@@ -205,4 +351,98 @@ int send_js_btn_to_can(struct can_msg *msg)
     msg->bytes[0] = state;
 
     return can_send(msg);
-}
\ No newline at end of file
+}
+
+/** ***************************************************************************
+ * @brief Send the joystick button press straight from an interrupt
+ *
+ * @param[in] trigger How the preloaded press frame is triggered
+ * @return int 0 on success, negative error code on failure
+ *******************************************************************************/
+int js_btn_fire_init(enum can_fire_trigger trigger)
+{
+    struct can_msg fire_msg = {
+        .id = CAN_ID_JOYSTICK_BTN,
+        .dlc = 1,
+        .bytes = {1}};
+
+    int res = can_fire_init(&fire_msg, trigger);
+    if (res != 0)
+    {
+        return res;
+    }
+
+    if (trigger == CAN_FIRE_TRIGGER_SPI)
+    {
+        // CTC mode, prescaler 64
+        OCR0 = FIRE_SAMPLE_OCR;
+        TCCR0 = (1 << WGM01) | (1 << CS01) | (1 << CS00);
+        fire_timer_ready = true;
+    }
+
+    return 0;
+}
+
+/** ***************************************************************************
+ * @brief Start or stop sampling the joystick button for the fire frame
+ *
+ * @param[in] enable True to start sampling, false to stop
+ *******************************************************************************/
+void js_btn_fire_enable(bool enable)
+{
+    if (!fire_timer_ready)
+    {
+        return;
+    }
+
+    if (!enable)
+    {
+        TIMSK &= ~(1 << OCIE0);
+        return;
+    }
+
+    // A button already held when sampling starts is not a press
+    fire_prev_pressed = get_joystick_btn_state();
+    fire_pending = false;
+    fire_holdoff = 0;
+    TIFR = (1 << OCF0);
+    TIMSK |= (1 << OCIE0);
+}
+
+/** ***************************************************************************
+ * @brief Timer0 compare interrupt, samples the joystick button
+ *
+ * @details Fires the preloaded frame on a press edge. Both edges start a hold-off,
+ *          so release bounces do not look like new presses. If the SPI bus is
+ *          busy the frame is retried on the next sample
+ *******************************************************************************/
+ISR(TIMER0_COMP_vect)
+{
+    bool pressed = get_joystick_btn_state();
+    if (fire_holdoff)
+    {
+        fire_holdoff--;
+    }
+    else if (pressed != fire_prev_pressed)
+    {
+        if (pressed)
+        {
+            fire_pending = true;
+        }
+        fire_holdoff = FIRE_HOLDOFF_SAMPLES;
+    }
+    fire_prev_pressed = pressed;
+
+    if (fire_pending && can_fire() != -EBUSY)
+    {
+        fire_pending = false;
+    }
+}
+
+/** ***************************************************************************
+ * @brief Timer2 compare interrupt, marks an input state tick
+ *******************************************************************************/
+ISR(TIMER2_COMP_vect)
+{
+    input_state_pending = true;
+}
@@ -15,6 +15,7 @@
 
 #include <avr/io.h>
 
+#include "debug.h"
 #include "xmem.h"
 
 
@@ -64,7 +65,7 @@ void SRAM_test(void)
 
 	uint16_t write_errors = 0;
 	uint16_t retrieval_errors = 0;
-	printf("Starting SRAM test...\r\n");
+	LOG_PRINTF("Starting SRAM test...\r\n");
 
 	// rand() stores some internal state, so calling this function in a loop will
 	// yield different seeds each time (unless srand() is called before this function)
@@ -77,7 +78,7 @@ void SRAM_test(void)
 		xmem_write(some_value, i);
 		uint8_t retrieved_value = xmem_read(i);
 		if (retrieved_value != some_value) {
-			printf("Write phase error: address 0x%03X contains 0x%02X (should be 0x%02X)\r\n", i, retrieved_value, some_value);
+			LOG_PRINTF("Write phase error: address 0x%03X contains 0x%02X (should be 0x%02X)\r\n", i, retrieved_value, some_value);
 			write_errors++;
 		}
 	}
@@ -88,10 +89,10 @@ void SRAM_test(void)
 		uint8_t some_value = rand();
 		uint8_t retrieved_value = xmem_read(i);
 		if (retrieved_value != some_value) {
-			printf("Retrieval phase error: address 0x%03X contains 0x%02X (should be 0x%02X)\r\n", i, retrieved_value, some_value);
+			LOG_PRINTF("Retrieval phase error: address 0x%03X contains 0x%02X (should be 0x%02X)\r\n", i, retrieved_value, some_value);
 			retrieval_errors++;
 		}
 	}
 
-	printf("SRAM test completed with\r\n%4d errors in write phase and\r\n%4d errors in retrieval phase\r\n\r\n", write_errors, retrieval_errors);
+	LOG_PRINTF("SRAM test completed with\r\n%4d errors in write phase and\r\n%4d errors in retrieval phase\r\n\r\n", write_errors, retrieval_errors);
 }
\ No newline at end of file
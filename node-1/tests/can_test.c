@@ -12,11 +12,13 @@
  * 
 *******************************************************************************/
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
 
 #define F_CPU 4915200
+#include <avr/interrupt.h>
 #include <util/delay.h>
 
 #include "../inc/can.h"
@@ -25,6 +27,28 @@
 #define TEST_PASSED "PASSED"
 #define TEST_FAILED "FAILED"
 
+#define LOOPBACK_FRAMES 20
+#define LOOPBACK_TEST_ID 0x10
+#define BURST_FRAMES_PER_CLASS 4
+#define REPLACE_FRAMES 8
+#define FILTER_REJECT_ID 0x11
+#define FIRE_FRAMES 8
+
+static const struct spi_device mcp2515_dev = {
+    .id = 2,
+    .cs_pin = {'D', 3}
+};
+
+// Same bit timing as main.c: 250 kbps @ 16 MHz
+static const struct can_config can_cfg = {
+    .phase2 = 4,
+    .propag = 3,
+    .phase1 = 8,
+    .sjw = 1,
+    .brp = 1,
+    .smp = 0
+};
+
 static uint8_t tests_passed = 0;
 static uint8_t tests_failed = 0;
 
@@ -97,6 +121,252 @@ static void test_can_status_placeholder(void) {
     print_test_result("CAN Status Placeholder", passed);
 }
 
+/** ***************************************************************************
+ * @brief Test CAN receive statistics with NULL pointer
+*******************************************************************************/
+static void test_can_rx_stats_null(void) {
+    int ret = can_get_rx_stats(NULL);
+    
+    // Should return error for NULL pointer
+    bool passed = (ret < 0);
+    
+    print_test_result("CAN RX Stats NULL", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test that no frames are lost in loopback mode
+ * 
+ * @details Sends a burst of frames to itself and checks that every frame
+ *          reaches the receive queue and that no overflow is reported
+*******************************************************************************/
+static void test_can_loopback_no_loss(void) {
+    int ret = can_init(&mcp2515_dev, CAN_MODE_LOOPBACK, can_cfg, NULL);
+    sei();
+    
+    // Empty the queue before counting
+    struct can_msg msg;
+    while (can_receive(&msg) == 0) {
+        ;
+    }
+    can_reset_rx_stats();
+    
+    uint8_t received = 0;
+    for (uint8_t i = 0; i < LOOPBACK_FRAMES; i++) {
+        msg.id = LOOPBACK_TEST_ID;
+        msg.dlc = 1;
+        msg.bytes[0] = i;
+        can_send(&msg);
+        _delay_ms(1);
+    }
+    while (can_receive(&msg) == 0) {
+        if (msg.id == LOOPBACK_TEST_ID) {
+            received++;
+        }
+    }
+    
+    struct can_rx_stats stats;
+    can_get_rx_stats(&stats);
+    
+    bool passed = (ret == 0) && (received == LOOPBACK_FRAMES) &&
+                  (stats.rx0_overflows == 0) && (stats.rx1_overflows == 0) &&
+                  (stats.queue_drops == 0);
+    
+    printf("  Received: %d/%d, RXB0: %u, RXB1: %u, Overflows: %u/%u, Drops: %u\r\n",
+           received, LOOPBACK_FRAMES, stats.rx0_frames, stats.rx1_frames,
+           stats.rx0_overflows, stats.rx1_overflows, stats.queue_drops);
+    print_test_result("CAN Loopback No Loss", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test that back-to-back sends use all transmit buffers without loss
+ * 
+ * @details Sends a burst of frames of every class without waiting, so most of
+ *          them go through the RAM queue, and checks that all are transmitted
+*******************************************************************************/
+static void test_can_tx_burst(void) {
+    static const uint32_t class_ids[CAN_NUM_TX_CLASSES] = {
+        [CAN_TX_CLASS_STATUS] = LOOPBACK_TEST_ID,
+        [CAN_TX_CLASS_JOYSTICK] = CAN_ID_JOYSTICK,
+        [CAN_TX_CLASS_BUTTON] = CAN_ID_JOYSTICK_BTN,
+    };
+    
+    int ret = can_init(&mcp2515_dev, CAN_MODE_LOOPBACK, can_cfg, NULL);
+    sei();
+    can_reset_tx_stats();
+    
+    struct can_msg msg;
+    uint8_t send_errors = 0;
+    for (uint8_t i = 0; i < BURST_FRAMES_PER_CLASS; i++) {
+        for (uint8_t tx_class = 0; tx_class < CAN_NUM_TX_CLASSES; tx_class++) {
+            msg.id = class_ids[tx_class];
+            msg.dlc = 8;
+            msg.data = i;
+            if (can_send(&msg)) {
+                send_errors++;
+            }
+        }
+    }
+    _delay_ms(10);
+    
+    // Throw away the looped back frames
+    while (can_receive(&msg) == 0) {
+        ;
+    }
+    
+    struct can_tx_stats stats;
+    can_get_tx_stats(&stats);
+    
+    bool passed = (ret == 0) && (send_errors == 0);
+    for (uint8_t tx_class = 0; tx_class < CAN_NUM_TX_CLASSES; tx_class++) {
+        struct can_tx_class_stats* cs = &stats.classes[tx_class];
+        passed = passed && (cs->sent == BURST_FRAMES_PER_CLASS) && (cs->drops == 0);
+        printf("  Class %u: sent %u, queued %u, drops %u, latency max %lu us, mean %lu us\r\n",
+               tx_class, cs->sent, cs->queued, cs->drops, cs->max_latency_us,
+               cs->sent ? cs->total_latency_us / cs->sent : 0);
+    }
+    
+    print_test_result("CAN TX Burst", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test that replace mode only delivers the newest joystick frame
+ * 
+ * @details Every frame is either sent or replaced, and the last one received
+ *          must carry the last value sent
+*******************************************************************************/
+static void test_can_tx_replace(void) {
+    int ret = can_init(&mcp2515_dev, CAN_MODE_LOOPBACK, can_cfg, NULL);
+    sei();
+    int ret_replace = can_set_tx_replace(CAN_TX_CLASS_JOYSTICK, true);
+    int ret_invalid = can_set_tx_replace(CAN_NUM_TX_CLASSES, true);
+    can_reset_tx_stats();
+    
+    struct can_msg msg;
+    for (uint8_t i = 0; i < REPLACE_FRAMES; i++) {
+        msg.id = CAN_ID_JOYSTICK;
+        msg.dlc = 1;
+        msg.bytes[0] = i;
+        can_send(&msg);
+    }
+    _delay_ms(5);
+    
+    uint8_t last_value = 0xFF;
+    while (can_receive(&msg) == 0) {
+        if (msg.id == CAN_ID_JOYSTICK) {
+            last_value = msg.bytes[0];
+        }
+    }
+    can_set_tx_replace(CAN_TX_CLASS_JOYSTICK, false);
+    
+    struct can_tx_stats stats;
+    can_get_tx_stats(&stats);
+    struct can_tx_class_stats* cs = &stats.classes[CAN_TX_CLASS_JOYSTICK];
+    
+    bool passed = (ret == 0) && (ret_replace == 0) && (ret_invalid == -EINVAL) &&
+                  (cs->sent + cs->replaced == REPLACE_FRAMES) && (cs->drops == 0) &&
+                  (last_value == REPLACE_FRAMES - 1);
+    
+    printf("  Sent %u, replaced %u, last value %u\r\n", cs->sent, cs->replaced, last_value);
+    print_test_result("CAN TX Replace", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test that the acceptance filters drop unwanted frames
+ * 
+ * @details Accepts only LOOPBACK_TEST_ID, sends it and a neighbouring ID, and
+ *          checks that only the first reaches the receive queue
+*******************************************************************************/
+static void test_can_filters(void) {
+    static const struct can_filter_config filters = {
+        .masks = {CAN_STD_ID_MASK, CAN_STD_ID_MASK},
+        .filters = {
+            {LOOPBACK_TEST_ID, false}, {LOOPBACK_TEST_ID, false}, {LOOPBACK_TEST_ID, false},
+            {LOOPBACK_TEST_ID, false}, {LOOPBACK_TEST_ID, false}, {LOOPBACK_TEST_ID, false}
+        }
+    };
+    
+    int ret = can_init(&mcp2515_dev, CAN_MODE_LOOPBACK, can_cfg, &filters);
+    sei();
+    
+    struct can_msg msg = {.dlc = 0};
+    msg.id = LOOPBACK_TEST_ID;
+    can_send(&msg);
+    msg.id = FILTER_REJECT_ID;
+    can_send(&msg);
+    _delay_ms(2);
+    
+    uint8_t accepted = 0;
+    uint8_t rejected = 0;
+    while (can_receive(&msg) == 0) {
+        if (msg.id == LOOPBACK_TEST_ID) {
+            accepted++;
+        } else {
+            rejected++;
+        }
+    }
+    
+    // Leave the controller accepting everything for the other tests
+    can_init(&mcp2515_dev, CAN_MODE_LOOPBACK, can_cfg, NULL);
+    
+    bool passed = (ret == 0) && (accepted == 1) && (rejected == 0);
+    
+    print_test_result("CAN Filters", passed);
+}
+
+/** ***************************************************************************
+ * @brief Compare the latency of the preloaded fire frame with can_send()
+ * 
+ * @details Both are measured from the call until the MCP2515 reports the frame
+ *          as sent. can_send() builds and loads the frame over SPI first, the
+ *          fire frame only needs the single RTS byte
+*******************************************************************************/
+static void test_can_fire_latency(void) {
+    struct can_msg msg = {.id = CAN_ID_JOYSTICK_BTN, .dlc = 1, .bytes = {1}};
+    
+    int ret = can_init(&mcp2515_dev, CAN_MODE_LOOPBACK, can_cfg, NULL);
+    sei();
+    can_reset_tx_stats();
+    
+    // Frame loaded over SPI on every press
+    for (uint8_t i = 0; i < FIRE_FRAMES; i++) {
+        can_send(&msg);
+        _delay_ms(1);
+    }
+    
+    // Preloaded frame, one RTS byte per press
+    int ret_fire_init = can_fire_init(&msg, CAN_FIRE_TRIGGER_SPI);
+    uint8_t fire_errors = 0;
+    for (uint8_t i = 0; i < FIRE_FRAMES; i++) {
+        if (can_fire()) {
+            fire_errors++;
+        }
+        _delay_ms(1);
+    }
+    
+    while (can_receive(&msg) == 0) {
+        ;
+    }
+    
+    struct can_tx_stats tx_stats;
+    struct can_fire_stats fire_stats;
+    can_get_tx_stats(&tx_stats);
+    can_get_fire_stats(&fire_stats);
+    struct can_tx_class_stats* btn = &tx_stats.classes[CAN_TX_CLASS_BUTTON];
+    
+    // Give the fire buffer back to can_send()
+    can_init(&mcp2515_dev, CAN_MODE_LOOPBACK, can_cfg, NULL);
+    
+    bool passed = (ret == 0) && (ret_fire_init == 0) && (fire_errors == 0) &&
+                  (btn->sent == FIRE_FRAMES) && (fire_stats.sent == FIRE_FRAMES) &&
+                  (fire_stats.total_latency_us < btn->total_latency_us);
+    
+    printf("  can_send(): mean %lu us, max %lu us\r\n",
+           btn->sent ? btn->total_latency_us / btn->sent : 0, btn->max_latency_us);
+    printf("  can_fire(): mean %lu us, max %lu us\r\n",
+           fire_stats.sent ? fire_stats.total_latency_us / fire_stats.sent : 0, fire_stats.max_latency_us);
+    print_test_result("CAN Fire Latency", passed);
+}
+
 /** ***************************************************************************
  * @brief Run all CAN tests
  * 
@@ -118,6 +388,12 @@ void run_can_tests(void) {
     test_can_receive_placeholder();
     test_can_filter_placeholder();
     test_can_status_placeholder();
+    test_can_rx_stats_null();
+    test_can_loopback_no_loss();
+    test_can_tx_burst();
+    test_can_tx_replace();
+    test_can_filters();
+    test_can_fire_latency();
     
     printf("\r\n");
     printf("========================================\r\n");
@@ -15,6 +15,7 @@
 #include <string.h>
 
 #define F_CPU 4915200
+#include <avr/pgmspace.h>
 #include <util/delay.h>
 
 #include "../inc/gui.h"
@@ -120,7 +121,7 @@ static void test_menu_item_strings(void) {
             passed = false;
             printf("  Menu item %d has NULL string\r\n", i);
         } else {
-            printf("  Item %d: %s\r\n", i, main_menu.items[i].string);
+            printf("  Item %d: %S\r\n", i, main_menu.items[i].string); // %S reads from flash
         }
     }
     
@@ -178,8 +179,8 @@ static void test_custom_menu(void) {
         .sel = 0,
         .prev_sel = 0,
         .items = (struct menu_item[]){
-            {.string = "Test Item 1", .action = test_action_callback},
-            {.string = "Test Item 2", .action = NULL}
+            {.string = PSTR("Test Item 1"), .action = test_action_callback},
+            {.string = PSTR("Test Item 2"), .action = NULL}
         }
     };
     
@@ -288,8 +289,8 @@ static void test_menu_long_strings(void) {
         .sel = 0,
         .prev_sel = 0,
         .items = (struct menu_item[]){
-            {.string = "Very Long Menu Item Name Here", .action = NULL},
-            {.string = "Short", .action = NULL}
+            {.string = PSTR("Very Long Menu Item Name Here"), .action = NULL},
+            {.string = PSTR("Short"), .action = NULL}
         }
     };
     
@@ -0,0 +1,135 @@
+/** ***************************************************************************
+ * @file latency_test.c
+ * @author Byggarane
+ * @brief Test suite for the latency measurement
+ * @version 0.1
+ * @date 2025-11-24
+ * 
+ * @copyright Copyright (c) 2025 Byggarane
+ * 
+*******************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "../inc/can.h"
+#include "../inc/latency.h"
+#include "../inc/timer.h"
+
+#define TEST_PASSED "PASSED"
+#define TEST_FAILED "FAILED"
+
+#define REF_RX_US 0xFFFF00UL    /**< Close to the 24-bit wrap of the node 2 time */
+#define TICKS_1250_US 768       /**< 768 ticks are exactly 1250 us */
+#define TICKS_1875_US 1152
+#define TICKS_10_MS 6144
+
+static uint8_t tests_passed = 0;
+static uint8_t tests_failed = 0;
+
+static void print_test_result(const char* test_name, bool passed) {
+    if (passed) {
+        printf("[%s] %s\r\n", TEST_PASSED, test_name);
+        tests_passed++;
+    } else {
+        printf("[%s] %s\r\n", TEST_FAILED, test_name);
+        tests_failed++;
+    }
+}
+
+static struct can_msg echo_msg(uint8_t seq, uint32_t rx_us, uint16_t actuation_us, uint16_t turnaround_us) {
+    struct can_msg msg = {.id = CAN_ID_LATENCY_ECHO, .dlc = 8};
+    msg.bytes[0] = seq;
+    msg.bytes[1] = rx_us & 0xFF;
+    msg.bytes[2] = (rx_us >> 8) & 0xFF;
+    msg.bytes[3] = (rx_us >> 16) & 0xFF;
+    msg.bytes[4] = actuation_us & 0xFF;
+    msg.bytes[5] = actuation_us >> 8;
+    msg.bytes[6] = turnaround_us & 0xFF;
+    msg.bytes[7] = turnaround_us >> 8;
+    return msg;
+}
+
+/** ***************************************************************************
+ * @brief Test matching of echoes to the outstanding probe
+ * 
+ * @details Round trip 1250 us minus 100 us turnaround gives 575 us one way,
+ *          plus 200 us until actuation
+*******************************************************************************/
+static void test_latency_echo_match(void) {
+    latency_reset();
+    latency_probe_sent(0, 1000);
+    
+    struct can_msg wrong = echo_msg(1, REF_RX_US, 200, 100);
+    struct can_msg right = echo_msg(0, REF_RX_US, 200, 100);
+    int ret_wrong = latency_echo_received(&wrong, 1000 + TICKS_1250_US);
+    int ret_right = latency_echo_received(&right, 1000 + TICKS_1250_US);
+    int ret_again = latency_echo_received(&right, 1000 + TICKS_1250_US);
+    
+    struct latency_stats stats;
+    latency_get_stats(&stats);
+    
+    bool passed = (ret_wrong == -ENXIO) && (ret_right == 0) && (ret_again == -ENXIO) &&
+                  (stats.echoes == 1) && (stats.min_net_us == 575) &&
+                  (stats.min_us == 775) && (stats.hist[1] == 1);
+    
+    print_test_result("Latency Echo Match", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test that later probes are measured against the reference offset
+ * 
+ * @details The second probe is sent 10 ms after the first and arrives 10.3 ms
+ *          after it on node 2, across the 24-bit wrap. Its longer round trip
+ *          does not replace the reference, so it is 300 us slower one way
+*******************************************************************************/
+static void test_latency_offset(void) {
+    latency_reset();
+    
+    latency_probe_sent(0, 1000);
+    struct can_msg first = echo_msg(0, REF_RX_US, 200, 100);
+    latency_echo_received(&first, 1000 + TICKS_1250_US);
+    
+    uint32_t second_stamp = 1000 + TICKS_10_MS;
+    latency_probe_sent(LATENCY_PROBE_INTERVAL, second_stamp);
+    struct can_msg second = echo_msg(LATENCY_PROBE_INTERVAL, (REF_RX_US + 10300) & LATENCY_CLOCK_MASK, 200, 100);
+    int ret = latency_echo_received(&second, second_stamp + TICKS_1875_US);
+    
+    // A probe without an echo counts as lost once the next one goes out
+    latency_probe_sent(2 * LATENCY_PROBE_INTERVAL, second_stamp + TICKS_10_MS);
+    latency_probe_sent(3 * LATENCY_PROBE_INTERVAL, second_stamp + 2 * TICKS_10_MS);
+    
+    struct latency_stats stats;
+    latency_get_stats(&stats);
+    
+    bool passed = (ret == 0) && (stats.echoes == 2) && (stats.best_rtt_us == 1150) &&
+                  (stats.max_net_us == 875) && (stats.max_us == 1075) &&
+                  (stats.hist[2] == 1) && (stats.probes == 4) && (stats.lost == 1);
+    
+    latency_print_report();
+    print_test_result("Latency Offset", passed);
+}
+
+/** ***************************************************************************
+ * @brief Run all latency tests
+*******************************************************************************/
+void run_latency_tests(void) {
+    printf("\r\n");
+    printf("========================================\r\n");
+    printf("      Latency Module Test Suite        \r\n");
+    printf("========================================\r\n\r\n");
+    
+    tests_passed = 0;
+    tests_failed = 0;
+    
+    test_latency_echo_match();
+    test_latency_offset();
+    latency_reset();
+    
+    printf("\r\n");
+    printf("========================================\r\n");
+    printf("Results: %d passed, %d failed\r\n", tests_passed, tests_failed);
+    printf("========================================\r\n\r\n");
+}
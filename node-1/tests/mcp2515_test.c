@@ -201,6 +201,74 @@ static void test_mcp2515_rts_multiple(void) {
     print_test_result("MCP2515 RTS All Buffers", passed);
 }
 
+/** ***************************************************************************
+ * @brief Test MCP2515 load TX buffer and read back the registers
+*******************************************************************************/
+static void test_mcp2515_load_tx_buffer(void) {
+    // SIDH, SIDL, EID8, EID0, DLC, DATA0-1
+    uint8_t frame[MCP2515_FRAME_MAX_SIZE] = {0x12, 0x40, 0x00, 0x00, 0x02, 0xAB, 0xCD};
+    uint8_t read_back[MCP2515_FRAME_HEADER_SIZE + 2] = {0};
+    
+    int ret_load = mcp2515_load_tx_buffer(1, frame);
+    int ret_read = mcp2515_read_multiple(MCP2515_TXB1CTRL + 1, read_back, sizeof(read_back));
+    
+    bool passed = (ret_load == 0) && (ret_read == 0);
+    for (uint8_t i = 0; i < sizeof(read_back); i++) {
+        if (read_back[i] != frame[i]) {
+            passed = false;
+        }
+    }
+    
+    print_test_result("MCP2515 Load TX Buffer", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test MCP2515 fast buffer instructions with invalid arguments
+*******************************************************************************/
+static void test_mcp2515_buffer_invalid(void) {
+    uint8_t frame[MCP2515_FRAME_MAX_SIZE] = {0};
+    
+    // Should return error for NULL pointers and out of range buffers
+    bool passed = (mcp2515_load_tx_buffer(0, NULL) < 0) &&
+                  (mcp2515_load_tx_buffer(MCP2515_NUM_TX_BUFFERS, frame) < 0) &&
+                  (mcp2515_read_rx_buffer(0, NULL) < 0) &&
+                  (mcp2515_read_rx_buffer(MCP2515_NUM_RX_BUFFERS, frame) < 0);
+    
+    print_test_result("MCP2515 Buffer Instructions Invalid", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test MCP2515 filter and mask registers
+ * 
+ * @note Relies on the MCP2515 being in configuration mode after reset
+*******************************************************************************/
+static void test_mcp2515_filter_mask(void) {
+    // 0x123 is SIDH 0x24 and SID2:0 = 3 in SIDL bits 7-5
+    uint8_t expected_filter[4] = {0x24, 0x60 | MCP2515_SIDL_EXIDE, 0x00, 0x00};
+    uint8_t expected_mask[4] = {0xFF, 0xE0, 0x00, 0x00};
+    uint8_t filter[4] = {0};
+    uint8_t mask[4] = {0};
+    
+    int ret_filter = mcp2515_set_filter(3, 0x123, true);
+    int ret_mask = mcp2515_set_mask(1, 0x7FF);
+    mcp2515_read_multiple(MCP2515_RXF3SIDH, filter, sizeof(filter));
+    mcp2515_read_multiple(MCP2515_RXM1SIDH, mask, sizeof(mask));
+    
+    bool passed = (ret_filter == 0) && (ret_mask == 0) &&
+                  (mcp2515_set_filter(MCP2515_NUM_FILTERS, 0, false) < 0) &&
+                  (mcp2515_set_mask(MCP2515_NUM_MASKS, 0) < 0);
+    for (uint8_t i = 0; i < sizeof(filter); i++) {
+        if (filter[i] != expected_filter[i] || mask[i] != expected_mask[i]) {
+            passed = false;
+        }
+    }
+    
+    // Accept everything again
+    mcp2515_set_mask(1, 0x000);
+    
+    print_test_result("MCP2515 Filter And Mask", passed);
+}
+
 /** ***************************************************************************
  * @brief Test MCP2515 register access patterns
 *******************************************************************************/
@@ -278,6 +346,9 @@ void run_mcp2515_tests(void) {
     test_mcp2515_read_status_null();
     test_mcp2515_rts();
     test_mcp2515_rts_multiple();
+    test_mcp2515_load_tx_buffer();
+    test_mcp2515_buffer_invalid();
+    test_mcp2515_filter_mask();
     test_mcp2515_register_access();
     test_mcp2515_configuration();
     
@@ -9,6 +9,7 @@
  * 
 *******************************************************************************/
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -16,15 +17,22 @@
 
 #define F_CPU 4915200
 #include <util/delay.h>
+#include <avr/interrupt.h>
 #include <avr/io.h>
 
 #include "../inc/spi.h"
 #include "../inc/gpio.h"
+#include "../inc/timer.h"
 #include "../inc/uart.h"
 
 #define TEST_PASSED "PASSED"
 #define TEST_FAILED "FAILED"
 
+#define BENCH_ITERATIONS 16
+
+/**< The timing every device used before per-device profiles */
+#define LEGACY_TIMING {.clock_div = SPI_CLOCK_DIV_2, .mode = SPI_MODE_0, .byte_delay_us = 100}
+
 static uint8_t tests_passed = 0;
 static uint8_t tests_failed = 0;
 
@@ -249,6 +257,197 @@ static void test_spi_multiple_devices(void) {
     print_test_result("SPI Multiple Devices", passed);
 }
 
+/** ***************************************************************************
+ * @brief Test that a device's timing profile is applied on select
+*******************************************************************************/
+static void test_spi_timing_profile(void) {
+    struct spi_device slow_dev = {
+        .id = 5,
+        .cs_pin = {'D', 3},
+        .timing = {.clock_div = SPI_CLOCK_DIV_16, .mode = SPI_MODE_3, .byte_delay_us = 0}
+    };
+    struct spi_device fast_dev = {
+        .id = 6,
+        .cs_pin = {'D', 3},
+        .timing = {.clock_div = SPI_CLOCK_DIV_2, .mode = SPI_MODE_0, .byte_delay_us = 0}
+    };
+    
+    spi_device_init(&slow_dev);
+    
+    // fck/16 is SPR0 without SPI2X, mode 3 is CPOL and CPHA
+    spi_master_transmit_single(&slow_dev, 0x00);
+    bool slow_ok = (SPCR & (1 << SPR0)) && !(SPCR & (1 << SPR1)) && !(SPSR & (1 << SPI2X)) &&
+                   (SPCR & (1 << CPOL)) && (SPCR & (1 << CPHA));
+    
+    // fck/2 is SPI2X only, mode 0 clears CPOL and CPHA
+    spi_master_transmit_single(&fast_dev, 0x00);
+    bool fast_ok = !(SPCR & ((1 << SPR0) | (1 << SPR1))) && (SPSR & (1 << SPI2X)) &&
+                   !(SPCR & ((1 << CPOL) | (1 << CPHA)));
+    
+    bool passed = slow_ok && fast_ok;
+    
+    print_test_result("SPI Timing Profile", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test a scatter-gather transfer under one chip select
+*******************************************************************************/
+static void test_spi_transfer_segments(void) {
+    struct spi_device test_dev = {
+        .id = 9,
+        .cs_pin = {'D', 3}
+    };
+    uint8_t header[2] = {0x02, 0x36};
+    uint8_t payload[3] = {0x11, 0x22, 0x33};
+    uint8_t rx_data[3] = {0};
+    struct spi_segment segments[3] = {
+        {.tx_data = header, .rx_data = NULL, .size = sizeof(header)},
+        {.tx_data = payload, .rx_data = rx_data, .size = sizeof(payload)},  // Full duplex
+        {.tx_data = NULL, .rx_data = NULL, .size = 0},
+    };
+    
+    spi_device_init(&test_dev);
+    
+    int ret = spi_transfer_segments(&test_dev, segments, 3);
+    int ret_null = spi_transfer_segments(&test_dev, NULL, 1);
+    
+    bool passed = (ret == 0) && (ret_null == -EINVAL) && gpio_get(test_dev.cs_pin) && !spi_is_busy();
+    
+    print_test_result("SPI Transfer Segments", passed);
+}
+
+/**< Number of completion callbacks seen by the async tests */
+static volatile uint8_t async_callbacks = 0;
+
+static void count_callback(struct spi_transaction* trans) {
+    (void)trans;
+    async_callbacks++;
+}
+
+/** ***************************************************************************
+ * @brief Test queued asynchronous transactions
+ * 
+ * @details Queues two transactions back to back, then issues a blocking transfer
+ *          that has to wait for them to release the bus
+*******************************************************************************/
+static void test_spi_async_transaction(void) {
+    struct spi_device test_dev = {
+        .id = 7,
+        .cs_pin = {'D', 2},
+        .timing = {.clock_div = SPI_CLOCK_DIV_2, .mode = SPI_MODE_0, .byte_delay_us = 0}
+    };
+    uint8_t rx_data[4] = {0};
+    // Long enough to still be running when it is submitted again
+    struct spi_transaction first = {
+        .device = &test_dev,
+        .tx_data = NULL,
+        .tx_size = 256,
+        .callback = count_callback
+    };
+    struct spi_transaction second = {
+        .device = &test_dev,
+        .tx_size = 1,
+        .rx_data = rx_data,
+        .rx_size = sizeof(rx_data),
+        .callback = count_callback
+    };
+    
+    spi_device_init(&test_dev);
+    async_callbacks = 0;
+    sei();
+    
+    int ret1 = spi_submit(&first);
+    int ret2 = spi_submit(&second);
+    int ret3 = spi_submit(&first);  // Still queued or active
+    int ret4 = spi_master_transmit_single(&test_dev, 0x00);
+    spi_wait(&second);
+    
+    bool passed = (ret1 == 0) && (ret2 == 0) && (ret3 == -EBUSY) && (ret4 == 0) &&
+                  (first.state == SPI_TRANS_DONE) && (second.state == SPI_TRANS_DONE) &&
+                  (async_callbacks == 2) && !spi_is_busy() && gpio_get(test_dev.cs_pin);
+    
+    print_test_result("SPI Async Transaction", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test that invalid asynchronous transactions are rejected
+*******************************************************************************/
+static void test_spi_async_invalid(void) {
+    struct spi_device delayed_dev = {
+        .id = 8,
+        .cs_pin = {'B', 2},
+        .timing = {.clock_div = SPI_CLOCK_DIV_2, .mode = SPI_MODE_0, .byte_delay_us = 100}
+    };
+    struct spi_transaction delayed = {.device = &delayed_dev, .tx_size = 1};
+    struct spi_transaction empty = {.device = &delayed_dev};
+    struct spi_transaction no_device = {.tx_size = 1};
+    
+    bool passed = (spi_submit(NULL) == -ENXIO) &&
+                  (spi_submit(&no_device) == -ENXIO) &&
+                  (spi_submit(&empty) == -EINVAL) &&
+                  (spi_submit(&delayed) == -EINVAL) &&
+                  !spi_is_busy();
+    
+    print_test_result("SPI Async Invalid", passed);
+}
+
+/** ***************************************************************************
+ * @brief Time a typical transaction on a device
+ * 
+ * @param[in] device Pointer to the SPI device structure
+ * @param[in] tx_size Number of command bytes to transmit
+ * @param[in] rx_size Number of bytes to receive
+ * @return uint32_t Average time per transaction in microseconds
+ * @details Uses the Timer3 timebase
+*******************************************************************************/
+static uint32_t bench_transaction(const struct spi_device* device, uint8_t tx_size, uint8_t rx_size) {
+    uint8_t tx_data[4] = {0};
+    uint8_t rx_data[4] = {0};
+    
+    timer_init();
+    uint32_t start = timer_now();
+    for (uint8_t i = 0; i < BENCH_ITERATIONS; i++) {
+        spi_query(device, tx_data, tx_size, rx_data, rx_size);
+    }
+    uint32_t ticks = timer_now() - start;
+    
+    return timer_ticks_to_us(ticks) / BENCH_ITERATIONS;
+}
+
+/** ***************************************************************************
+ * @brief Benchmark the per-transaction time of each device
+ * 
+ * @details Runs each device's typical transaction with the legacy global
+ *          timing (100 us after every received byte) and with its own profile
+*******************************************************************************/
+static void benchmark_spi_devices(void) {
+    struct {
+        const char* name;
+        struct spi_device legacy;
+        struct spi_device profiled;
+        uint8_t tx_size;
+        uint8_t rx_size;
+    } benches[] = {
+        // Register read: READ, address, 1 data byte
+        {"MCP2515 read", {.id = 2, .cs_pin = {'D', 3}, .timing = LEGACY_TIMING},
+            {.id = 2, .cs_pin = {'D', 3}, .timing = {.clock_div = SPI_CLOCK_DIV_2, .mode = SPI_MODE_0, .byte_delay_us = 0}}, 2, 1},
+        // Button read: command, 3 data bytes
+        {"User I/O btns", {.id = 1, .cs_pin = {'B', 2}, .timing = LEGACY_TIMING},
+            {.id = 1, .cs_pin = {'B', 2}, .timing = {.clock_div = SPI_CLOCK_DIV_2, .mode = SPI_MODE_0, .byte_delay_us = 100}}, 1, 3},
+        // Goto address: 3 command bytes
+        {"OLED address", {.id = 0, .cs_pin = {'D', 2}, .timing = LEGACY_TIMING},
+            {.id = 0, .cs_pin = {'D', 2}, .timing = {.clock_div = SPI_CLOCK_DIV_2, .mode = SPI_MODE_0, .byte_delay_us = 0}}, 3, 0},
+    };
+    
+    printf("  Device          Legacy [us]  Profile [us]\r\n");
+    for (uint8_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        spi_device_init(&benches[i].legacy);
+        uint32_t legacy_us = bench_transaction(&benches[i].legacy, benches[i].tx_size, benches[i].rx_size);
+        uint32_t profiled_us = bench_transaction(&benches[i].profiled, benches[i].tx_size, benches[i].rx_size);
+        printf("  %-14s  %11lu  %12lu\r\n", benches[i].name, legacy_us, profiled_us);
+    }
+}
+
 /** ***************************************************************************
  * @brief Run all SPI tests
 *******************************************************************************/
@@ -271,6 +470,14 @@ void run_spi_tests(void) {
     test_spi_null_device();
     test_spi_cs_control();
     test_spi_multiple_devices();
+    test_spi_timing_profile();
+    test_spi_transfer_segments();
+    test_spi_async_transaction();
+    test_spi_async_invalid();
+    
+    printf("\r\n");
+    printf("SPI transaction benchmark:\r\n");
+    benchmark_spi_devices();
     
     printf("\r\n");
     printf("========================================\r\n");
@@ -34,15 +34,18 @@ extern void run_adc_tests(void);
 extern void run_can_tests(void);
 extern void run_gpio_tests(void);
 extern void run_gui_tests(void);
+extern void run_latency_tests(void);
 extern void run_mcp2515_tests(void);
 extern void run_oled_tests(void);
 extern void run_spi_tests(void);
+extern void run_timer_tests(void);
+extern void run_timesync_tests(void);
 extern void run_uart_tests(void);
 extern void run_user_io_tests(void);
 extern void run_xmem_tests(void);
 
-#define BAUD_RATE 9600
-#define UBRR (F_CPU/16/BAUD_RATE - 1)
+#define BAUD_RATE 38400
+#define UBRR UART_UBRR(BAUD_RATE)
 
 /** ***************************************************************************
  * @brief Print test menu
@@ -64,6 +67,9 @@ static void print_test_menu(void) {
     printf("  8. UART Driver Tests\r\n");
     printf("  9. User I/O Driver Tests\r\n");
     printf("  A. XMEM Driver Tests\r\n");
+    printf("  B. Timer Tests\r\n");
+    printf("  C. Latency Tests\r\n");
+    printf("  D. Time Sync Tests\r\n");
     printf("  0. Run ALL Tests\r\n");
     printf("  Q. Quit\r\n");
     printf("\r\n");
@@ -74,15 +80,15 @@ static void print_test_menu(void) {
  * @brief Initialize hardware for testing
 *******************************************************************************/
 static void test_hardware_init(void) {
+    // Initialize external memory first, it can hold the UART rings
+    xmem_init();
+
     // Initialize UART
     uart_init(UBRR);
     fdevopen(uart_transmit_stdio, uart_receive_stdio);
     
     printf("\r\n");
     printf("Initializing test hardware...\r\n");
-    
-    // Initialize external memory
-    xmem_init();
     printf("  [OK] External Memory\r\n");
     
     // Initialize GPIO for LED indicator
@@ -118,7 +124,8 @@ static void test_hardware_init(void) {
     // Initialize User I/O
     struct spi_device user_io_dev = {
         .id = 1,
-        .cs_pin = {'B', 2}
+        .cs_pin = {'B', 2},
+        .timing = {.clock_div = SPI_CLOCK_DIV_2, .mode = SPI_MODE_0, .byte_delay_us = 100}
     };
     struct gpio_pin js_btn_pin = {'B', 1};
     ret = user_io_init(user_io_dev, js_btn_pin);
@@ -168,6 +175,15 @@ static void run_all_tests(void) {
     run_xmem_tests();
     _delay_ms(500);
     
+    run_timer_tests();
+    _delay_ms(500);
+    
+    run_latency_tests();
+    _delay_ms(500);
+    
+    run_timesync_tests();
+    _delay_ms(500);
+    
     run_mcp2515_tests();
     _delay_ms(500);
     
@@ -236,6 +252,18 @@ int main(void) {
             case 'A':
                 run_xmem_tests();
                 break;
+            case 'b':
+            case 'B':
+                run_timer_tests();
+                break;
+            case 'c':
+            case 'C':
+                run_latency_tests();
+                break;
+            case 'd':
+            case 'D':
+                run_timesync_tests();
+                break;
             case '0':
                 run_all_tests();
                 break;
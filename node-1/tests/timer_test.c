@@ -0,0 +1,133 @@
+/** ***************************************************************************
+ * @file timer_test.c
+ * @author Byggarane
+ * @brief Test suite for the Timer3 timebase
+ * @version 0.1
+ * @date 2025-10-23
+ * 
+ * @copyright Copyright (c) 2025 Byggarane
+ * 
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define F_CPU 4915200
+#include <util/delay.h>
+#include <avr/interrupt.h>
+#include <avr/io.h>
+
+#include "../inc/timer.h"
+#include "../inc/uart.h"
+
+#define TEST_PASSED "PASSED"
+#define TEST_FAILED "FAILED"
+
+#define DELAY_TEST_MS 200
+#define DELAY_TOLERANCE_US 2000
+
+static uint8_t tests_passed = 0;
+static uint8_t tests_failed = 0;
+
+static void print_test_result(const char* test_name, bool passed) {
+    if (passed) {
+        printf("[%s] %s\r\n", TEST_PASSED, test_name);
+        tests_passed++;
+    } else {
+        printf("[%s] %s\r\n", TEST_FAILED, test_name);
+        tests_failed++;
+    }
+}
+
+/** ***************************************************************************
+ * @brief Test that the timer starts and keeps running on a second init
+*******************************************************************************/
+static void test_timer_init(void) {
+    timer_init();
+    uint32_t before = timer_now();
+    timer_init();
+    uint32_t after = timer_now();
+    
+    bool running = (TCCR3B & (1 << CS31)) != 0;
+    bool passed = running && (after >= before);
+    
+    print_test_result("Timer Init", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test the tick to microsecond conversion
+*******************************************************************************/
+static void test_timer_ticks_to_us(void) {
+    bool passed = (timer_ticks_to_us(0) == 0) &&
+                  (timer_ticks_to_us(384) == 625) &&
+                  (timer_ticks_to_us(TIMER_TICK_HZ) == 1000000UL) &&
+                  (timer_ticks_to_us(3840001UL) == 6250001UL);
+    
+    print_test_result("Timer Ticks To us", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test the measured time against a busy-wait delay
+ * 
+ * @details The delay spans several Timer3 overflows, so the 32-bit extension
+ *          is exercised as well
+*******************************************************************************/
+static void test_timer_elapsed(void) {
+    timer_init();
+    sei();
+    
+    uint32_t start = timer_now();
+    _delay_ms(DELAY_TEST_MS);
+    uint32_t elapsed_us = timer_ticks_to_us(timer_now() - start);
+    
+    bool passed = (elapsed_us > DELAY_TEST_MS * 1000UL - DELAY_TOLERANCE_US) &&
+                  (elapsed_us < DELAY_TEST_MS * 1000UL + DELAY_TOLERANCE_US);
+    
+    printf("  %d ms delay measured as %lu us\r\n", DELAY_TEST_MS, elapsed_us);
+    print_test_result("Timer Elapsed", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test that the time never goes backwards
+*******************************************************************************/
+static void test_timer_monotonic(void) {
+    timer_init();
+    sei();
+    
+    bool passed = true;
+    uint32_t last = timer_now();
+    for (uint16_t i = 0; i < 10000; i++) {
+        uint32_t now = timer_now();
+        if (now < last) {
+            passed = false;
+            break;
+        }
+        last = now;
+    }
+    
+    print_test_result("Timer Monotonic", passed);
+}
+
+/** ***************************************************************************
+ * @brief Run all timer tests
+*******************************************************************************/
+void run_timer_tests(void) {
+    printf("\r\n");
+    printf("========================================\r\n");
+    printf("       Timer Driver Test Suite         \r\n");
+    printf("========================================\r\n\r\n");
+    
+    tests_passed = 0;
+    tests_failed = 0;
+    
+    test_timer_init();
+    test_timer_ticks_to_us();
+    test_timer_elapsed();
+    test_timer_monotonic();
+    
+    printf("\r\n");
+    printf("========================================\r\n");
+    printf("Results: %d passed, %d failed\r\n", tests_passed, tests_failed);
+    printf("========================================\r\n\r\n");
+}
@@ -0,0 +1,179 @@
+/** ***************************************************************************
+ * @file timesync_test.c
+ * @author Byggarane
+ * @brief Test suite for the time synchronisation to node 2
+ * @version 0.1
+ * @date 2025-11-26
+ * 
+ * @copyright Copyright (c) 2025 Byggarane
+ * 
+*******************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../inc/can.h"
+#include "../inc/timesync.h"
+
+#define TEST_PASSED "PASSED"
+#define TEST_FAILED "FAILED"
+
+#define SYNC_TICKS 307200UL         /**< 500 ms of timer ticks */
+#define SYNC_US 500000UL
+#define DRIFT_PPM 100
+#define DRIFT_SAMPLES 320
+#define REMOTE_START_US 4000000000UL /**< Wraps during the drift test */
+
+static uint8_t tests_passed = 0;
+static uint8_t tests_failed = 0;
+
+static void print_test_result(const char* test_name, bool passed) {
+    if (passed) {
+        printf("[%s] %s\r\n", TEST_PASSED, test_name);
+        tests_passed++;
+    } else {
+        printf("[%s] %s\r\n", TEST_FAILED, test_name);
+        tests_failed++;
+    }
+}
+
+/** ***************************************************************************
+ * @brief Feed one SYNC/follow-up pair
+ * 
+ * @param[in] seq Sequence number
+ * @param[in] stamp Local receive time of the SYNC frame
+ * @param[in] sync_us Node 2 send time of the SYNC frame
+ * @return int Result of handling the follow-up
+*******************************************************************************/
+static int feed_sync(uint8_t seq, uint32_t stamp, uint32_t sync_us) {
+    struct can_msg sync = {.id = CAN_ID_TIME_SYNC, .dlc = 1, .bytes = {seq}};
+    struct timesync_follow_up_frame frame = {.seq = seq, .sync_us = sync_us};
+    struct can_msg follow_up = {.id = CAN_ID_TIME_FOLLOW_UP, .dlc = sizeof(frame)};
+    memcpy(follow_up.bytes, &frame, sizeof(frame));
+    
+    timesync_handle(&sync, stamp);
+    return timesync_handle(&follow_up, stamp + 100);
+}
+
+/** ***************************************************************************
+ * @brief Test that the first sample sets the clock
+*******************************************************************************/
+static void test_timesync_lock(void) {
+    timesync_reset();
+    bool unlocked = !timesync_locked() && (timesync_to_remote_us(1000) == 0);
+    
+    int ret = feed_sync(1, 1000, 50000);
+    
+    // 384 ticks are 625 us
+    bool passed = unlocked && (ret == 0) && timesync_locked() &&
+                  (timesync_to_remote_us(1000) == 50000 + TIMESYNC_RX_DELAY_US) &&
+                  (timesync_to_remote_us(1000 + 384) == 50625 + TIMESYNC_RX_DELAY_US) &&
+                  (timesync_to_remote_us(1000 - 384) == 49375 + TIMESYNC_RX_DELAY_US);
+    
+    print_test_result("Timesync Lock", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test that follow-ups are matched to their SYNC frame
+*******************************************************************************/
+static void test_timesync_unmatched(void) {
+    timesync_reset();
+    
+    struct can_msg sync = {.id = CAN_ID_TIME_SYNC, .dlc = 1, .bytes = {7}};
+    struct timesync_follow_up_frame frame = {.seq = 8, .sync_us = 1000};
+    struct can_msg follow_up = {.id = CAN_ID_TIME_FOLLOW_UP, .dlc = sizeof(frame)};
+    memcpy(follow_up.bytes, &frame, sizeof(frame));
+    struct can_msg other = {.id = CAN_ID_GAME_OVER, .dlc = 1};
+    
+    timesync_handle(&sync, 1000);
+    int ret = timesync_handle(&follow_up, 1100);
+    int ret_other = timesync_handle(&other, 1200);
+    
+    struct timesync_stats stats;
+    timesync_get_stats(&stats);
+    
+    bool passed = (ret == -ENXIO) && (ret_other == -EINVAL) && !timesync_locked() &&
+                  (stats.unmatched == 1) && (stats.samples == 0);
+    
+    print_test_result("Timesync Unmatched", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test the drift estimate against a node 2 clock running 100 ppm fast
+*******************************************************************************/
+static void test_timesync_drift(void) {
+    timesync_reset();
+    
+    uint32_t stamp = 1000;
+    uint32_t remote_us = REMOTE_START_US;
+    for (uint16_t i = 0; i < DRIFT_SAMPLES; i++) {
+        feed_sync(i, stamp, remote_us);
+        stamp += SYNC_TICKS;
+        remote_us += SYNC_US + SYNC_US * DRIFT_PPM / 1000000UL;
+    }
+    
+    // Predict the next SYNC before it arrives
+    int32_t error_us = (int32_t)(timesync_to_remote_us(stamp) - (remote_us + TIMESYNC_RX_DELAY_US));
+    
+    struct timesync_stats stats;
+    timesync_get_stats(&stats);
+    int32_t drift_error = stats.drift_ppm16 - DRIFT_PPM * TIMESYNC_PPM_SCALE;
+    
+    bool passed = (stats.samples == DRIFT_SAMPLES) && (stats.outliers == 0) &&
+                  (drift_error > -TIMESYNC_PPM_SCALE) && (drift_error < TIMESYNC_PPM_SCALE) &&
+                  (error_us > -5) && (error_us < 5);
+    
+    printf("  drift %ld/16 ppm, prediction error %ld us\r\n", stats.drift_ppm16, error_us);
+    print_test_result("Timesync Drift", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test that outliers are ignored, and that many in a row drop the lock
+*******************************************************************************/
+static void test_timesync_outliers(void) {
+    timesync_reset();
+    
+    feed_sync(0, 1000, 0);
+    feed_sync(1, 1000 + SYNC_TICKS, SYNC_US + 2 * TIMESYNC_OUTLIER_US);
+    bool single_ignored = timesync_locked() &&
+                          (timesync_to_remote_us(1000) == TIMESYNC_RX_DELAY_US);
+    
+    for (uint8_t i = 2; i < 1 + TIMESYNC_MAX_OUTLIERS; i++) {
+        feed_sync(i, 1000 + i * SYNC_TICKS, i * SYNC_US + 2 * TIMESYNC_OUTLIER_US);
+    }
+    
+    struct timesync_stats stats;
+    timesync_get_stats(&stats);
+    
+    bool passed = single_ignored && !timesync_locked() &&
+                  (stats.outliers == TIMESYNC_MAX_OUTLIERS) && (stats.samples == 1);
+    
+    print_test_result("Timesync Outliers", passed);
+}
+
+/** ***************************************************************************
+ * @brief Run all time synchronisation tests
+*******************************************************************************/
+void run_timesync_tests(void) {
+    printf("\r\n");
+    printf("========================================\r\n");
+    printf("    Time Synchronisation Test Suite    \r\n");
+    printf("========================================\r\n\r\n");
+    
+    tests_passed = 0;
+    tests_failed = 0;
+    
+    test_timesync_lock();
+    test_timesync_unmatched();
+    test_timesync_drift();
+    test_timesync_outliers();
+    timesync_reset();
+    
+    printf("\r\n");
+    printf("========================================\r\n");
+    printf("Results: %d passed, %d failed\r\n", tests_passed, tests_failed);
+    printf("========================================\r\n\r\n");
+}
@@ -16,13 +16,14 @@
 
 #define F_CPU 4915200
 #include <util/delay.h>
+#include <avr/interrupt.h>
 #include <avr/io.h>
 
 #include "../inc/uart.h"
 
 #define TEST_PASSED "PASSED"
 #define TEST_FAILED "FAILED"
-#define UBRR_TEST_VALUE 25  // For 9600 baud at 4.9152 MHz
+#define UBRR_TEST_VALUE UART_UBRR(38400)  // Same rate as the test menu
 
 static uint8_t tests_passed = 0;
 static uint8_t tests_failed = 0;
@@ -221,6 +222,50 @@ static void test_uart_different_bauds(void) {
     print_test_result("UART Different Bauds", passed);
 }
 
+/** ***************************************************************************
+ * @brief Test that a full transmit ring drops bytes instead of waiting
+*******************************************************************************/
+static void test_uart_transmit_drop(void) {
+    uart_flush();
+    uint16_t dropped_before = uart_tx_dropped();
+
+    uart_tx_policy(UART_TX_DROP);
+    for (uint16_t i = 0; i < 2 * UART_TX_BUFFER_SIZE; i++) {
+        uart_transmit('-');
+    }
+    uint16_t dropped = uart_tx_dropped() - dropped_before;
+    uart_tx_policy(UART_TX_BLOCK);
+    uart_flush();
+    printf("\r\n");
+
+    // The ring takes some, the transmitter may send a few while we fill it
+    bool passed = dropped > 0 && dropped < 2 * UART_TX_BUFFER_SIZE;
+
+    printf("  Dropped: %u of %u\r\n", dropped, 2 * UART_TX_BUFFER_SIZE);
+    print_test_result("UART Transmit Drop", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test that blocking output with interrupts disabled falls back to polling
+*******************************************************************************/
+static void test_uart_transmit_polled(void) {
+    uint16_t dropped_before = uart_tx_dropped();
+    uint8_t sreg = SREG;
+
+    cli();
+    for (uint16_t i = 0; i < 2 * UART_TX_BUFFER_SIZE; i++) {
+        uart_transmit('+');
+    }
+    uart_flush();
+    SREG = sreg;
+    printf("\r\n");
+
+    // If we got here without hanging, nothing was lost
+    bool passed = uart_tx_dropped() == dropped_before;
+
+    print_test_result("UART Transmit Polled", passed);
+}
+
 /** ***************************************************************************
  * @brief Run all UART tests
 *******************************************************************************/
@@ -243,6 +288,8 @@ void run_uart_tests(void) {
     test_uart_transmit_speed();
     test_uart_transmit_binary();
     test_uart_different_bauds();
+    test_uart_transmit_drop();
+    test_uart_transmit_polled();
     
     printf("\r\n");
     printf("========================================\r\n");
@@ -14,4 +14,8 @@
 
 int adc_init(void);
 
-int adc_read(uint16_t* result);
\ No newline at end of file
+int adc_read(uint16_t* result);
+
+// Result of the latest adc_read(), does not start a conversion or touch the ADC.
+// Safe to call from interrupts
+uint16_t adc_last(void);
\ No newline at end of file
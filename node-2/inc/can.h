@@ -23,9 +23,16 @@ enum can_msg_id {
     CAN_ID_GAME_START = 0x03,
     CAN_ID_GAME_OVER = 0x04,
     CAN_ID_NODE1_RDY = 0x05,
-    CAN_ID_NODE2_RDY = 0x06
+    CAN_ID_NODE2_RDY = 0x06,
+    CAN_ID_INPUT_STATE = 0x07,
+    CAN_ID_LATENCY_ECHO = 0x20,
+    CAN_ID_TIME_SYNC = 0x21,
+    CAN_ID_TIME_FOLLOW_UP = 0x22
 };
 
+#define CAN_STD_ID_MASK 0x7FF
+#define CAN_EXT_ID_MASK 0x1FFFFFFF
+
 // Struct with bit timing information
 // See `can_init` for usage example
 typedef struct CanInit CanInit;
@@ -44,12 +51,14 @@ __attribute__((packed)) struct CanInit {
 };
 
 
-// Initialize CAN bus, with bit timings and optional interrupt
-// If `rxInterrupt` is not 0, an interrupt will be triggered when a message is received.
-// (See can.c for an example interrupt handler)
+// Initialize CAN bus, with bit timings
+// Messages are sent as standard or extended frames as given by `CanMsg.extended`
+// Mailboxes 0-2 are fed from a software transmit queue. Mailbox 3 keeps the
+// newest input state frame, mailboxes 4-7 queue all other frames and are emptied
+// by `CAN0_Handler` into a software ring buffer, button frames first
 // Example:
-//    can_init((CanInit){.brp = F_CPU/2000000-1, .phase1 = 5, .phase2 = 1, .propag = 6}, 0);
-void can_init(CanInit init, uint8_t rxInterrupt);
+//    can_init((CanInit){.brp = F_CPU/2000000-1, .phase1 = 5, .phase2 = 1, .propag = 6});
+void can_init(CanInit init);
 
 
 // Strict-aliasing-safe reinterpret-cast
@@ -83,6 +92,7 @@ struct Byte8 {
 //    
 //    CanMsg m = (CanMsg){
 //        .id = 1,
+//        .extended = 0,
 //        .length = sizeof(YourStruct),
 //        .byte8 = union_cast(Byte8, ((YourStruct){
 //            .a = 10,
@@ -94,24 +104,66 @@ struct Byte8 {
 //    // Should print: CanMsg(id:1, length:7, data:{10, 0, 20, 0, 0, 240, 193})
 typedef struct CanMsg CanMsg;
 struct CanMsg {
-    uint8_t id;
+    uint32_t id;        // 11-bit standard or 29-bit extended identifier
+    uint8_t extended;   // 1 if `id` is a 29-bit identifier
     uint8_t length;
     union {
         uint8_t     byte[8];
         uint32_t    dword[2];
         Byte8       byte8;
     };    
+    uint64_t rxTime;    // `time_now()` at the start of the frame, set on receive
+};
+
+// Queue a CAN message for sending on the bus.
+// Does not block. Returns 0 on success, -EAGAIN if the transmit queue is full
+// (typically because the bus is disconnected or the other node is not acking)
+int can_tx(CanMsg m);
+
+// Queue a CAN message like `can_tx`, and record when it starts on the bus
+// Only the last stamped message is tracked, see `can_tx_time`
+int can_tx_stamped(CanMsg m);
+
+// Get the `time_now()` at the start of frame of the last message queued with
+// `can_tx_stamped`. Returns 1 once after it has been sent, 0 otherwise
+uint8_t can_tx_time(uint64_t* t);
+
+// Transmit statistics
+// `queueFull` counts frames rejected by `can_tx` because the queue was full
+typedef struct CanTxStats CanTxStats;
+struct CanTxStats {
+    uint32_t queued;
+    uint32_t sent;
+    uint32_t queueFull;
 };
 
-// Send a CAN message on the bus. 
-// Blocks if the bus does not receive the message (typically because one of the 
-// receiving nodes has not cleared a buffer)
-void can_tx(CanMsg m);
+// Get a snapshot of the transmit statistics
+void can_tx_stats(CanTxStats* stats);
 
-// Receive a CAN message.
+// Receive a CAN message from the receive ring buffer.
+// Input state frames are not queued, see `can_rx_input_state`
 // Does not block. Returns 0 if there is no message, 1 otherwise
 uint8_t can_rx(CanMsg* m);
 
+// Take the newest input state frame, older ones are stale joystick positions
+// Does not block. Returns 1 if a frame arrived since the last call, 0 otherwise
+uint8_t can_rx_input_state(CanMsg* m);
+
+// Receive statistics
+// `ringOverruns` counts frames dropped because the ring buffer was full,
+// `mailboxOverruns` counts frames overwritten because all mailboxes were full
+// `inputOverwrites` counts input state frames replaced by a newer one before being read
+typedef struct CanRxStats CanRxStats;
+struct CanRxStats {
+    uint32_t received;
+    uint32_t ringOverruns;
+    uint32_t mailboxOverruns;
+    uint32_t inputOverwrites;
+};
+
+// Get a snapshot of the receive statistics
+void can_rx_stats(CanRxStats* stats);
+
 // Print a CAN message (using `printf`)
 void can_printmsg(CanMsg m);
 
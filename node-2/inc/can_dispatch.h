@@ -0,0 +1,60 @@
+/** ***************************************************************************
+ * @file can_dispatch.h
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Table driven dispatch of received CAN messages
+ * @version 0.1
+ * @date 2025-11-20
+ *
+ * @copyright Copyright (c) 2025 Byggarane
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "can.h"
+
+#define CAN_DISPATCH_MAX_HANDLERS 16
+
+/** ***************************************************************************
+ * @brief Handler for a received CAN message
+ *
+ * @param msg Received message
+ * @param ctx Context pointer given at registration
+ * @return int 0 on success, negative error code on failure
+ *******************************************************************************/
+typedef int (*can_handler_t)(CanMsg *msg, void *ctx);
+
+/** ***************************************************************************
+ * @brief Register a handler for all IDs matching @p id in the bits set in @p mask
+ *
+ * @param id Identifier to match
+ * @param mask Bits of the identifier that must match, all ones for a single ID
+ * @param extended true for 29-bit identifiers, false for 11-bit
+ * @param handler Function called for matching messages
+ * @param ctx Passed to @p handler
+ * @return int 0 on success, -EINVAL on invalid arguments, -ENOMEM if all
+ *         handler slots are used
+ * @details Standard IDs are resolved through a table indexed by the ID, so
+ *          dispatch cost does not depend on the number of handlers.
+ *          Registration fills the table and takes time proportional to the
+ *          11-bit ID space, so do it at startup. Extended IDs are matched by
+ *          scanning the registered handlers. A later registration overrides
+ *          earlier ones for the IDs they share.
+ *******************************************************************************/
+int can_dispatch_register(uint32_t id, uint32_t mask, bool extended, can_handler_t handler, void *ctx);
+
+/** ***************************************************************************
+ * @brief Call the handler registered for a message
+ *
+ * @param msg Received message
+ * @return int Return value of the handler, -ENOENT if no handler matches
+ *******************************************************************************/
+int can_dispatch(CanMsg *msg);
+
+/** ***************************************************************************
+ * @brief Remove all registered handlers
+ *******************************************************************************/
+void can_dispatch_reset(void);
@@ -0,0 +1,59 @@
+/** ***************************************************************************
+ * @file frame.h
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief COBS framing with CRC for binary data on the UART
+ * @version 0.1
+ * @date 2025-11-30
+ *
+ * @copyright Copyright (c) 2025 Byggarane
+ *
+ * @details A frame on the wire is a zero byte, the COBS encoded payload with
+ *          its CRC-16/CCITT-FALSE appended little endian, and another zero
+ *          byte. COBS removes all zeros from the data, so a receiver finds
+ *          frame boundaries by the zeros alone, even mixed with printf() text.
+ *          Shared with the host tools, keep it free of target headers.
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#define FRAME_DELIMITER 0x00
+#define FRAME_CRC_SIZE 2
+
+/** ***************************************************************************
+ * @brief Bytes on the wire for a payload of @p len bytes, at most
+ *******************************************************************************/
+#define FRAME_MAX_ENCODED(len) ((len) + FRAME_CRC_SIZE + ((len) + FRAME_CRC_SIZE) / 254 + 1 + 2)
+
+/** ***************************************************************************
+ * @brief CRC-16/CCITT-FALSE, polynomial 0x1021, initial value 0xFFFF
+ *
+ * @param[in] data Data to check
+ * @param[in] len Number of bytes
+ * @return uint16_t CRC
+ *******************************************************************************/
+uint16_t frame_crc16(const uint8_t *data, uint16_t len);
+
+/** ***************************************************************************
+ * @brief Encode a payload as a delimited frame
+ *
+ * @param[in] payload Data to send
+ * @param[in] len Payload length, at most 253 bytes
+ * @param[out] out FRAME_MAX_ENCODED(len) bytes
+ * @return uint16_t Number of bytes written to @p out, delimiters included
+ *******************************************************************************/
+uint16_t frame_encode(const void *payload, uint16_t len, uint8_t *out);
+
+/** ***************************************************************************
+ * @brief Decode the bytes between two delimiters
+ *
+ * @param[in] in Encoded bytes, without delimiters
+ * @param[in] len Number of encoded bytes
+ * @param[out] payload Decoded payload
+ * @param[in] size Size of @p payload
+ * @return int Payload length, -EINVAL if the COBS encoding is broken,
+ *         -EMSGSIZE if it does not fit, -EBADMSG on a CRC mismatch
+ *******************************************************************************/
+int frame_decode(const uint8_t *in, uint16_t len, void *payload, uint16_t size);
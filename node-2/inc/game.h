@@ -11,12 +11,19 @@
 
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "can.h"
 
 #define IR_ADC_THRESHOLD 500
 
+// Node 1 timestamp unit, 64 Timer3 ticks at 614.4 kHz = 625/6 us
+#define INPUT_STATE_TIMESTAMP_US_NUM 625
+#define INPUT_STATE_TIMESTAMP_US_DEN 6
+#define INPUT_STATE_MAX_REORDER 4      /**< Older frames are taken as a sequence restart */
+#define INPUT_STATE_RESYNC_REJECTS 8   /**< Rejected frames in a row before a sequence restart is assumed */
+
 enum game_state {
     GAME_WAIT_START,
     GAME_RUNNING,
@@ -32,6 +39,50 @@ struct xy_coords
     uint8_t y;
 };
 
+/** ***************************************************************************
+ * @brief Bit positions in input_state_frame.buttons
+ *******************************************************************************/
+enum input_state_btn {
+    INPUT_STATE_BTN_JOYSTICK = 0, /**< Joystick button */
+    INPUT_STATE_BTN_RIGHT = 1,    /**< R1-R6 in bits 1-6 */
+    INPUT_STATE_BTN_LEFT = 7,     /**< L1-L6 in bits 7-12 */
+    INPUT_STATE_BTN_PROBE = 15    /**< Not a button, node 1 asks for a latency echo */
+};
+
+/** ***************************************************************************
+ * @brief Payload of the CAN_ID_INPUT_STATE frame from node 1
+ *
+ * @note Must match the definition on node 1. x and y are at the same offsets
+ *       as in the CAN_ID_JOYSTICK frame
+ *******************************************************************************/
+struct __attribute__((packed)) input_state_frame
+{
+    uint8_t x;          /**< Joystick x in percent */
+    uint8_t y;          /**< Joystick y in percent */
+    uint16_t buttons;   /**< See enum input_state_btn */
+    uint8_t slider;     /**< Touch slider position */
+    uint8_t seq;        /**< Sequence number, increments by one per frame */
+    uint16_t timestamp; /**< Send time in INPUT_STATE_TIMESTAMP_US_NUM / _DEN us units */
+};
+
+/** ***************************************************************************
+ * @brief Loss, reordering and jitter of the input state frames
+ *******************************************************************************/
+struct input_state_stats
+{
+    uint32_t received;      /**< Frames accepted */
+    uint32_t lost;          /**< Gaps in the sequence numbers */
+    uint32_t reordered;     /**< Frames older than one already accepted, dropped */
+    uint32_t resyncs;       /**< Sequence restarts, e.g. after node 1 was reset */
+    uint32_t max_jitter_us; /**< Largest difference between arrival and send interval */
+    uint32_t total_jitter_us; /**< Sum of the jitter of all accepted frames but the first after a resync */
+    uint32_t jitter_samples; /**< Number of frames in total_jitter_us */
+    uint8_t rejects_in_row; /**< Frames rejected as reordered since the last accepted one */
+    uint8_t last_seq;
+    uint16_t last_timestamp;
+    uint64_t last_arrival;
+};
+
 /** ***************************************************************************
  * @brief Set the servo angle from joystick percentage in CAN message
  *
@@ -47,6 +98,27 @@ int set_servo_from_js_can(CanMsg *msg);
  *******************************************************************************/
 int set_solenoid_from_can(CanMsg *msg);
 
+/** ***************************************************************************
+ * @brief Set the solenoid state
+ * @param state true to push the solenoid out
+ * @return int 0 on success, negative error code on failure
+ *******************************************************************************/
+int set_solenoid(bool state);
+
+/** ***************************************************************************
+ * @brief Decode an input state frame and track its sequence and timing
+ *
+ * @param msg CAN message with a CAN_ID_INPUT_STATE frame
+ * @param[out] frame Decoded frame
+ * @param stats Statistics to update, zero before the first frame
+ * @return int 0 on success, -EINVAL if the frame is too short, -EAGAIN if it
+ *         is older than the last accepted frame and should be ignored
+ * @note A frame more than INPUT_STATE_MAX_REORDER behind, or the
+ *       INPUT_STATE_RESYNC_REJECTS-th rejected frame in a row, is accepted as a
+ *       restart of the sequence, so a reset of node 1 only costs a few frames
+ *******************************************************************************/
+int input_state_from_can(CanMsg *msg, struct input_state_frame *frame, struct input_state_stats *stats);
+
 /** ***************************************************************************
  * @brief Set motor direction and speed from joystick value in CAN message
  *
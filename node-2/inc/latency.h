@@ -0,0 +1,50 @@
+/** ***************************************************************************
+ * @file latency.h
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Node 2 side of the input to actuation latency measurement
+ * @version 0.1
+ * @date 2025-11-24
+ *
+ * @copyright Copyright (c) 2025 Byggarane
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "can.h"
+
+#define LATENCY_CLOCK_MASK 0xFFFFFF /**< Receive times are sent as 24-bit microseconds */
+
+/** ***************************************************************************
+ * @brief Payload of the CAN_ID_LATENCY_ECHO frame
+ *
+ * @note Must match the definition on node 1
+ *******************************************************************************/
+struct __attribute__((packed)) latency_echo_frame
+{
+    uint8_t seq;            /**< Sequence number of the probed input state frame */
+    uint8_t rx_us[3];       /**< time_now() at start of the probe frame, little endian */
+    uint16_t actuation_us;  /**< From receive until the control loop applied the setpoint */
+    uint16_t turnaround_us; /**< From receive until the echo was queued */
+};
+
+/** ***************************************************************************
+ * @brief Note a probe from node 1, answered by latency_probe_actuated()
+ *
+ * @param msg Received probe frame, its receive time is used
+ * @param seq Sequence number of the probe
+ * @note Call after the setpoint from the probe frame has been set
+ *******************************************************************************/
+void latency_probe_received(const CanMsg *msg, uint8_t seq);
+
+/** ***************************************************************************
+ * @brief Echo the pending probe once its setpoint has been applied
+ *
+ * @return int 0 if nothing is pending or the echo was queued, negative error
+ *         code from can_tx() on failure
+ * @note Call from the main loop, the probe counts as actuated once the
+ *       motor control loop has run after latency_probe_received()
+ *******************************************************************************/
+int latency_probe_actuated(void);
@@ -17,6 +17,32 @@
 #define MOTOR_DIR_THRESHOLD_LOW 45
 #define MOTOR_DIR_THRESHOLD_HIGH 55
 
+#define MOTOR_POS_SCALE 1000  /**< Controller position unit, permille of the calibrated range */
+#define MOTOR_DUTY_SCALE 1000 /**< Controller output unit, permille duty cycle */
+
+#define MOTOR_CTRL_MAX_RATE_HZ 10000 /**< Upper limit for the control loop rate */
+#define MOTOR_CTRL_IRQ_PRIORITY 0    /**< Same as CAN and UART, above SysTick */
+
+/** ***************************************************************************
+ * @brief Timing of the control loop interrupt
+ *******************************************************************************/
+struct motor_ctrl_stats
+{
+    uint32_t ticks;           /**< Control loop iterations since start */
+    uint32_t overruns;        /**< Iterations that took longer than the period */
+    uint32_t max_exec_cycles; /**< Longest iteration in CPU cycles */
+    uint32_t period_cycles;   /**< Loop period in CPU cycles */
+};
+
+/** ***************************************************************************
+ * @brief Mean CPU cycles per controller step, see motor_ctrl_benchmark()
+ *******************************************************************************/
+struct motor_ctrl_benchmark
+{
+    uint32_t fixed_cycles; /**< Fixed-point PID and duty register value */
+    uint32_t float_cycles; /**< Former float P controller and duty conversion */
+};
+
 /** ***************************************************************************
  * @brief Initialize motor encoder
  *
@@ -47,15 +73,59 @@ int motor_init(uint8_t period_us);
 void set_motor_dir(bool dir);
 
 /** ***************************************************************************
- * @brief Set the motor position
+ * @brief Start the position control loop
  *
- * @param joystick_value Joystick value controlling motor position, as a percentage (0-100)
+ * @param[in] rate_hz Loop rate in Hz, 1 to MOTOR_CTRL_MAX_RATE_HZ
+ * @return int 0 on success, -EINVAL if the rate is out of range
+ * @details Runs from the TC0 channel 0 compare interrupt. Each iteration reads
+ *          the encoder, runs the fixed-point PID and writes the PWM duty cycle
+ *          and direction, so the sample time does not depend on the main loop.
+ *          The PID state is reset on every start
+ ******************************************************************************/
+int motor_ctrl_start(uint16_t rate_hz);
+
+/** ***************************************************************************
+ * @brief Stop the position control loop and the motor
  ******************************************************************************/
-void set_motor_pos(int joystick_value);
+void motor_ctrl_stop(void);
+
+/** ***************************************************************************
+ * @brief Set the position the control loop drives the motor to
+ *
+ * @param position Target position as a percentage (0-100) of the calibrated range
+ * @note Safe to call from the main loop and from other interrupts, it takes
+ *       effect at the next control loop iteration
+ ******************************************************************************/
+void motor_ctrl_set_setpoint(uint8_t position);
+
+/** ***************************************************************************
+ * @brief Get the most recent control loop iteration
+ *
+ * @param[out] time time_now() at the start of the iteration, may be NULL
+ * @return uint32_t Number of iterations since start, changes once a new
+ *         setpoint has been applied
+ ******************************************************************************/
+uint32_t motor_ctrl_last_tick(uint64_t *time);
+
+/** ***************************************************************************
+ * @brief Get timing statistics of the control loop
+ *
+ * @param[out] stats Statistics since the loop was last started
+ ******************************************************************************/
+void motor_ctrl_get_stats(struct motor_ctrl_stats *stats);
 
 /** ***************************************************************************
  * @brief Get the encoder value
  *
  * @return int Encoder value
  ******************************************************************************/
-int get_encoder_value(void);
\ No newline at end of file
+int get_encoder_value(void);
+
+/** ***************************************************************************
+ * @brief Compare the cost of the fixed-point controller with the float one
+ *
+ * @param[out] result Mean cycles per step of each path
+ * @details Runs both without touching the motor outputs. The Cortex-M3 has no
+ *          FPU, so the float path goes through the soft-float library
+ ******************************************************************************/
+void motor_ctrl_benchmark(struct motor_ctrl_benchmark *result);
\ No newline at end of file
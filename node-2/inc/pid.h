@@ -0,0 +1,87 @@
+/** ***************************************************************************
+ * @file pid.h
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Fixed-point PID controller
+ * @version 0.1
+ * @date 2025-11-27
+ *
+ * @copyright Copyright (c) 2025 Byggarane
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PID_Q 16        /**< Fractional bits of the gains */
+#define PID_I_EXTRA_Q 8 /**< Extra fractional bits of the integral term */
+
+/** ***************************************************************************
+ * @brief Convert a constant gain to Q16
+ *
+ * @note Only use with constant expressions, so no float code ends up on target
+ *******************************************************************************/
+#define PID_GAIN(x) ((int32_t)((x) * (1L << PID_Q) + 0.5))
+
+/** ***************************************************************************
+ * @brief Gains and limits of a PID controller
+ *
+ * @details Gains are in continuous time, they are scaled by the sample rate in
+ *          pid_init(). Setpoint, measurement and output share the integer units
+ *          the gains are tuned for
+ *******************************************************************************/
+struct pid_config
+{
+    int32_t kp;       /**< Proportional gain, Q16 */
+    int32_t ki;       /**< Integral gain per second, Q16 */
+    int32_t kd;       /**< Derivative gain in seconds, Q16 */
+    uint16_t rate_hz; /**< Rate pid_step() is called at */
+    int32_t out_min;  /**< Lowest output */
+    int32_t out_max;  /**< Highest output */
+};
+
+/** ***************************************************************************
+ * @brief State of a PID controller, set up by pid_init()
+ *******************************************************************************/
+struct pid
+{
+    int32_t kp;               /**< Q16 */
+    int32_t ki;               /**< Per sample, Q(PID_Q + PID_I_EXTRA_Q) */
+    int32_t kd;               /**< Per sample, Q16 */
+    int32_t out_min;
+    int32_t out_max;
+    int64_t integral;         /**< Q(PID_Q + PID_I_EXTRA_Q) */
+    int32_t prev_measurement;
+    bool primed;              /**< prev_measurement is valid */
+};
+
+/** ***************************************************************************
+ * @brief Set up a PID controller
+ *
+ * @param[out] pid Controller to set up
+ * @param[in] config Gains and limits
+ * @return int 0 on success, -EINVAL on negative gains, a zero rate, an
+ *         empty output range or gains that overflow once scaled by the rate
+ *******************************************************************************/
+int pid_init(struct pid *pid, const struct pid_config *config);
+
+/** ***************************************************************************
+ * @brief Clear the integral and derivative history
+ *
+ * @param[in,out] pid Controller to reset
+ *******************************************************************************/
+void pid_reset(struct pid *pid);
+
+/** ***************************************************************************
+ * @brief Run one controller step
+ *
+ * @param[in,out] pid Controller
+ * @param[in] setpoint Wanted value
+ * @param[in] measurement Current value
+ * @return int32_t Output, saturated to the configured range
+ * @details The derivative acts on the measurement, so setpoint steps do not
+ *          kick the output. The integral is clamped to the output range and
+ *          held while the output is saturated in the direction of the error
+ *******************************************************************************/
+int32_t pid_step(struct pid *pid, int32_t setpoint, int32_t measurement);
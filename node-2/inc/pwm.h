@@ -18,6 +18,7 @@
 #define PWM_CLOCK_FREQ 84000000UL // 84 MHz main clock
 #define SERVO_MIN_PW_MS 0.9f
 #define SERVO_MAX_PW_MS 2.1f
+#define PWM_PERMILLE_MAX 1000 // Full duty cycle for pwm_set_duty_permille()
 
 /** ***************************************************************************
  * @brief Initialize PWM
@@ -53,4 +54,15 @@ int pwm_set_pulse_width_ms(float pulse_width_ms, uint8_t ch_num);
  * @return int 0 on success, negative errno on failure
  * @note Uses fixed channel number CH_NUM
  *******************************************************************************/
-int pwm_set_duty_cycle(float duty_cycle_percentage, uint8_t ch_num);
\ No newline at end of file
+int pwm_set_duty_cycle(float duty_cycle_percentage, uint8_t ch_num);
+
+/** ***************************************************************************
+ * @brief Set PWM duty cycle without floating point
+ *
+ * @param[in] duty_permille Duty cycle in permille (0 to PWM_PERMILLE_MAX)
+ * @param[in] ch_num PWM channel number
+ * @return int 0 on success, -EINVAL if the channel is not initialized or the
+ *         duty cycle is out of range
+ * @note Does not print, safe to call from interrupts
+ *******************************************************************************/
+int pwm_set_duty_permille(uint16_t duty_permille, uint8_t ch_num);
\ No newline at end of file
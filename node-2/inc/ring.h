@@ -0,0 +1,143 @@
+/** ***************************************************************************
+ * @file ring.h
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Lock-free single-producer single-consumer ring buffer
+ * @version 0.1
+ * @date 2025-11-29
+ *
+ * @copyright Copyright (c) 2025 Byggarane
+ *
+ * @details Hands elements from one context to another, typically from an
+ *          interrupt to the main loop or back, without disabling interrupts.
+ *          Only the producer moves the head and only the consumer moves the
+ *          tail. Both are free-running counters, masked to index the buffer,
+ *          so all slots are usable. A release store publishes an index only
+ *          after the slot it covers is written or read, so no other barriers
+ *          are needed.
+ *
+ *          Several producers (or consumers) must be serialized by the caller,
+ *          e.g. with interrupts disabled. Kept free of target headers so the
+ *          host tests can build it.
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** ***************************************************************************
+ * @brief Ring state, set up by ring_init() or RING_INIT
+ *******************************************************************************/
+struct ring
+{
+    uint8_t *buf;           /**< size * elem_size bytes */
+    uint32_t elem_size;     /**< Bytes per element */
+    uint32_t mask;          /**< size - 1, size is a power of two */
+    volatile uint32_t head; /**< Elements pushed, written by the producer only */
+    volatile uint32_t tail; /**< Elements popped, written by the consumer only */
+};
+
+/** ***************************************************************************
+ * @brief Static initializer for a ring over an array
+ *
+ * @param array Element array, its length must be a power of two
+ *******************************************************************************/
+#define RING_INIT(array)                                                         \
+    {                                                                            \
+        .buf = (uint8_t *)(array),                                               \
+        .elem_size = sizeof((array)[0]),                                         \
+        .mask = sizeof(array) / sizeof((array)[0]) - 1,                         \
+    }
+
+/** ***************************************************************************
+ * @brief Set up a ring over a buffer
+ *
+ * @param[out] ring Ring to set up
+ * @param[in] buf Storage for @p size elements
+ * @param[in] elem_size Bytes per element
+ * @param[in] size Number of elements, a power of two
+ * @return int 0 on success, -EINVAL if @p size is not a power of two or an
+ *         argument is zero
+ *******************************************************************************/
+int ring_init(struct ring *ring, void *buf, uint32_t elem_size, uint32_t size);
+
+/** ***************************************************************************
+ * @brief Empty the ring
+ *
+ * @note Only while neither side is using it
+ *******************************************************************************/
+void ring_reset(struct ring *ring);
+
+/** ***************************************************************************
+ * @brief Number of elements waiting, exact for the consumer
+ *******************************************************************************/
+uint32_t ring_count(const struct ring *ring);
+
+/** ***************************************************************************
+ * @brief Number of free slots, exact for the producer
+ *******************************************************************************/
+uint32_t ring_free(const struct ring *ring);
+
+/** ***************************************************************************
+ * @brief Copy one element in
+ *
+ * @return bool true if pushed, false if the ring is full
+ *******************************************************************************/
+bool ring_push(struct ring *ring, const void *elem);
+
+/** ***************************************************************************
+ * @brief Copy one element out
+ *
+ * @return bool true if popped, false if the ring is empty
+ *******************************************************************************/
+bool ring_pop(struct ring *ring, void *elem);
+
+/** ***************************************************************************
+ * @brief Copy up to @p count elements in, publishing them together
+ *
+ * @return uint32_t Number of elements pushed
+ *******************************************************************************/
+uint32_t ring_push_bulk(struct ring *ring, const void *elems, uint32_t count);
+
+/** ***************************************************************************
+ * @brief Copy up to @p count elements out
+ *
+ * @return uint32_t Number of elements popped
+ *******************************************************************************/
+uint32_t ring_pop_bulk(struct ring *ring, void *elems, uint32_t count);
+
+/** ***************************************************************************
+ * @brief Get the next free slot to fill in place, producer side
+ *
+ * @return void* Slot, or NULL if the ring is full. Publish it with
+ *         ring_write_commit()
+ *******************************************************************************/
+void *ring_write_slot(struct ring *ring);
+
+/** ***************************************************************************
+ * @brief Publish @p count slots filled in place
+ *******************************************************************************/
+void ring_write_commit(struct ring *ring, uint32_t count);
+
+/** ***************************************************************************
+ * @brief Get the oldest element without removing it, consumer side
+ *
+ * @return void* Element, or NULL if the ring is empty. Release it with
+ *         ring_read_commit()
+ *******************************************************************************/
+void *ring_read_slot(struct ring *ring);
+
+/** ***************************************************************************
+ * @brief Get the waiting elements that are contiguous in memory
+ *
+ * @param[out] elems Oldest element
+ * @return uint32_t Number of elements from @p elems up to the end of the
+ *         buffer or the head, for handing to DMA
+ *******************************************************************************/
+uint32_t ring_read_contiguous(struct ring *ring, void **elems);
+
+/** ***************************************************************************
+ * @brief Release @p count elements read in place
+ *******************************************************************************/
+void ring_read_commit(struct ring *ring, uint32_t count);
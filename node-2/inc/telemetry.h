@@ -0,0 +1,96 @@
+/** ***************************************************************************
+ * @file telemetry.h
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Binary telemetry stream from the motor control loop
+ * @version 0.1
+ * @date 2025-11-30
+ *
+ * @copyright Copyright (c) 2025 Byggarane
+ *
+ * @details The control loop hands a sample to telemetry_sample() every
+ *          iteration. At the configured rate it is queued in a ring, and
+ *          telemetry_drain() sends it from the main loop as a COBS frame with
+ *          CRC, see frame.h. tools/telemetry_decode.c turns the stream into
+ *          CSV. Shared with the host tool, keep it free of target headers.
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#define TELEMETRY_RING_SIZE 32       /**< Samples, must be a power of two */
+#define TELEMETRY_DRAIN_FRAMES 4     /**< Most frames queued per telemetry_drain() call */
+#define TELEMETRY_CLOCK_HZ 84000000  /**< Unit of telemetry_sample.time */
+
+/** ***************************************************************************
+ * @brief First payload byte, tells the frame types apart
+ *******************************************************************************/
+enum telemetry_frame_type {
+    TELEMETRY_FRAME_SAMPLE = 1
+};
+
+/** ***************************************************************************
+ * @brief One control loop iteration, the payload of a TELEMETRY_FRAME_SAMPLE
+ *
+ * @note Positions and duty cycle are in the motor controller units, permille
+ *******************************************************************************/
+struct __attribute__((packed)) telemetry_sample
+{
+    uint8_t type;         /**< TELEMETRY_FRAME_SAMPLE */
+    uint8_t seq;          /**< Increments by one per sample sent, gaps are losses */
+    uint32_t time;        /**< Low 32 bits of time_now() at the start of the iteration */
+    int32_t encoder;      /**< Raw encoder count */
+    int16_t setpoint;     /**< Target position */
+    int16_t position;     /**< Measured position */
+    int16_t duty;         /**< Controller output, sign is direction */
+    uint16_t ir_adc;      /**< Last IR detector ADC conversion */
+    uint16_t exec_cycles; /**< Execution time of the previous iteration */
+};
+
+/** ***************************************************************************
+ * @brief Counters since telemetry_start()
+ *******************************************************************************/
+struct telemetry_stats
+{
+    uint32_t queued;  /**< Samples queued for sending */
+    uint32_t dropped; /**< Samples lost because the ring was full */
+};
+
+/** ***************************************************************************
+ * @brief Start sampling
+ *
+ * @param[in] rate_hz Samples per second
+ * @param[in] loop_rate_hz Rate telemetry_sample() is called at
+ * @return int 0 on success, -EINVAL if @p rate_hz is zero or above @p loop_rate_hz
+ * @note Every n-th call is kept, so the rate is rounded to a divisor of the
+ *       loop rate
+ *******************************************************************************/
+int telemetry_start(uint16_t rate_hz, uint16_t loop_rate_hz);
+
+/** ***************************************************************************
+ * @brief Stop sampling, queued samples are still sent
+ *******************************************************************************/
+void telemetry_stop(void);
+
+/** ***************************************************************************
+ * @brief Offer a sample, called by the control loop interrupt
+ *
+ * @param[in] sample Sample, type and seq are filled in here
+ *******************************************************************************/
+void telemetry_sample(const struct telemetry_sample *sample);
+
+/** ***************************************************************************
+ * @brief Send queued samples without waiting
+ *
+ * @details Queues whole frames in the UART transmit ring, as many as fit.
+ *          Call from the main loop
+ *******************************************************************************/
+void telemetry_drain(void);
+
+/** ***************************************************************************
+ * @brief Get the counters
+ *
+ * @param[out] stats Counters since telemetry_start()
+ *******************************************************************************/
+void telemetry_get_stats(struct telemetry_stats *stats);
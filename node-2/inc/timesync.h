@@ -0,0 +1,47 @@
+/** ***************************************************************************
+ * @file timesync.h
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Time synchronisation master, node 1 follows the node 2 clock
+ * @version 0.1
+ * @date 2025-11-26
+ *
+ * @copyright Copyright (c) 2025 Byggarane
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#define TIMESYNC_PERIOD_MS 500
+
+/** ***************************************************************************
+ * @brief Payload of the CAN_ID_TIME_FOLLOW_UP frame
+ *
+ * @note Must match the definition on node 1. The CAN_ID_TIME_SYNC frame only
+ *       carries the sequence number
+ *******************************************************************************/
+struct __attribute__((packed)) timesync_follow_up_frame
+{
+    uint8_t seq;        /**< Sequence number of the SYNC frame */
+    uint8_t reserved[3];
+    uint32_t sync_us;   /**< time_now() in microseconds at start of the SYNC frame */
+};
+
+/** ***************************************************************************
+ * @brief Send SYNC and follow-up frames when due
+ *
+ * @return int 0 on success, negative error code from can_tx() on failure
+ * @details Call from the main loop. A SYNC frame goes out every
+ *          TIMESYNC_PERIOD_MS. Its start of frame time is captured by the CAN
+ *          controller and sent in a follow-up frame once it is known, so the
+ *          transmit queue delay does not affect the synchronisation
+ *******************************************************************************/
+int timesync_service(void);
+
+/** ***************************************************************************
+ * @brief Get the shared time axis in microseconds
+ *
+ * @return uint32_t time_now() in microseconds, wraps after about 71 minutes
+ *******************************************************************************/
+uint32_t timesync_now_us(void);
@@ -0,0 +1,86 @@
+/** ***************************************************************************
+ * @file trace.h
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Deferred binary trace logging
+ * @version 0.1
+ * @date 2025-11-28
+ *
+ * @copyright Copyright (c) 2025 Byggarane
+ *
+ * @details trace() stores a fixed size record in a RAM ring and returns, so it
+ *          can be used in interrupts and hot paths where printf() is too slow.
+ *          trace_drain() queues the records on the UART in the background,
+ *          each prefixed with TRACE_SYNC_BYTE, mixed with normal printf() text.
+ *          tools/trace_decode.c turns them back into text on the host.
+ *          This header is shared with the host decoder, keep it free of target
+ *          headers.
+ *
+ *******************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#define TRACE_RING_SIZE 64     /**< Records, must be a power of two */
+#define TRACE_DRAIN_RECORDS 4  /**< Most records queued per trace_drain() call */
+#define TRACE_SYNC_BYTE 0xA5   /**< Starts a record on the wire, never sent as text */
+#define TRACE_CLOCK_HZ 84000000 /**< Unit of trace_record.time */
+
+/** ***************************************************************************
+ * @brief Trace events with the format the decoder prints them with
+ *
+ * @details The format gets the arguments a, b and c as long, in that order,
+ *          and may leave out trailing ones
+ *******************************************************************************/
+#define TRACE_EVENTS(X)                                                          \
+    X(TRACE_DROPPED, "trace: %ld records dropped")                               \
+    X(TRACE_MOTOR, "motor: setpoint %ld, position %ld, duty %ld")                \
+    X(TRACE_SERVO, "servo: y %ld")                                               \
+    X(TRACE_SOLENOID, "solenoid: %ld")                                           \
+    X(TRACE_CAN_UNKNOWN, "can: unknown message id %lX")
+
+#define TRACE_EVENT_ENUM(name, format) name,
+
+enum trace_event {
+    TRACE_EVENTS(TRACE_EVENT_ENUM)
+    TRACE_EVENT_COUNT
+};
+
+/** ***************************************************************************
+ * @brief A trace record as stored and sent, little endian
+ *******************************************************************************/
+struct __attribute__((packed)) trace_record
+{
+    uint32_t time; /**< Low 32 bits of time_now(), wraps after 51 s */
+    uint16_t id;   /**< enum trace_event */
+    int16_t c;
+    int32_t a;
+    int32_t b;
+};
+
+/** ***************************************************************************
+ * @brief Record an event
+ *
+ * @param id Event
+ * @param a First argument
+ * @param b Second argument
+ * @param c Third argument
+ * @note Safe to call from interrupts. Counts the record as dropped if the
+ *       ring is full
+ *******************************************************************************/
+void trace(enum trace_event id, int32_t a, int32_t b, int16_t c);
+
+/** ***************************************************************************
+ * @brief Send buffered records over the UART without waiting
+ *
+ * @details Queues up to TRACE_DRAIN_RECORDS whole records in the UART transmit
+ *          ring, as many as fit. Call from the main loop
+ *******************************************************************************/
+void trace_drain(void);
+
+/** ***************************************************************************
+ * @brief Get the number of records dropped because the ring was full
+ *
+ * @return uint32_t Dropped records since start
+ *******************************************************************************/
+uint32_t trace_dropped(void);
@@ -8,19 +8,46 @@
 // Internally, receiving is handled with interrupts and a ring buffer, so no characters
 // are lost, until the buffer is full. If necessary, you can change this buffer size in 
 // uart.c
+//
+// Sending is queued in a ring buffer that the peripheral DMA controller empties in the
+// background, so `printf` returns as soon as the text is queued. What happens when the
+// ring is full is chosen with `uart_tx_policy`
 
 
 // Initialize. Hooks stdio functions (like `printf`)
 void uart_init(uint32_t cpufreq, uint32_t baudrate);
 
+// What `uart_write` does when the transmit ring is full
+typedef enum UartTxPolicy UartTxPolicy;
+enum UartTxPolicy {
+    UART_TX_DROP,   // Drop what does not fit and count it (default)
+    UART_TX_BLOCK,  // Wait for room. Drops anyway in interrupts or with interrupts disabled
+};
+
 // Send a single character
 // Prefer using `printf` instead
 void uart_tx(uint8_t val);
 
+// Queue bytes for sending. Returns the number of bytes queued
+int uart_write(const uint8_t* buf, int len);
+
+// Free space in the transmit ring, in bytes
+// Lets a caller queue a record whole or not at all
+int uart_tx_free(void);
+
+// Choose what happens when the transmit ring is full
+void uart_tx_policy(UartTxPolicy policy);
+
+// Number of bytes dropped because the transmit ring was full
+uint32_t uart_tx_dropped(void);
+
 // Read a single character
 // Prefer using `uart_flush` and `sscanf` instead (see below)
 uint8_t uart_rx(uint8_t* val);
 
+// Number of received bytes dropped because the receive ring was full
+uint32_t uart_rx_dropped(void);
+
 // Flush the internal ring buffer into your own buffer
 // Example (`scanf` workaround):
 //    int result;
@@ -14,6 +14,9 @@
 #include <errno.h>
 #include <stdio.h>
 
+// Reading ADC_CDR clears EOC0, so interrupts get the result from here instead
+// of racing adc_read() for the data register
+static volatile uint16_t last_result = 0;
 
 int adc_init(void) {
     // Enable peripheral clock for ADC (ID = 37)
@@ -47,6 +50,11 @@ int adc_read(uint16_t* result) {
 
     // Read result
     *result = ADC->ADC_CDR[0];
+    last_result = *result;
 
     return 0;
+}
+
+uint16_t adc_last(void) {
+    return last_result;
 }
\ No newline at end of file
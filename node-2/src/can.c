@@ -12,14 +12,73 @@
 
 #include "sam.h"
 #include "can.h"
+#include "ring.h"
+#include "time.h"
+#include <errno.h>
 #include <stdio.h>
 
-#define txMailbox 0
-#define rxMailbox 1
+// Mailboxes 0..2 transmit. Frames are queued in software and loaded into a
+// free mailbox with a hardware priority derived from the ID, so a waiting
+// high priority frame goes out before lower priority ones already loaded.
+#define txFirstMailbox 0
+#define txLastMailbox 2
+#define txMailboxMask (((1u << (txLastMailbox + 1)) - 1) & ~((1u << txFirstMailbox) - 1))
+#define txLowestPriority 15
+
+// Software transmit queue, filled by `can_tx` and drained into the mailboxes
+// by `CAN0_Handler` when one becomes ready. Size must be a power of two.
+#define txQueueSize 16
+
+typedef struct TxEntry TxEntry;
+struct TxEntry {
+    CanMsg msg;
+    uint8_t stamped;
+};
+
+static TxEntry txEntries[txQueueSize];
+static struct ring txQueue = RING_INIT(txEntries);
+static uint32_t txBusyMailboxes = 0;
+static uint8_t txMailboxPriority[txLastMailbox + 1];
+static CanTxStats txStats = {0};
+
+// Send time of the last frame queued with `can_tx_stamped`
+static uint32_t txStampMailboxes = 0;
+static volatile uint64_t txStampTime;
+static volatile uint8_t txStampValid = 0;
+
+// Receive mailboxes are routed by ID. A frame is stored in the lowest numbered
+// free mailbox whose acceptance filter matches.
+//  3:   input state, overwrite mode, so only the newest sample is kept
+//  4-5: button, queued
+//  6-7: everything else (control frames, and buttons when 4-5 are full)
+// The queued mailboxes are read in ascending order, which is not strictly
+// arrival order, see CAN0_Handler(). The last one overwrites when full, which
+// sets MMI and lets us count frames lost in hardware.
+#define rxInputMailbox 3
+#define rxButtonFirstMailbox 4
+#define rxButtonLastMailbox 5
+#define rxFirstMailbox 4
+#define rxLastMailbox 7
+#define rxMailboxMask (((1u << (rxLastMailbox + 1)) - 1) & ~((1u << rxFirstMailbox) - 1))
+
+// Software receive ring, filled by `CAN0_Handler` and emptied by `can_rx`.
+// Size must be a power of two.
+#define rxRingSize 32
+
+static CanMsg rxMsgs[rxRingSize];
+static struct ring rxRing = RING_INIT(rxMsgs);
+static volatile CanRxStats rxStats = {0};
+
+// Length of a bit in CPU cycles, the unit of the CAN timer and mailbox timestamps
+static uint32_t bitCycles = 0;
+
+// Latest input state sample, written by `CAN0_Handler` and taken by `can_rx_input_state`
+static CanMsg rxInput;
+static volatile uint8_t rxInputFresh = 0;
 
 
 void can_printmsg(CanMsg m){
-    printf("CanMsg(id:%d, length:%d, data:{", m.id, m.length);
+    printf("CanMsg(id:%lX%s, length:%d, data:{", m.id, m.extended ? " ext" : "", m.length);
     if(m.length){
         printf("%d", m.byte[0]);
     }
@@ -30,7 +89,99 @@ void can_printmsg(CanMsg m){
 }
 
 
-void can_init(CanInit init, uint8_t rxInterrupt){
+// Lower IDs win arbitration on the bus, so give them the higher mailbox priority.
+// Extended IDs use their 11-bit base ID, all base IDs from 15 up share the lowest
+static uint8_t can_tx_priority(const CanMsg* m){
+    uint32_t base = m->extended ? (m->id >> 18) : m->id;
+    base &= CAN_STD_ID_MASK;
+    return base < txLowestPriority ? base : txLowestPriority;
+}
+
+// Load queued frames into free mailboxes. Must be called with the CAN0
+// interrupt disabled or from `CAN0_Handler`.
+// Mailboxes with equal priority are sent lowest number first, not in load
+// order, so a frame waits while another with its priority is still pending.
+static void can_tx_schedule(void){
+    TxEntry* entry;
+    while((entry = ring_read_slot(&txQueue))){
+        uint32_t free = txMailboxMask & ~txBusyMailboxes;
+        if(!free){
+            return;
+        }
+        
+        CanMsg* m = &entry->msg;
+        uint8_t priority = can_tx_priority(m);
+        for(uint8_t mb = txFirstMailbox; mb <= txLastMailbox; mb++){
+            if((txBusyMailboxes & (1u << mb)) && txMailboxPriority[mb] == priority){
+                return;
+            }
+        }
+        
+        uint8_t mb = __builtin_ctz(free);
+        txBusyMailboxes |= 1u << mb;
+        txMailboxPriority[mb] = priority;
+        if(entry->stamped){
+            txStampMailboxes |= 1u << mb;
+        }
+        
+        // Set message ID, MIDvA and MIDvB together hold the 29-bit extended ID
+        CAN0->CAN_MB[mb].CAN_MMR = CAN_MMR_MOT_MB_TX | CAN_MMR_PRIOR(priority);
+        if(m->extended){
+            CAN0->CAN_MB[mb].CAN_MID = (m->id & CAN_EXT_ID_MASK) | CAN_MID_MIDE;
+        } else {
+            CAN0->CAN_MB[mb].CAN_MID = CAN_MID_MIDvA(m->id);
+        }
+        
+        //  Put message in can data registers
+        CAN0->CAN_MB[mb].CAN_MDL = m->dword[0];
+        CAN0->CAN_MB[mb].CAN_MDH = m->dword[1];
+        
+        // Set message length and mailbox ready to send
+        CAN0->CAN_MB[mb].CAN_MCR = (m->length << CAN_MCR_MDLC_Pos) | CAN_MCR_MTCR;
+        
+        // Interrupt when the mailbox is ready again
+        CAN0->CAN_IER = 1u << mb;
+        ring_read_commit(&txQueue, 1);
+    }
+}
+
+
+// Configure a receive mailbox to accept standard frames whose ID matches `id`
+// in the bits set in `mask`. A zero mask accepts all frames, standard and extended
+static void can_rx_config(uint8_t mb, uint32_t id, uint32_t mask, uint32_t mode){
+    CAN0->CAN_MB[mb].CAN_MAM = mask ? (CAN_MAM_MIDvA(mask) | CAN_MAM_MIDE) : 0;
+    CAN0->CAN_MB[mb].CAN_MID = CAN_MID_MIDvA(id);
+    CAN0->CAN_MB[mb].CAN_MMR = mode;
+    CAN0->CAN_MB[mb].CAN_MCR |= CAN_MCR_MTCR;
+}
+
+// Converts a mailbox timestamp, the CAN timer at the start of frame, to
+// time_now() units. Called from CAN0_Handler, which preempts SysTick, so this
+// depends on time_now() accounting for a pending SysTick reload
+static uint64_t can_stamp_time(uint32_t mbStatus){
+    uint16_t bitsAgo = (uint16_t)(CAN0->CAN_TIM - (mbStatus & CAN_MSR_MTIMESTAMP_Msk));
+    return time_now() - (uint64_t)bitsAgo * bitCycles;
+}
+
+static void can_rx_read(uint8_t mb, uint32_t mbStatus, CanMsg* m){
+    // Start of frame, so the receive time does not include interrupt latency
+    m->rxTime = can_stamp_time(mbStatus);
+    
+    // MIDE holds the type of the received frame
+    uint32_t mid = CAN0->CAN_MB[mb].CAN_MID;
+    m->extended = (mid & CAN_MID_MIDE) ? 1 : 0;
+    if(m->extended){
+        m->id = mid & CAN_EXT_ID_MASK;
+    } else {
+        m->id = (mid & CAN_MID_MIDvA_Msk) >> CAN_MID_MIDvA_Pos;
+    }
+    m->length = (uint8_t)((mbStatus & CAN_MSR_MDLC_Msk) >> CAN_MSR_MDLC_Pos);
+    m->dword[0] = CAN0->CAN_MB[mb].CAN_MDL;
+    m->dword[1] = CAN0->CAN_MB[mb].CAN_MDH;
+}
+
+
+void can_init(CanInit init){
     // Disable CAN
     CAN0->CAN_MR &= ~CAN_MR_CANEN; 
     
@@ -58,65 +209,185 @@ void can_init(CanInit init, uint8_t rxInterrupt){
     CAN0->CAN_WPMR = 0x43414E00; // Disable write protection
     //Set baudrate, Phase1, phase2 and propagation delay for can bus. Must match on all nodes!
     CAN0->CAN_BR = init.reg; 
+    bitCycles = (init.brp + 1) * (init.propag + init.phase1 + init.phase2 + 4);
     
     
 
     // Configure mailboxes
     // transmit
-    CAN0->CAN_MB[txMailbox].CAN_MID = CAN_MID_MIDE;
-    CAN0->CAN_MB[txMailbox].CAN_MMR = CAN_MMR_MOT_MB_TX;
+    ring_reset(&txQueue);
+    txBusyMailboxes = 0;
+    txStampMailboxes = 0;
+    txStampValid = 0;
+    txStats = (CanTxStats){0};
+    for(uint8_t mb = txFirstMailbox; mb <= txLastMailbox; mb++){
+        CAN0->CAN_MB[mb].CAN_MID = CAN_MID_MIDE;
+        CAN0->CAN_MB[mb].CAN_MMR = CAN_MMR_MOT_MB_TX;
+    }
     
     // receive
-    CAN0->CAN_MB[rxMailbox].CAN_MAM = 0; // Accept all messages
-    CAN0->CAN_MB[rxMailbox].CAN_MID = CAN_MID_MIDE;
-    CAN0->CAN_MB[rxMailbox].CAN_MMR = CAN_MMR_MOT_MB_RX;
-    CAN0->CAN_MB[rxMailbox].CAN_MCR |= CAN_MCR_MTCR;
-    if(rxInterrupt){
-        // Enable interrupt on receive
-        CAN0->CAN_IER |= (1 << rxMailbox); 
-        // Enable interrupt in NVIC 
-        NVIC_EnableIRQ(ID_CAN0);
+    ring_reset(&rxRing);
+    rxStats = (CanRxStats){0};
+    rxInputFresh = 0;
+    can_rx_config(rxInputMailbox, CAN_ID_INPUT_STATE, CAN_STD_ID_MASK, CAN_MMR_MOT_MB_RX_OVERWRITE);
+    for(uint8_t mb = rxButtonFirstMailbox; mb <= rxButtonLastMailbox; mb++){
+        can_rx_config(mb, CAN_ID_JOYSTICK_BTN, CAN_STD_ID_MASK, CAN_MMR_MOT_MB_RX);
     }
+    for(uint8_t mb = rxButtonLastMailbox + 1; mb <= rxLastMailbox; mb++){
+        // Accept all messages
+        can_rx_config(mb, 0, 0, (mb == rxLastMailbox) ? CAN_MMR_MOT_MB_RX_OVERWRITE : CAN_MMR_MOT_MB_RX);
+    }
+    
+    // Enable interrupt on receive in all receive mailboxes. Transmit mailbox
+    // interrupts are enabled while they hold a frame
+    CAN0->CAN_IDR = 0xFFFFFFFF;
+    CAN0->CAN_IER = rxMailboxMask | (1u << rxInputMailbox);
+    NVIC_EnableIRQ(ID_CAN0);
 
     // Enable CAN
     CAN0->CAN_MR |= CAN_MR_CANEN;
 }
 
 
-void can_tx(CanMsg m){
-    while(!(CAN0->CAN_MB[txMailbox].CAN_MSR & CAN_MSR_MRDY)){}
-    
-    // Set message ID and use CAN 2.0B protocol
-    CAN0->CAN_MB[txMailbox].CAN_MID = CAN_MID_MIDvA(m.id) | CAN_MID_MIDE ;
-        
+static int can_tx_enqueue(CanMsg m, uint8_t stamped){
     // Coerce maximum 8 byte length
     m.length = m.length > 8 ? 8 : m.length;
     
-    //  Put message in can data registers
-    CAN0->CAN_MB[txMailbox].CAN_MDL = m.dword[0];
-    CAN0->CAN_MB[txMailbox].CAN_MDH = m.dword[1];
-        
-    // Set message length and mailbox ready to send
-    CAN0->CAN_MB[txMailbox].CAN_MCR = (m.length << CAN_MCR_MDLC_Pos) | CAN_MCR_MTCR;
+    int ret = 0;
+    TxEntry entry = {.msg = m, .stamped = stamped};
+    NVIC_DisableIRQ(ID_CAN0);
+    if(!ring_push(&txQueue, &entry)){
+        txStats.queueFull++;
+        ret = -EAGAIN;
+    } else {
+        if(stamped){
+            txStampValid = 0;
+        }
+        txStats.queued++;
+        can_tx_schedule();
+    }
+    NVIC_EnableIRQ(ID_CAN0);
+    return ret;
+}
+
+int can_tx(CanMsg m){
+    return can_tx_enqueue(m, 0);
+}
+
+int can_tx_stamped(CanMsg m){
+    return can_tx_enqueue(m, 1);
+}
+
+uint8_t can_tx_time(uint64_t* t){
+    uint8_t valid;
+    NVIC_DisableIRQ(ID_CAN0);
+    valid = txStampValid;
+    if(valid){
+        *t = txStampTime;
+        txStampValid = 0;
+    }
+    NVIC_EnableIRQ(ID_CAN0);
+    return valid;
+}
+
+void can_tx_stats(CanTxStats* stats){
+    NVIC_DisableIRQ(ID_CAN0);
+    *stats = txStats;
+    NVIC_EnableIRQ(ID_CAN0);
 }
 
 uint8_t can_rx(CanMsg* m){
-    if(!(CAN0->CAN_MB[rxMailbox].CAN_MSR & CAN_MSR_MRDY)){
-        return 0;
+    return ring_pop(&rxRing, m);
+}
+
+uint8_t can_rx_input_state(CanMsg* m){
+    uint8_t fresh;
+    NVIC_DisableIRQ(ID_CAN0);
+    fresh = rxInputFresh;
+    if(fresh){
+        *m = rxInput;
+        rxInputFresh = 0;
     }
+    NVIC_EnableIRQ(ID_CAN0);
+    return fresh;
+}
+
+void can_rx_stats(CanRxStats* stats){
+    NVIC_DisableIRQ(ID_CAN0);
+    *stats = rxStats;
+    NVIC_EnableIRQ(ID_CAN0);
+}
 
-    // Get message ID
-    m->id = (uint8_t)((CAN0->CAN_MB[rxMailbox].CAN_MID & CAN_MID_MIDvA_Msk) >> CAN_MID_MIDvA_Pos);
+void CAN0_Handler(void){
+    // Snapshot the mailboxes holding a frame and rearm them only after all have
+    // been read. Frames arriving meanwhile go to higher mailboxes and are read
+    // on the next interrupt. This is not strict arrival order: once a low
+    // mailbox is rearmed it can take a newer frame, which is then read before
+    // an older one still waiting in a higher mailbox.
+    uint32_t status = CAN0->CAN_SR;
+    uint32_t ready = status & rxMailboxMask;
+    
+    // Transmit mailboxes that have sent their frame
+    uint32_t sent = status & CAN0->CAN_IMR & txMailboxMask;
+    if(sent){
+        // Start of frame of a stamped frame, as for received frames
+        uint32_t stamped = sent & txStampMailboxes;
+        if(stamped){
+            uint8_t mb = __builtin_ctz(stamped);
+            txStampTime = can_stamp_time(CAN0->CAN_MB[mb].CAN_MSR);
+            txStampValid = 1;
+            txStampMailboxes &= ~stamped;
+        }
+        CAN0->CAN_IDR = sent;
+        txBusyMailboxes &= ~sent;
+        txStats.sent += __builtin_popcount(sent);
+        can_tx_schedule();
+    }
+    
+    // Newest input state sample. Reading MSR clears MMI, so if it is set again
+    // after reading, the mailbox was overwritten meanwhile and is read again.
+    if(status & (1u << rxInputMailbox)){
+        uint32_t mbStatus = CAN0->CAN_MB[rxInputMailbox].CAN_MSR;
+        if(rxInputFresh){
+            rxStats.inputOverwrites++;
+        }
+        do {
+            if(mbStatus & CAN_MSR_MMI){
+                rxStats.inputOverwrites++;
+            }
+            can_rx_read(rxInputMailbox, mbStatus, &rxInput);
+            mbStatus = CAN0->CAN_MB[rxInputMailbox].CAN_MSR;
+        } while(mbStatus & CAN_MSR_MMI);
+        rxInputFresh = 1;
+        rxStats.received++;
+        CAN0->CAN_MB[rxInputMailbox].CAN_MCR = CAN_MCR_MTCR;
+    }
+    
+    for(uint8_t mb = rxFirstMailbox; mb <= rxLastMailbox; mb++){
+        if(!(ready & (1u << mb))){
+            continue;
+        }
+        
+        uint32_t mbStatus = CAN0->CAN_MB[mb].CAN_MSR;
+        if(mbStatus & CAN_MSR_MMI){
+            rxStats.mailboxOverruns++;
+        }
+        
+        CanMsg* slot = ring_write_slot(&rxRing);
+        if(!slot){
+            rxStats.ringOverruns++;
+            continue;
+        }
         
-    // Get data length
-    m->length = (uint8_t)((CAN0->CAN_MB[rxMailbox].CAN_MSR & CAN_MSR_MDLC_Msk) >> CAN_MSR_MDLC_Pos);
+        can_rx_read(mb, mbStatus, slot);
+        ring_write_commit(&rxRing, 1);
+        rxStats.received++;
+    }
     
-    // Get data from CAN mailbox
-    m->dword[0] = CAN0->CAN_MB[rxMailbox].CAN_MDL;
-    m->dword[1] = CAN0->CAN_MB[rxMailbox].CAN_MDH;
-                
     // Reset for new receive
-    CAN0->CAN_MB[rxMailbox].CAN_MMR = CAN_MMR_MOT_MB_RX;
-    CAN0->CAN_MB[rxMailbox].CAN_MCR |= CAN_MCR_MTCR;
-    return 1;
-}
\ No newline at end of file
+    for(uint8_t mb = rxFirstMailbox; mb <= rxLastMailbox; mb++){
+        if(ready & (1u << mb)){
+            CAN0->CAN_MB[mb].CAN_MCR = CAN_MCR_MTCR;
+        }
+    }
+}
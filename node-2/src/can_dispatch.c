@@ -0,0 +1,103 @@
+/** ***************************************************************************
+ * @file can_dispatch.c
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Table driven dispatch of received CAN messages
+ * @version 0.1
+ * @date 2025-11-20
+ *
+ * @copyright Copyright (c) 2025 Byggarane
+ *
+ *******************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+
+#include "can_dispatch.h"
+
+struct can_handler_entry {
+    uint32_t id;
+    uint32_t mask;
+    bool extended;
+    can_handler_t handler;
+    void *ctx;
+};
+
+static struct can_handler_entry handlers[CAN_DISPATCH_MAX_HANDLERS];
+static uint8_t num_handlers = 0;
+
+/* Handler slot + 1 for every standard ID, 0 if none is registered */
+static uint8_t std_table[CAN_STD_ID_MASK + 1];
+
+int can_dispatch_register(uint32_t id, uint32_t mask, bool extended, can_handler_t handler, void *ctx)
+{
+    uint32_t id_mask = extended ? CAN_EXT_ID_MASK : CAN_STD_ID_MASK;
+    if (!handler || (id & ~id_mask))
+    {
+        return -EINVAL;
+    }
+    if (num_handlers >= CAN_DISPATCH_MAX_HANDLERS)
+    {
+        return -ENOMEM;
+    }
+
+    mask &= id_mask;
+    handlers[num_handlers] = (struct can_handler_entry){
+        .id = id & mask,
+        .mask = mask,
+        .extended = extended,
+        .handler = handler,
+        .ctx = ctx,
+    };
+    num_handlers++;
+
+    if (!extended)
+    {
+        for (uint32_t i = 0; i <= CAN_STD_ID_MASK; i++)
+        {
+            if ((i & mask) == (id & mask))
+            {
+                std_table[i] = num_handlers;
+            }
+        }
+    }
+    return 0;
+}
+
+int can_dispatch(CanMsg *msg)
+{
+    struct can_handler_entry *entry = NULL;
+
+    if (!msg->extended)
+    {
+        uint8_t slot = std_table[msg->id & CAN_STD_ID_MASK];
+        if (slot)
+        {
+            entry = &handlers[slot - 1];
+        }
+    }
+    else
+    {
+        // Newest registration wins, as for standard IDs
+        for (uint8_t i = num_handlers; i > 0; i--)
+        {
+            struct can_handler_entry *e = &handlers[i - 1];
+            if (e->extended && (msg->id & e->mask) == e->id)
+            {
+                entry = e;
+                break;
+            }
+        }
+    }
+
+    if (!entry)
+    {
+        return -ENOENT;
+    }
+    return entry->handler(msg, entry->ctx);
+}
+
+void can_dispatch_reset(void)
+{
+    num_handlers = 0;
+    memset(std_table, 0, sizeof(std_table));
+}
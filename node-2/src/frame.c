@@ -0,0 +1,113 @@
+/** ***************************************************************************
+ * @file frame.c
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief COBS framing with CRC for binary data on the UART
+ * @version 0.1
+ * @date 2025-11-30
+ *
+ * @copyright Copyright (c) 2025 Byggarane
+ *
+ *******************************************************************************/
+
+#include <errno.h>
+
+#include "frame.h"
+
+#define CRC_POLY 0x1021
+#define CRC_INIT 0xFFFF
+#define COBS_MAX_RUN 0xFF /**< Code byte of a run of 254 non-zero bytes */
+
+uint16_t frame_crc16(const uint8_t *data, uint16_t len)
+{
+    uint16_t crc = CRC_INIT;
+    for (uint16_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ CRC_POLY : crc << 1;
+        }
+    }
+    return crc;
+}
+
+uint16_t frame_encode(const void *payload, uint16_t len, uint8_t *out)
+{
+    const uint8_t *src = payload;
+    uint16_t crc = frame_crc16(src, len);
+    uint8_t crc_bytes[FRAME_CRC_SIZE] = {crc & 0xFF, crc >> 8};
+
+    uint16_t pos = 0;
+    out[pos++] = FRAME_DELIMITER;
+
+    // Each run of non-zero bytes is preceded by a code byte, one more than its
+    // length, standing in for the zero that ends it
+    uint16_t code_pos = pos++;
+    uint8_t code = 1;
+    for (uint16_t i = 0; i < len + FRAME_CRC_SIZE; i++) {
+        uint8_t byte = i < len ? src[i] : crc_bytes[i - len];
+        if (byte != 0) {
+            out[pos++] = byte;
+            code++;
+        }
+        if (byte == 0 || code == COBS_MAX_RUN) {
+            out[code_pos] = code;
+            code_pos = pos++;
+            code = 1;
+        }
+    }
+    out[code_pos] = code;
+
+    out[pos++] = FRAME_DELIMITER;
+    return pos;
+}
+
+int frame_decode(const uint8_t *in, uint16_t len, void *payload, uint16_t size)
+{
+    uint8_t *dst = payload;
+    uint16_t out = 0;
+    uint16_t pos = 0;
+    uint16_t crc_rx = 0;
+
+    while (pos < len) {
+        uint8_t code = in[pos++];
+        if (code == 0 || pos + code - 1 > len) {
+            return -EINVAL;
+        }
+        for (uint8_t i = 1; i < code; i++) {
+            uint8_t byte = in[pos++];
+            if (byte == 0) {
+                return -EINVAL;
+            }
+            // The last two decoded bytes are the CRC, keep them out of the payload
+            if (out >= size + FRAME_CRC_SIZE) {
+                return -EMSGSIZE;
+            }
+            if (out < size) {
+                dst[out] = byte;
+            }
+            crc_rx = (crc_rx >> 8) | ((uint16_t)byte << 8);
+            out++;
+        }
+        if (code != COBS_MAX_RUN && pos < len) {
+            if (out >= size + FRAME_CRC_SIZE) {
+                return -EMSGSIZE;
+            }
+            if (out < size) {
+                dst[out] = 0;
+            }
+            crc_rx >>= 8;
+            out++;
+        }
+    }
+
+    if (out < FRAME_CRC_SIZE) {
+        return -EINVAL;
+    }
+    uint16_t payload_len = out - FRAME_CRC_SIZE;
+    if (payload_len > size) {
+        return -EMSGSIZE;
+    }
+    if (frame_crc16(dst, payload_len) != crc_rx) {
+        return -EBADMSG;
+    }
+    return payload_len;
+}
@@ -9,6 +9,7 @@
  *
  *******************************************************************************/
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -20,6 +21,8 @@
 #include "gpio.h"
 #include "motor_ctrl.h"
 #include "servo.h"
+#include "time.h"
+#include "trace.h"
 
 struct sam_gpio_pin solenoid_pin = {
     .port = 'B',
@@ -35,7 +38,7 @@ int set_servo_from_js_can(CanMsg *msg)
     // Threshold to avoid jitter
     if (abs(js.y - last_js.y) >= 3)
     {
-        //printf("Y: %u\r\n", js.y);
+        trace(TRACE_SERVO, js.y, 0, 0);
         servo_set_angle_percentage(js.y);
     }
     last_js.y = js.y;
@@ -52,9 +55,63 @@ int set_motor_from_js_can(CanMsg *msg, struct xy_coords* js)
 int set_solenoid_from_can(CanMsg *msg)
 {
     bool state = msg->byte[0];
-    printf("Solenoid state from CAN: %d\r\n", state);
-    sam_gpio_set(solenoid_pin, state);
+    trace(TRACE_SOLENOID, state, 0, 0);
 
+    return set_solenoid(state);
+}
+
+int set_solenoid(bool state)
+{
+    return sam_gpio_set(solenoid_pin, state);
+}
+
+int input_state_from_can(CanMsg *msg, struct input_state_frame *frame, struct input_state_stats *stats)
+{
+    if (msg->length < sizeof(*frame))
+    {
+        return -EINVAL;
+    }
+    uint64_t now = time_now();
+    memcpy(frame, msg->byte, sizeof(*frame));
+
+    if (stats->received)
+    {
+        // Sequence numbers wrap, so compare them as a signed distance
+        int8_t delta = (int8_t)(frame->seq - stats->last_seq);
+        if (delta <= 0 && delta >= -INPUT_STATE_MAX_REORDER &&
+            ++stats->rejects_in_row < INPUT_STATE_RESYNC_REJECTS)
+        {
+            stats->reordered++;
+            return -EAGAIN;
+        }
+
+        if (delta <= 0)
+        {
+            // Node 1 restarted its sequence, take this frame as the new start
+            stats->resyncs++;
+        }
+        else
+        {
+            stats->lost += delta - 1;
+
+            int32_t arrival_us = (int32_t)((now - stats->last_arrival) / usecs(1));
+            int32_t send_us = (int32_t)((uint16_t)(frame->timestamp - stats->last_timestamp) *
+                                        INPUT_STATE_TIMESTAMP_US_NUM / INPUT_STATE_TIMESTAMP_US_DEN);
+            uint32_t jitter_us = abs(arrival_us - send_us);
+            stats->total_jitter_us += jitter_us;
+            stats->jitter_samples++;
+            if (jitter_us > stats->max_jitter_us)
+            {
+                stats->max_jitter_us = jitter_us;
+            }
+        }
+    }
+
+    stats->rejects_in_row = 0;
+    stats->received++;
+    stats->last_seq = frame->seq;
+    stats->last_timestamp = frame->timestamp;
+    stats->last_arrival = now;
     return 0;
 }
 
@@ -73,9 +130,9 @@ int check_game_over()
 int send_game_over(CanMsg *msg)
 {
     msg->id = CAN_ID_GAME_OVER;
+    msg->extended = 0;
     msg->length = 1;
     msg->byte[0] = 1; // Game over signal
-    can_tx(*msg);
 
-    return 0; // Game continues
+    return can_tx(*msg);
 }
\ No newline at end of file
@@ -0,0 +1,67 @@
+/** ***************************************************************************
+ * @file latency.c
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Node 2 side of the input to actuation latency measurement
+ * @version 0.1
+ * @date 2025-11-24
+ *
+ * @copyright Copyright (c) 2025 Byggarane
+ *
+ *******************************************************************************/
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "latency.h"
+#include "motor_ctrl.h"
+#include "time.h"
+
+static bool probe_pending = false;
+static uint8_t probe_seq;
+static uint64_t probe_rx_time;
+static uint32_t probe_tick;
+
+static uint32_t ticks_to_us(uint64_t ticks)
+{
+    return ticks / usecs(1);
+}
+
+static uint16_t clamp_u16(uint32_t value)
+{
+    return value > UINT16_MAX ? UINT16_MAX : value;
+}
+
+void latency_probe_received(const CanMsg *msg, uint8_t seq)
+{
+    probe_pending = true;
+    probe_seq = seq;
+    probe_rx_time = msg->rxTime;
+    probe_tick = motor_ctrl_last_tick(NULL);
+}
+
+int latency_probe_actuated(void)
+{
+    uint64_t applied;
+    if (!probe_pending || motor_ctrl_last_tick(&applied) == probe_tick)
+    {
+        return 0;
+    }
+    probe_pending = false;
+
+    uint32_t actuation_us = ticks_to_us(applied - probe_rx_time);
+    uint32_t rx_us = ticks_to_us(probe_rx_time) & LATENCY_CLOCK_MASK;
+    struct latency_echo_frame echo = {
+        .seq = probe_seq,
+        .rx_us = {rx_us & 0xFF, (rx_us >> 8) & 0xFF, (rx_us >> 16) & 0xFF},
+        .actuation_us = clamp_u16(actuation_us),
+    };
+
+    CanMsg msg = {
+        .id = CAN_ID_LATENCY_ECHO,
+        .extended = 0,
+        .length = sizeof(echo),
+    };
+    echo.turnaround_us = clamp_u16(ticks_to_us(time_now() - probe_rx_time));
+    memcpy(msg.byte, &echo, sizeof(echo));
+    return can_tx(msg);
+}
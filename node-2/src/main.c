@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include "sam.h"
@@ -5,23 +6,125 @@
 
 #include "adc.h"
 #include "can.h"
+#include "can_dispatch.h"
 #include "game.h"
+#include "latency.h"
 #include "gpio.h"
 #include "motor_ctrl.h"
 #include "pwm.h"
 #include "servo.h"
+#include "telemetry.h"
+#include "timesync.h"
+#include "trace.h"
 #include "uart.h"
 
 #define F_CPU 84000000
-#define BAUD_RATE 115200
+#define BAUD_RATE 250000 // 84 MHz / 16 / 21, exact
 
 #define SERVO_PERIOD_MS 20
 #define MOTOR_PERIOD_US 50
+#define MOTOR_CTRL_RATE_HZ 1000
+#define TELEMETRY_RATE_HZ 500
 
 #define IR_COUNTER_THRESHOLD 1
 
 #define _delay(time) time_spinFor(msecs(time))
 
+struct game {
+    enum game_state state;
+    bool calibrated;
+    struct xy_coords js;
+    bool js_btn;
+    struct input_state_stats input_stats;
+};
+
+static struct game game = {
+    .state = GAME_WAIT_START,
+    .calibrated = false,
+};
+
+static int send_node2_ready(void)
+{
+    CanMsg msg = {
+        .id = CAN_ID_NODE2_RDY,
+        .extended = 0,
+        .length = 1,
+        .byte = {1}, // Node 2 ready signal
+    };
+    return can_tx(msg);
+}
+
+static int on_joystick_btn(CanMsg *msg, void *ctx)
+{
+    struct game *g = ctx;
+    if (g->state != GAME_RUNNING) {
+        return 0;
+    }
+    return set_solenoid_from_can(msg);
+}
+
+static int on_input_state(CanMsg *msg, void *ctx)
+{
+    struct game *g = ctx;
+    struct input_state_frame frame;
+    int ret = input_state_from_can(msg, &frame, &g->input_stats);
+    if (ret || g->state != GAME_RUNNING) {
+        return ret;
+    }
+
+    set_servo_from_js_can(msg);
+    set_motor_from_js_can(msg, &g->js);
+    motor_ctrl_set_setpoint(g->js.x);
+    if (frame.buttons & (1 << INPUT_STATE_BTN_PROBE)) {
+        latency_probe_received(msg, frame.seq);
+    }
+
+    bool js_btn = frame.buttons & (1 << INPUT_STATE_BTN_JOYSTICK);
+    if (js_btn != g->js_btn) {
+        g->js_btn = js_btn;
+        return set_solenoid(js_btn);
+    }
+    return 0;
+}
+
+static int on_game_start(CanMsg *msg, void *ctx)
+{
+    struct game *g = ctx;
+    switch (g->state) {
+        case GAME_WAIT_START:
+            if (!g->calibrated)
+            {
+                printf("Calibrating motor...\r\n");
+                calibrate_motor();
+                g->calibrated = true;
+            }
+            g->input_stats = (struct input_state_stats){0};
+            motor_ctrl_set_setpoint(g->js.x);
+            int ret = telemetry_start(TELEMETRY_RATE_HZ, MOTOR_CTRL_RATE_HZ);
+            if (ret) {
+                return ret;
+            }
+            ret = motor_ctrl_start(MOTOR_CTRL_RATE_HZ);
+            if (ret) {
+                return ret;
+            }
+            g->state = GAME_RUNNING;
+            printf("Game started!\r\n");
+            return send_node2_ready();
+
+        case GAME_RUNNING:
+            return send_node2_ready();
+
+        case GAME_OVER:
+            g->state = GAME_WAIT_START;
+            printf("Restarting game, waiting for start...\r\n");
+            return 0;
+
+        default:
+            return -EINVAL;
+    }
+}
+
 int main()
 {
     SystemInit();
@@ -37,8 +140,12 @@ int main()
         .smp = 0     // Sampling mode
     };
 
-    can_init(_can_init, 0);
+    can_init(_can_init);
     struct CanMsg msg;
+    CanRxStats can_rx_info;
+    CanTxStats can_tx_info;
+    struct motor_ctrl_stats motor_info;
+    struct telemetry_stats telemetry_info;
 
     uart_init(F_CPU, BAUD_RATE);
     printf("Hello World\r\n");
@@ -58,43 +165,47 @@ int main()
     motor_init(MOTOR_PERIOD_US);
     encoder_init();
     printf("Motor and encoder initialized\r\n");
+
+    struct motor_ctrl_benchmark bench;
+    motor_ctrl_benchmark(&bench);
+    printf("Motor controller step: fixed-point PID %lu cycles, float P %lu cycles\r\n",
+           bench.fixed_cycles, bench.float_cycles);
     
     servo_init(SERVO_PERIOD_MS);
     printf("Servo initialized\r\n");
 
     // Game variables
-    struct xy_coords js = {0};
     uint8_t ir_counter = 0;
-    enum game_state current_state = GAME_WAIT_START;
-    bool calibrated = false;
+    bool game_over_retry = false;
+    printf("Waiting for game start...\r\n");
+
+    can_dispatch_register(CAN_ID_JOYSTICK_BTN, CAN_STD_ID_MASK, false, on_joystick_btn, &game);
+    can_dispatch_register(CAN_ID_INPUT_STATE, CAN_STD_ID_MASK, false, on_input_state, &game);
+    can_dispatch_register(CAN_ID_GAME_START, CAN_STD_ID_MASK, false, on_game_start, &game);
 
     while (1)
     {
+        // Keep node 1 on our clock
+        timesync_service();
+
+        // Send trace records in the background
+        trace_drain();
+        telemetry_drain();
+
+        // Newest input state, older ones are dropped by the CAN driver
+        if (can_rx_input_state(&msg)) {
+            can_dispatch(&msg);
+        }
+
+        // Process incoming CAN messages
+        if (can_rx(&msg) && can_dispatch(&msg) == -ENOENT) {
+            trace(TRACE_CAN_UNKNOWN, msg.id, 0, 0);
+        }
 
         // Game state machine
-        switch(current_state) {
+        switch(game.state) {
 
             case GAME_WAIT_START:
-                printf("Waiting for game start...\r\n");
-                if (can_rx(&msg))
-                {
-                    printf("Received CAN message with ID: %X\r\n", msg.id);
-                    if (msg.id == CAN_ID_GAME_START)
-                    {
-                        if (!calibrated)
-                        {
-                            printf("Calibrating motor...\r\n");
-                            calibrate_motor();
-                            calibrated = true;
-                        }
-                        msg.id = CAN_ID_NODE2_RDY;
-                        msg.length = 1;
-                        msg.byte[0] = 1; // Node 2 ready signal
-                        can_tx(msg);
-                        current_state = GAME_RUNNING;
-                        printf("Game started!\r\n");
-                    }
-                }
                 break;
 
             case GAME_RUNNING:
@@ -104,56 +215,52 @@ int main()
                     ir_counter++;
                     if (ir_counter > IR_COUNTER_THRESHOLD)
                     {
-                        send_game_over(&msg);
+                        // A full transmit queue is retried from GAME_OVER
+                        game_over_retry = send_game_over(&msg) != 0;
                         can_printmsg(msg);
+                        can_rx_stats(&can_rx_info);
+                        printf("CAN rx: %lu, ring overruns: %lu, mailbox overruns: %lu, input overwrites: %lu\r\n",
+                               can_rx_info.received, can_rx_info.ringOverruns, can_rx_info.mailboxOverruns,
+                               can_rx_info.inputOverwrites);
+                        can_tx_stats(&can_tx_info);
+                        printf("CAN tx: %lu, sent: %lu, queue full: %lu\r\n",
+                               can_tx_info.queued, can_tx_info.sent, can_tx_info.queueFull);
+                        struct input_state_stats *in = &game.input_stats;
+                        printf("Input state: %lu, lost: %lu, reordered: %lu, resyncs: %lu, jitter mean %lu us, max %lu us\r\n",
+                               in->received, in->lost, in->reordered, in->resyncs,
+                               in->jitter_samples ? in->total_jitter_us / in->jitter_samples : 0,
+                               in->max_jitter_us);
+                        motor_ctrl_stop();
+                        telemetry_stop();
+                        motor_ctrl_get_stats(&motor_info);
+                        printf("Motor loop: %lu ticks, overruns: %lu, max %lu of %lu cycles\r\n",
+                               motor_info.ticks, motor_info.overruns, motor_info.max_exec_cycles,
+                               motor_info.period_cycles);
+                        printf("UART tx dropped: %lu bytes, trace dropped: %lu records\r\n",
+                               uart_tx_dropped(), trace_dropped());
+                        telemetry_get_stats(&telemetry_info);
+                        printf("Telemetry: %lu samples, dropped: %lu\r\n",
+                               telemetry_info.queued, telemetry_info.dropped);
                         ir_counter = 0;
-                        current_state = GAME_OVER;
+                        game.state = GAME_OVER;
                         break;
                     }
                 } else {
                     ir_counter = 0;
                 }
 
-                // Process incoming CAN messages
-                if (can_rx(&msg)) {
-
-                    switch (msg.id) {
-                        case CAN_ID_JOYSTICK:
-                            set_servo_from_js_can(&msg);
-                            set_motor_from_js_can(& msg, &js);
-                            break;
-                        
-                        case CAN_ID_JOYSTICK_BTN:
-                            set_solenoid_from_can(&msg);
-                            break;
-                        
-                        case CAN_ID_GAME_START:
-                            msg.id = CAN_ID_NODE2_RDY;
-                            msg.length = 1;
-                            msg.byte[0] = 1; // Node 2 ready signal
-                            can_tx(msg);
-                            break;
-                        
-                        default:
-                            printf("Unknown CAN message ID: %d\r\n", msg.id);
-                            break;
-                    }
-                }
-
-                set_motor_pos(js.x);
+                // The setpoint is applied by the motor control loop interrupt
+                latency_probe_actuated();
                 break;
 
             case GAME_OVER:
-                if(can_rx(&msg)) {
-                    if (msg.id == CAN_ID_GAME_START) {
-                        current_state = GAME_WAIT_START;
-                        printf("Restarting game, waiting for start...\r\n");
-                    }
+                if (game_over_retry && send_game_over(&msg) == 0) {
+                    game_over_retry = false;
                 }
                 break;
                 
             default:
-                current_state = GAME_RUNNING;
+                game.state = GAME_RUNNING;
                 break;
                     
             }
@@ -9,16 +9,25 @@
  *
  *******************************************************************************/
 
+#include <errno.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include "sam.h"
 
+#include "adc.h"
 #include "gpio.h"
 #include "motor_ctrl.h"
+#include "pid.h"
 #include "pwm.h"
+#include "telemetry.h"
 #include "time.h"
+#include "trace.h"
 
-#define MIN_ABS_ERROR 20
+#define MIN_ABS_ERROR 20 /**< Used by the float reference in the benchmark only */
 #define CALIBRATE_DELAY_MS 1000
+#define BENCHMARK_STEPS 256
+#define TRACE_DIVIDER 10 /**< Trace every n-th control loop iteration */
+#define CTRL_TC_CLOCK_DIV 2 /**< TIMER_CLOCK1 runs at MCK / 2 */
 
 struct sam_gpio_pin motor_dir_pin = {
     .port = 'C',
@@ -29,15 +38,29 @@ struct sam_gpio_pin motor_dir_pin = {
 static struct {
     int16_t min_pos;    /**< Minimum encoder position */
     int16_t max_pos;    /**< Maximum encoder position */
-    float k_p;          /**< Proportional gain */
-    float k_i;          /**< Integral gain */
+    struct pid_config pid; /**< Gains in permille duty per permille position */
 } motor_cal = {
     .min_pos = 0,
     .max_pos = 100,
-    .k_p = 1.2f,
-    .k_i = 2.0f,
+    .pid = {
+        .kp = PID_GAIN(1.2),
+        .ki = PID_GAIN(2.0),
+        .kd = PID_GAIN(0.0),
+        .out_min = -MOTOR_DUTY_SCALE,
+        .out_max = MOTOR_DUTY_SCALE,
+    },
 };
 
+static struct pid motor_pid;
+static volatile uint32_t benchmark_sink; /**< Keeps benchmark results from being optimized away */
+
+/* Shared between the control loop interrupt and the rest of the program. */
+static volatile uint8_t ctrl_setpoint;
+static volatile uint32_t ctrl_ticks;
+static volatile uint64_t ctrl_tick_time;
+static struct motor_ctrl_stats ctrl_stats;
+static uint32_t ctrl_last_exec_cycles;
+
 void encoder_init(void)
 {
     // activate clock for the Timer counter- module in Power management controller
@@ -91,6 +114,7 @@ int get_encoder_value(void)
 }
 
 int calibrate_motor(void) {
+    motor_ctrl_stop();
     int16_t last_val = get_encoder_value();
     printf("Start pos: %d\r\n", last_val);
 
@@ -125,10 +149,9 @@ int get_motor_pos()
     int16_t encoder_val = get_encoder_value();
     int16_t pos_range = motor_cal.max_pos - motor_cal.min_pos;
     if (pos_range == 0) {
-        printf("Motor not calibrated!\r\n");
-        return 0; // Avoid division by zero
+        return 0; // Not calibrated, avoid division by zero
     }
-    return (encoder_val - motor_cal.min_pos) * 100 / pos_range;
+    return (encoder_val - motor_cal.min_pos) * MOTOR_POS_SCALE / pos_range;
 }
 
 int motor_init(uint8_t period_us)
@@ -148,23 +171,166 @@ void set_motor_dir(bool dir)
 
 
 
-void set_motor_pos(int joystick_value)
+static void motor_ctrl_step(uint8_t setpoint, struct telemetry_sample *sample)
+{
+    int32_t target = setpoint * MOTOR_POS_SCALE / 100;
+    int32_t position = get_motor_pos();
+    int32_t duty = pid_step(&motor_pid, target, position);
+    set_motor_dir(duty > 0);
+    pwm_set_duty_permille(abs(duty), MOTOR_PWM_CH);
+
+    if (ctrl_ticks % TRACE_DIVIDER == 0) {
+        trace(TRACE_MOTOR, target, position, duty);
+    }
+
+    sample->setpoint = target;
+    sample->position = position;
+    sample->duty = duty;
+}
+
+void TC0_Handler(void)
+{
+    uint64_t start = time_now();
+    TC0->TC_CHANNEL[0].TC_SR; // Clear the compare flag
+
+    struct telemetry_sample sample = {
+        .time = start,
+        .encoder = get_encoder_value(),
+        .ir_adc = adc_last(),
+        .exec_cycles = ctrl_last_exec_cycles > UINT16_MAX ? UINT16_MAX : ctrl_last_exec_cycles,
+    };
+    motor_ctrl_step(ctrl_setpoint, &sample);
+    telemetry_sample(&sample);
+    ctrl_tick_time = start;
+    ctrl_ticks = ctrl_ticks + 1;
+
+    uint32_t cycles = time_now() - start;
+    ctrl_last_exec_cycles = cycles;
+    if (cycles > ctrl_stats.max_exec_cycles) {
+        ctrl_stats.max_exec_cycles = cycles;
+    }
+    if (cycles > ctrl_stats.period_cycles) {
+        ctrl_stats.overruns++;
+    }
+}
+
+int motor_ctrl_start(uint16_t rate_hz)
+{
+    if (rate_hz == 0 || rate_hz > MOTOR_CTRL_MAX_RATE_HZ) {
+        return -EINVAL;
+    }
+    motor_ctrl_stop();
+
+    motor_cal.pid.rate_hz = rate_hz;
+    int ret = pid_init(&motor_pid, &motor_cal.pid);
+    if (ret) {
+        return ret;
+    }
+
+    ctrl_ticks = 0;
+    ctrl_tick_time = 0;
+    ctrl_last_exec_cycles = 0;
+    ctrl_stats = (struct motor_ctrl_stats){
+        .period_cycles = SystemCoreClock / rate_hz,
+    };
+
+    // TC0 channel 0 counts MCK / 2 up to RC and interrupts on the RC compare
+    PMC->PMC_PCER0 |= (1 << ID_TC0);
+    TC0->TC_CHANNEL[0].TC_CMR = TC_CMR_TCCLKS_TIMER_CLOCK1 | TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC;
+    TC0->TC_CHANNEL[0].TC_RC = SystemCoreClock / CTRL_TC_CLOCK_DIV / rate_hz;
+    TC0->TC_CHANNEL[0].TC_IER = TC_IER_CPCS;
+
+    NVIC_SetPriority(TC0_IRQn, MOTOR_CTRL_IRQ_PRIORITY);
+    NVIC_ClearPendingIRQ(TC0_IRQn);
+    NVIC_EnableIRQ(TC0_IRQn);
+    TC0->TC_CHANNEL[0].TC_CCR = TC_CCR_CLKEN | TC_CCR_SWTRG;
+    return 0;
+}
+
+void motor_ctrl_stop(void)
 {
-    // P controller. Dont know if this works
-    // Walter: test this and motor calibration
-    uint8_t actual_pos = get_motor_pos();
-    int8_t error = joystick_value - actual_pos;
+    TC0->TC_CHANNEL[0].TC_CCR = TC_CCR_CLKDIS;
+    TC0->TC_CHANNEL[0].TC_IDR = TC_IDR_CPCS;
+    NVIC_DisableIRQ(TC0_IRQn);
+    pwm_set_duty_cycle(0, MOTOR_PWM_CH);
+}
+
+void motor_ctrl_set_setpoint(uint8_t position)
+{
+    ctrl_setpoint = position;
+}
+
+/* Mask the loop interrupt, returning whether it was enabled. After
+ * motor_ctrl_stop() it has to stay off, so callers restore rather than enable. */
+static uint32_t ctrl_irq_save(void)
+{
+    uint32_t enabled = NVIC_GetEnableIRQ(TC0_IRQn);
+    NVIC_DisableIRQ(TC0_IRQn);
+    return enabled;
+}
+
+static void ctrl_irq_restore(uint32_t enabled)
+{
+    if (enabled) {
+        NVIC_EnableIRQ(TC0_IRQn);
+    }
+}
+
+uint32_t motor_ctrl_last_tick(uint64_t *time)
+{
+    uint32_t enabled = ctrl_irq_save();
+    uint32_t ticks = ctrl_ticks;
+    if (time) {
+        *time = ctrl_tick_time;
+    }
+    ctrl_irq_restore(enabled);
+    return ticks;
+}
+
+void motor_ctrl_get_stats(struct motor_ctrl_stats *stats)
+{
+    uint32_t enabled = ctrl_irq_save();
+    *stats = ctrl_stats;
+    stats->ticks = ctrl_ticks;
+    ctrl_irq_restore(enabled);
+}
+
+/* The P controller this loop replaced, float math as in pwm_set_duty_cycle(). */
+static uint32_t float_reference_step(uint8_t setpoint, uint8_t actual_pos, uint32_t period)
+{
+    const float k_p = 1.2f;
+    int8_t error = setpoint - actual_pos;
     if(error > 1 && error < MIN_ABS_ERROR) {
         error = MIN_ABS_ERROR;
     } else if (error < -1 && error > -MIN_ABS_ERROR) {
         error = -MIN_ABS_ERROR;
     }
-    int8_t control = motor_cal.k_p * error;
-    printf("Joystick: %d, Actual: %d, Error: %d, Control: %d\r\n", joystick_value, actual_pos, error, control);
-    if (control > 0) {
-        set_motor_dir(true);
-    } else {
-        set_motor_dir(false);
+    int8_t control = k_p * error;
+    float period_ms = ((float)period / (PWM_CLOCK_FREQ / 42)) * 1000.0f;
+    float pulse_width_ms = (abs(control) / 100.0f) * period_ms;
+    return (uint32_t)((pulse_width_ms / 1000.0f) * (PWM_CLOCK_FREQ / 42));
+}
+
+void motor_ctrl_benchmark(struct motor_ctrl_benchmark *result)
+{
+    volatile uint32_t period = PWM->PWM_CH_NUM[MOTOR_PWM_CH].PWM_CPRD;
+    struct pid pid;
+    struct pid_config config = motor_cal.pid;
+    config.rate_hz = 1000;
+    pid_init(&pid, &config);
+
+    // Sweep the measurement so both paths see all error signs and sizes
+    uint64_t start = time_now();
+    for (uint16_t i = 0; i < BENCHMARK_STEPS; i++) {
+        int32_t duty = pid_step(&pid, MOTOR_POS_SCALE / 2, i * MOTOR_POS_SCALE / BENCHMARK_STEPS);
+        benchmark_sink = period * abs(duty) / MOTOR_DUTY_SCALE;
+    }
+    uint64_t fixed_end = time_now();
+    for (uint16_t i = 0; i < BENCHMARK_STEPS; i++) {
+        benchmark_sink = float_reference_step(50, i * 100 / BENCHMARK_STEPS, period);
     }
-    pwm_set_duty_cycle(abs(control), MOTOR_PWM_CH);
+    uint64_t float_end = time_now();
+
+    result->fixed_cycles = (fixed_end - start) / BENCHMARK_STEPS;
+    result->float_cycles = (float_end - fixed_end) / BENCHMARK_STEPS;
 }
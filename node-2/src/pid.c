@@ -0,0 +1,88 @@
+/** ***************************************************************************
+ * @file pid.c
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Fixed-point PID controller
+ * @version 0.1
+ * @date 2025-11-27
+ *
+ * @copyright Copyright (c) 2025 Byggarane
+ *
+ *******************************************************************************/
+
+#include <errno.h>
+
+#include "pid.h"
+
+#define I_Q (PID_Q + PID_I_EXTRA_Q)
+
+static int64_t clamp_i64(int64_t value, int64_t min, int64_t max)
+{
+    if (value < min) {
+        return min;
+    }
+    if (value > max) {
+        return max;
+    }
+    return value;
+}
+
+int pid_init(struct pid *pid, const struct pid_config *config)
+{
+    if (config->kp < 0 || config->ki < 0 || config->kd < 0 ||
+        config->rate_hz == 0 || config->out_min >= config->out_max) {
+        return -EINVAL;
+    }
+
+    // Fold the sample time into the gains, so a step is multiplies only
+    int64_t ki = ((int64_t)config->ki << PID_I_EXTRA_Q) / config->rate_hz;
+    int64_t kd = (int64_t)config->kd * config->rate_hz;
+    if (ki > INT32_MAX || kd > INT32_MAX) {
+        return -EINVAL;
+    }
+
+    pid->kp = config->kp;
+    pid->ki = ki;
+    pid->kd = kd;
+    pid->out_min = config->out_min;
+    pid->out_max = config->out_max;
+    pid_reset(pid);
+    return 0;
+}
+
+void pid_reset(struct pid *pid)
+{
+    pid->integral = 0;
+    pid->prev_measurement = 0;
+    pid->primed = false;
+}
+
+int32_t pid_step(struct pid *pid, int32_t setpoint, int32_t measurement)
+{
+    int32_t error = setpoint - measurement;
+
+    int64_t p = (int64_t)pid->kp * error;
+    int64_t d = 0;
+    if (pid->primed) {
+        d = -(int64_t)pid->kd * (measurement - pid->prev_measurement);
+    }
+    pid->prev_measurement = measurement;
+    pid->primed = true;
+
+    int64_t integral = clamp_i64(pid->integral + (int64_t)pid->ki * error,
+                                 (int64_t)pid->out_min << I_Q, (int64_t)pid->out_max << I_Q);
+
+    int64_t out = (p + d + (integral >> PID_I_EXTRA_Q) + (1L << (PID_Q - 1))) >> PID_Q;
+    if (out >= pid->out_max) {
+        out = pid->out_max;
+        if (error > 0) {
+            integral = pid->integral; // Hold, integrating would only wind up
+        }
+    } else if (out <= pid->out_min) {
+        out = pid->out_min;
+        if (error < 0) {
+            integral = pid->integral;
+        }
+    }
+    pid->integral = integral;
+    return out;
+}
@@ -186,3 +186,16 @@ int pwm_set_duty_cycle(float duty_cycle_percentage, uint8_t ch_num)
 
     return pwm_set_pulse_width_ms(pulse_width_ms, ch_num);
 }
+
+
+int pwm_set_duty_permille(uint16_t duty_permille, uint8_t ch_num)
+{
+    uint32_t period = PWM->PWM_CH_NUM[ch_num].PWM_CPRD;
+    if (period == 0 || duty_permille > PWM_PERMILLE_MAX)
+    {
+        return -EINVAL;
+    }
+
+    PWM->PWM_CH_NUM[ch_num].PWM_CDTYUPD = period * duty_permille / PWM_PERMILLE_MAX;
+    return 0;
+}
@@ -0,0 +1,148 @@
+/** ***************************************************************************
+ * @file ring.c
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Lock-free single-producer single-consumer ring buffer
+ * @version 0.1
+ * @date 2025-11-29
+ *
+ * @copyright Copyright (c) 2025 Byggarane
+ *
+ *******************************************************************************/
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "ring.h"
+
+/* The other side's index is loaded with acquire, so its slot accesses are
+ * complete before ours start. Our index is stored with release, so our slot
+ * accesses are complete before the other side sees it. On the Cortex-M3 both
+ * become a DMB. */
+static uint32_t load_acquire(const volatile uint32_t *index)
+{
+    return __atomic_load_n(index, __ATOMIC_ACQUIRE);
+}
+
+static void store_release(volatile uint32_t *index, uint32_t value)
+{
+    __atomic_store_n(index, value, __ATOMIC_RELEASE);
+}
+
+static uint8_t *slot(const struct ring *ring, uint32_t index)
+{
+    return ring->buf + (index & ring->mask) * ring->elem_size;
+}
+
+/* Copy elements between the ring and a linear buffer, splitting at the end of the ring. */
+static void copy_in(struct ring *ring, uint32_t index, const uint8_t *src, uint32_t count)
+{
+    uint32_t first = ring->mask + 1 - (index & ring->mask);
+    if (first > count) {
+        first = count;
+    }
+    memcpy(slot(ring, index), src, first * ring->elem_size);
+    memcpy(ring->buf, src + first * ring->elem_size, (count - first) * ring->elem_size);
+}
+
+static void copy_out(const struct ring *ring, uint32_t index, uint8_t *dst, uint32_t count)
+{
+    uint32_t first = ring->mask + 1 - (index & ring->mask);
+    if (first > count) {
+        first = count;
+    }
+    memcpy(dst, slot(ring, index), first * ring->elem_size);
+    memcpy(dst + first * ring->elem_size, ring->buf, (count - first) * ring->elem_size);
+}
+
+int ring_init(struct ring *ring, void *buf, uint32_t elem_size, uint32_t size)
+{
+    if (!buf || !elem_size || !size || (size & (size - 1))) {
+        return -EINVAL;
+    }
+    ring->buf = buf;
+    ring->elem_size = elem_size;
+    ring->mask = size - 1;
+    ring_reset(ring);
+    return 0;
+}
+
+void ring_reset(struct ring *ring)
+{
+    ring->head = 0;
+    ring->tail = 0;
+}
+
+uint32_t ring_count(const struct ring *ring)
+{
+    return load_acquire(&ring->head) - ring->tail;
+}
+
+uint32_t ring_free(const struct ring *ring)
+{
+    return ring->mask + 1 - (ring->head - load_acquire(&ring->tail));
+}
+
+bool ring_push(struct ring *ring, const void *elem)
+{
+    return ring_push_bulk(ring, elem, 1);
+}
+
+bool ring_pop(struct ring *ring, void *elem)
+{
+    return ring_pop_bulk(ring, elem, 1);
+}
+
+uint32_t ring_push_bulk(struct ring *ring, const void *elems, uint32_t count)
+{
+    uint32_t free = ring_free(ring);
+    if (count > free) {
+        count = free;
+    }
+    if (count) {
+        copy_in(ring, ring->head, elems, count);
+        store_release(&ring->head, ring->head + count);
+    }
+    return count;
+}
+
+uint32_t ring_pop_bulk(struct ring *ring, void *elems, uint32_t count)
+{
+    uint32_t waiting = ring_count(ring);
+    if (count > waiting) {
+        count = waiting;
+    }
+    if (count) {
+        copy_out(ring, ring->tail, elems, count);
+        store_release(&ring->tail, ring->tail + count);
+    }
+    return count;
+}
+
+void *ring_write_slot(struct ring *ring)
+{
+    return ring_free(ring) ? slot(ring, ring->head) : NULL;
+}
+
+void ring_write_commit(struct ring *ring, uint32_t count)
+{
+    store_release(&ring->head, ring->head + count);
+}
+
+void *ring_read_slot(struct ring *ring)
+{
+    return ring_count(ring) ? slot(ring, ring->tail) : NULL;
+}
+
+uint32_t ring_read_contiguous(struct ring *ring, void **elems)
+{
+    uint32_t waiting = ring_count(ring);
+    uint32_t to_end = ring->mask + 1 - (ring->tail & ring->mask);
+    *elems = slot(ring, ring->tail);
+    return waiting < to_end ? waiting : to_end;
+}
+
+void ring_read_commit(struct ring *ring, uint32_t count)
+{
+    store_release(&ring->tail, ring->tail + count);
+}
@@ -0,0 +1,91 @@
+/** ***************************************************************************
+ * @file telemetry.c
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Binary telemetry stream from the motor control loop
+ * @version 0.1
+ * @date 2025-11-30
+ *
+ * @copyright Copyright (c) 2025 Byggarane
+ *
+ *******************************************************************************/
+
+#include <errno.h>
+#include <stdbool.h>
+
+#include "frame.h"
+#include "ring.h"
+#include "telemetry.h"
+#include "uart.h"
+
+/* Filled by the control loop interrupt, emptied by telemetry_drain(). */
+static struct telemetry_sample samples[TELEMETRY_RING_SIZE];
+static struct ring ring = RING_INIT(samples);
+
+static volatile bool running = false;
+static volatile uint16_t divider;
+static uint16_t countdown;
+static uint8_t seq;
+static volatile struct telemetry_stats stats;
+
+int telemetry_start(uint16_t rate_hz, uint16_t loop_rate_hz)
+{
+    if (rate_hz == 0 || rate_hz > loop_rate_hz) {
+        return -EINVAL;
+    }
+    running = false;
+    divider = loop_rate_hz / rate_hz;
+    countdown = 0;
+    stats.queued = 0;
+    stats.dropped = 0;
+    running = true;
+    return 0;
+}
+
+void telemetry_stop(void)
+{
+    running = false;
+}
+
+void telemetry_sample(const struct telemetry_sample *sample)
+{
+    if (!running) {
+        return;
+    }
+    if (countdown) {
+        countdown--;
+        return;
+    }
+    countdown = divider - 1;
+
+    struct telemetry_sample *slot = ring_write_slot(&ring);
+    if (!slot) {
+        stats.dropped++;
+        return;
+    }
+    *slot = *sample;
+    slot->type = TELEMETRY_FRAME_SAMPLE;
+    slot->seq = seq++;
+    ring_write_commit(&ring, 1);
+    stats.queued++;
+}
+
+void telemetry_drain(void)
+{
+    uint8_t frame[FRAME_MAX_ENCODED(sizeof(struct telemetry_sample))];
+    struct telemetry_sample *sample;
+
+    for (uint8_t sent = 0; sent < TELEMETRY_DRAIN_FRAMES && (sample = ring_read_slot(&ring)); sent++) {
+        uint16_t len = frame_encode(sample, sizeof(*sample), frame);
+        if (uart_tx_free() < len) {
+            break; // Whole frames only, retried on the next call
+        }
+        uart_write(frame, len);
+        ring_read_commit(&ring, 1);
+    }
+}
+
+void telemetry_get_stats(struct telemetry_stats *out)
+{
+    out->queued = stats.queued;
+    out->dropped = stats.dropped;
+}
@@ -5,7 +5,7 @@
 
 
 uint64_t calib;
-static uint64_t now = 0;
+static volatile uint64_t now = 0;
     
 __attribute__((constructor)) void time_init(void){
     // Clock calibration is set to '(num cycles for 1ms) / 8'
@@ -30,7 +30,21 @@ void SysTick_Handler(void){
 
 
 uint64_t time_now(void){
-    return now + calib - SysTick->VAL;
+    uint64_t base;
+    uint32_t val;
+    uint32_t reloaded;
+    do {
+        base = now;
+        val = SysTick->VAL;
+        // Reloaded, but SysTick_Handler has not run yet. Happens when called from
+        // a higher priority interrupt. Read again so VAL is from after the reload
+        reloaded = SCB->ICSR & SCB_ICSR_PENDSTSET_Msk;
+        if (reloaded) {
+            val = SysTick->VAL;
+        }
+        // now is 64 bits and not read atomically, retry if the handler ran meanwhile
+    } while (base != now);
+    return base + (reloaded ? calib : 0) + calib - val;
 }
 
 
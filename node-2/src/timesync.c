@@ -0,0 +1,64 @@
+/** ***************************************************************************
+ * @file timesync.c
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Time synchronisation master, node 1 follows the node 2 clock
+ * @version 0.1
+ * @date 2025-11-26
+ *
+ * @copyright Copyright (c) 2025 Byggarane
+ *
+ *******************************************************************************/
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "can.h"
+#include "time.h"
+#include "timesync.h"
+
+static uint64_t next_sync = 0;
+static uint8_t sync_seq = 0;
+static bool follow_up_pending = false;
+
+uint32_t timesync_now_us(void)
+{
+    return time_now() / usecs(1);
+}
+
+int timesync_service(void)
+{
+    uint64_t sync_time;
+    if (follow_up_pending && can_tx_time(&sync_time))
+    {
+        struct timesync_follow_up_frame follow_up = {
+            .seq = sync_seq,
+            .sync_us = sync_time / usecs(1),
+        };
+        CanMsg msg = {
+            .id = CAN_ID_TIME_FOLLOW_UP,
+            .extended = 0,
+            .length = sizeof(follow_up),
+        };
+        memcpy(msg.byte, &follow_up, sizeof(follow_up));
+        follow_up_pending = false;
+        return can_tx(msg);
+    }
+
+    uint64_t now = time_now();
+    if (now < next_sync)
+    {
+        return 0;
+    }
+    next_sync = now + msecs(TIMESYNC_PERIOD_MS);
+
+    // A SYNC that never went out (bus off, queue full) is simply replaced
+    CanMsg msg = {
+        .id = CAN_ID_TIME_SYNC,
+        .extended = 0,
+        .length = 1,
+        .byte = {++sync_seq},
+    };
+    int ret = can_tx_stamped(msg);
+    follow_up_pending = (ret == 0);
+    return ret;
+}
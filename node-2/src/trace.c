@@ -0,0 +1,92 @@
+/** ***************************************************************************
+ * @file trace.c
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Deferred binary trace logging
+ * @version 0.1
+ * @date 2025-11-28
+ *
+ * @copyright Copyright (c) 2025 Byggarane
+ *
+ *******************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+#include "sam.h"
+
+#include "ring.h"
+#include "time.h"
+#include "trace.h"
+#include "uart.h"
+
+#define FRAME_SIZE (1 + sizeof(struct trace_record))
+
+/* Producers in all interrupt levels are serialized by masking interrupts in
+ * trace(), trace_drain() is the only consumer. */
+static struct trace_record records[TRACE_RING_SIZE];
+static struct ring ring = RING_INIT(records);
+static volatile uint32_t dropped;
+static uint32_t dropped_sent;
+
+void trace(enum trace_event id, int32_t a, int32_t b, int16_t c)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+
+    struct trace_record *record = ring_write_slot(&ring);
+    if (!record) {
+        dropped = dropped + 1;
+    } else {
+        *record = (struct trace_record){
+            .time = (uint32_t)time_now(),
+            .id = id,
+            .a = a,
+            .b = b,
+            .c = c,
+        };
+        ring_write_commit(&ring, 1);
+    }
+
+    __set_PRIMASK(primask);
+}
+
+static int send_frame(const struct trace_record *record)
+{
+    uint8_t frame[FRAME_SIZE];
+    if (uart_tx_free() < (int)sizeof(frame)) {
+        return -EAGAIN; // Whole records only, so the decoder stays in sync
+    }
+    frame[0] = TRACE_SYNC_BYTE;
+    memcpy(&frame[1], record, sizeof(*record));
+    uart_write(frame, sizeof(frame));
+    return 0;
+}
+
+void trace_drain(void)
+{
+    // Report drops once there is room to, so the decoder can flag the gap
+    uint32_t dropped_now = dropped;
+    if (dropped_now != dropped_sent) {
+        struct trace_record record = {
+            .time = (uint32_t)time_now(),
+            .id = TRACE_DROPPED,
+            .a = dropped_now - dropped_sent,
+        };
+        if (send_frame(&record)) {
+            return;
+        }
+        dropped_sent = dropped_now;
+    }
+
+    struct trace_record *record;
+    for (uint8_t sent = 0; sent < TRACE_DRAIN_RECORDS && (record = ring_read_slot(&ring)); sent++) {
+        if (send_frame(record)) {
+            break;
+        }
+        ring_read_commit(&ring, 1);
+    }
+}
+
+uint32_t trace_dropped(void)
+{
+    return dropped;
+}
@@ -1,40 +1,27 @@
 #include "sam.h"
 #include <stdio.h>
+#include "ring.h"
+#include "uart.h"
 
 #define F_CPU 84000000
 #define BAUD_RATE 115200
 
-typedef struct RingBuf RingBuf;
-struct RingBuf {
-    uint8_t buffer[1024];
-    int capacity;
-    
-    int insertIdx;
-    int removeIdx;
-    int length;
-};
-RingBuf ringBuf = {0};
-
+// Receive ring, filled by `UART_Handler` and emptied by `uart_rx`
+#define rxRingSize 1024
+static uint8_t rxBuf[rxRingSize];
+static struct ring rxRing = RING_INIT(rxBuf);
+static volatile uint32_t rxDropped;
 
-int push(RingBuf* rb, uint8_t val){
-    if(rb->length >= (sizeof(rb->buffer)/sizeof(rb->buffer[0]))){
-        return 0;
-    }
-    rb->buffer[rb->insertIdx] = val;
-    rb->insertIdx = (rb->insertIdx + 1) % (sizeof(rb->buffer)/sizeof(rb->buffer[0]));
-    rb->length++;
-    return 1;
-}
+// Transmit ring, sent in contiguous chunks by the peripheral DMA controller (PDC).
+// The writers are serialized by disabling interrupts, `UART_Handler` releases a
+// chunk once it is sent. `txSending` is the length of the chunk in flight.
+#define txRingSize 2048
+static uint8_t txBuf[txRingSize];
+static struct ring txRing = RING_INIT(txBuf);
+static volatile uint32_t txSending;
+static volatile uint32_t txDropped;
+static volatile UartTxPolicy txPolicy = UART_TX_DROP;
 
-int pop(RingBuf* rb, uint8_t* val){    
-    if(!rb->length){
-        return 0;
-    }
-    *val = rb->buffer[rb->removeIdx];
-    rb->removeIdx = (rb->removeIdx + 1) % (sizeof(rb->buffer)/sizeof(rb->buffer[0]));
-    rb->length--;
-    return 1;
-}
 
 void uart_init(uint32_t cpufreq, uint32_t baudrate){
     PMC->PMC_PCER0 |= (1 << ID_UART);
@@ -59,15 +46,72 @@ void uart_init(uint32_t cpufreq, uint32_t baudrate){
     
 }    
 
+// Start sending the bytes from the tail up to the head or the end of the ring.
+// Call with interrupts disabled, or from `UART_Handler`
+static void txStart(void){
+    if(txSending){
+        return;
+    }
+    void* chunk;
+    uint32_t len = ring_read_contiguous(&txRing, &chunk);
+    if(!len){
+        UART->UART_IDR = UART_IDR_ENDTX;
+        return;
+    }
+    txSending = len;
+    UART->UART_TPR = (uint32_t)chunk;
+    UART->UART_TCR = len;
+    UART->UART_PTCR = UART_PTCR_TXTEN;
+    UART->UART_IER = UART_IER_ENDTX;
+}
+
+int uart_write(const uint8_t* buf, int len){
+    int written = 0;
+    while(written < len){
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+
+        written += ring_push_bulk(&txRing, &buf[written], len - written);
+        txStart();
+
+        __set_PRIMASK(primask);
+
+        if(written < len){
+            // Blocking from an interrupt, or with interrupts off, would never end
+            if(txPolicy == UART_TX_DROP || __get_IPSR() || primask){
+                txDropped += len - written;
+                break;
+            }
+            while(!ring_free(&txRing)){}
+        }
+    }
+    return written;
+}
+
 void uart_tx(uint8_t val){
-    while(!(UART->UART_SR & UART_SR_TXEMPTY)){}
-    UART->UART_THR = val;
+    uart_write(&val, 1);
+}
+
+int uart_tx_free(void){
+    return ring_free(&txRing);
+}
+
+void uart_tx_policy(UartTxPolicy policy){
+    txPolicy = policy;
+}
+
+uint32_t uart_tx_dropped(void){
+    return txDropped;
 }
 
 uint8_t uart_rx(uint8_t* val){
-    return pop(&ringBuf, val);
+    return ring_pop(&rxRing, val);
 }    
 
+uint32_t uart_rx_dropped(void){
+    return rxDropped;
+}
+
 int uart_flush(char* buf, int len){
     int r = 0;
     for(; r < len; r++){
@@ -84,15 +128,23 @@ void UART_Handler(){
     
     uint32_t status = UART->UART_SR;
     
+    // Transmit chunk done: free it and send the next one
+    if(txSending && (status & UART_SR_ENDTX)){
+        ring_read_commit(&txRing, txSending);
+        txSending = 0;
+        txStart();
+    }
+    
     // Errors: Reset UART
     if(status & (UART_SR_OVRE | UART_SR_FRAME | UART_SR_PARE)){
         UART->UART_CR = UART_CR_RXEN | UART_CR_TXEN | UART_CR_RSTSTA;
     }
     
-    // Receive ready: push to ring buffer
+    // Receive ready: push to ring buffer, count what does not fit
     if(status & UART_SR_RXRDY){
-        if(!push(&ringBuf, UART->UART_RHR & 0xff)){
-            printf("UART receive buffer full\n");
+        uint8_t val = UART->UART_RHR & 0xff;
+        if(!ring_push(&rxRing, &val)){
+            rxDropped++;
         }
     }
     
@@ -153,9 +205,8 @@ int _write(int file, char* ptr, int len){
         return -1;    
     }
 
-    for(int idx = 0; idx < len; idx++){
-        uart_tx((uint8_t)ptr[idx]);
-    }
+    // Returns once queued, see `uart_tx_policy` for when the ring is full
+    uart_write((const uint8_t*)ptr, len);
     return len;
 }
 
@@ -0,0 +1,138 @@
+/** ***************************************************************************
+ * @file frame_test.c
+ * @author Byggarane
+ * @brief Host test suite for the COBS and CRC framing
+ * @version 0.1
+ * @date 2025-11-30
+ * 
+ * @copyright Copyright (c) 2025 Byggarane
+ * 
+*******************************************************************************/
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../inc/frame.h"
+
+#define TEST_PASSED "PASSED"
+#define TEST_FAILED "FAILED"
+
+#define MAX_PAYLOAD 253
+#define CRC_CHECK_VALUE 0x29B1 /**< CRC-16/CCITT-FALSE of "123456789" */
+
+static uint8_t tests_passed = 0;
+static uint8_t tests_failed = 0;
+
+static void print_test_result(const char* test_name, bool passed) {
+    if (passed) {
+        printf("[%s] %s\r\n", TEST_PASSED, test_name);
+        tests_passed++;
+    } else {
+        printf("[%s] %s\r\n", TEST_FAILED, test_name);
+        tests_failed++;
+    }
+}
+
+/** ***************************************************************************
+ * @brief Encode and decode a payload, checking the wire format on the way
+*******************************************************************************/
+static bool round_trip(const uint8_t* payload, uint16_t len) {
+    uint8_t wire[FRAME_MAX_ENCODED(MAX_PAYLOAD)];
+    uint8_t decoded[MAX_PAYLOAD];
+    
+    uint16_t wire_len = frame_encode(payload, len, wire);
+    if (wire_len > FRAME_MAX_ENCODED(len) || wire[0] != FRAME_DELIMITER ||
+        wire[wire_len - 1] != FRAME_DELIMITER) {
+        return false;
+    }
+    if (memchr(&wire[1], FRAME_DELIMITER, wire_len - 2)) {
+        return false;
+    }
+    
+    int ret = frame_decode(&wire[1], wire_len - 2, decoded, len);
+    return (ret == len) && (memcmp(payload, decoded, len) == 0);
+}
+
+/** ***************************************************************************
+ * @brief Test the CRC against the standard check value
+*******************************************************************************/
+static void test_frame_crc(void) {
+    const char* check = "123456789";
+    bool passed = frame_crc16((const uint8_t*)check, strlen(check)) == CRC_CHECK_VALUE;
+    print_test_result("Frame CRC", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test payloads with zeros, without zeros and across the 254 byte run
+*******************************************************************************/
+static void test_frame_round_trip(void) {
+    uint8_t payload[MAX_PAYLOAD];
+    bool passed = round_trip(payload, 0);
+    
+    memset(payload, 0, sizeof(payload));
+    passed &= round_trip(payload, 1) && round_trip(payload, 20) && round_trip(payload, MAX_PAYLOAD);
+    
+    for (uint16_t i = 0; i < MAX_PAYLOAD; i++) {
+        payload[i] = 1 + i % 255;
+    }
+    for (uint16_t len = 1; len <= MAX_PAYLOAD; len++) {
+        passed &= round_trip(payload, len);
+    }
+    
+    for (uint16_t i = 0; i < MAX_PAYLOAD; i++) {
+        payload[i] = (i % 7 == 0) ? 0 : i;
+    }
+    passed &= round_trip(payload, MAX_PAYLOAD);
+    
+    print_test_result("Frame Round Trip", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test that corrupt and oversized frames are rejected
+*******************************************************************************/
+static void test_frame_errors(void) {
+    uint8_t payload[20] = {1, 0, 2, 3, 0, 0, 4};
+    uint8_t wire[FRAME_MAX_ENCODED(sizeof(payload))];
+    uint8_t decoded[sizeof(payload)];
+    uint16_t wire_len = frame_encode(payload, sizeof(payload), wire);
+    
+    int too_small = frame_decode(&wire[1], wire_len - 2, decoded, sizeof(decoded) - 1);
+    
+    wire[5] ^= 0x10;
+    int corrupt = frame_decode(&wire[1], wire_len - 2, decoded, sizeof(decoded));
+    
+    uint8_t broken[] = {5, 1, 2};
+    int truncated = frame_decode(broken, sizeof(broken), decoded, sizeof(decoded));
+    
+    bool passed = (too_small == -EMSGSIZE) && (corrupt == -EBADMSG || corrupt == -EINVAL) &&
+                  (truncated == -EINVAL);
+    print_test_result("Frame Errors", passed);
+}
+
+/** ***************************************************************************
+ * @brief Run all framing tests
+ *
+ * @return int Number of failed tests
+*******************************************************************************/
+int run_frame_tests(void) {
+    printf("\r\n");
+    printf("========================================\r\n");
+    printf("         Framing Test Suite            \r\n");
+    printf("========================================\r\n\r\n");
+    
+    tests_passed = 0;
+    tests_failed = 0;
+    
+    test_frame_crc();
+    test_frame_round_trip();
+    test_frame_errors();
+    
+    printf("\r\n");
+    printf("========================================\r\n");
+    printf("Results: %d passed, %d failed\r\n", tests_passed, tests_failed);
+    printf("========================================\r\n\r\n");
+    return tests_failed;
+}
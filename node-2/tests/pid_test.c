@@ -0,0 +1,172 @@
+/** ***************************************************************************
+ * @file pid_test.c
+ * @author Byggarane
+ * @brief Host test suite for the fixed-point PID controller
+ * @version 0.1
+ * @date 2025-12-02
+ * 
+ * @copyright Copyright (c) 2025 Byggarane
+ * 
+*******************************************************************************/
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../inc/pid.h"
+
+#define TEST_PASSED "PASSED"
+#define TEST_FAILED "FAILED"
+
+#define RATE_HZ 100
+#define OUT_LIMIT 1000
+#define SETPOINT 500
+
+static uint8_t tests_passed = 0;
+static uint8_t tests_failed = 0;
+
+static void print_test_result(const char* test_name, bool passed) {
+    if (passed) {
+        printf("[%s] %s\r\n", TEST_PASSED, test_name);
+        tests_passed++;
+    } else {
+        printf("[%s] %s\r\n", TEST_FAILED, test_name);
+        tests_failed++;
+    }
+}
+
+/** ***************************************************************************
+ * @brief First order plant, the output moves an eighth of the way to the input
+ *        each step
+*******************************************************************************/
+static int32_t plant_step(int32_t y, int32_t u) {
+    return y + (u - y) / 8;
+}
+
+/** ***************************************************************************
+ * @brief Test that gains overflowing once scaled by the rate are rejected
+*******************************************************************************/
+static void test_pid_init(void) {
+    struct pid pid;
+    struct pid_config config = {
+        .kp = PID_GAIN(1.0), .ki = 0, .kd = PID_GAIN(1000.0),
+        .rate_hz = 1000, .out_min = -OUT_LIMIT, .out_max = OUT_LIMIT,
+    };
+    int kd_overflow = pid_init(&pid, &config);
+    
+    config.kd = 0;
+    config.ki = INT32_MAX;
+    config.rate_hz = 1;
+    int ki_overflow = pid_init(&pid, &config);
+    
+    config.ki = PID_GAIN(1.0);
+    config.rate_hz = 0;
+    int zero_rate = pid_init(&pid, &config);
+    
+    config.rate_hz = RATE_HZ;
+    int valid = pid_init(&pid, &config);
+    
+    bool passed = (kd_overflow == -EINVAL) && (ki_overflow == -EINVAL) &&
+                  (zero_rate == -EINVAL) && (valid == 0);
+    print_test_result("PID Init", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test that a PI controller settles a setpoint step on the plant
+ *        without leaving the output range
+*******************************************************************************/
+static void test_pid_step_response(void) {
+    struct pid pid;
+    struct pid_config config = {
+        .kp = PID_GAIN(0.5), .ki = PID_GAIN(20.0), .kd = 0,
+        .rate_hz = RATE_HZ, .out_min = -OUT_LIMIT, .out_max = OUT_LIMIT,
+    };
+    bool passed = pid_init(&pid, &config) == 0;
+    
+    int32_t y = 0;
+    for (int i = 0; i < 5 * RATE_HZ; i++) {
+        int32_t u = pid_step(&pid, SETPOINT, y);
+        passed &= (u >= -OUT_LIMIT) && (u <= OUT_LIMIT);
+        y = plant_step(y, u);
+    }
+    
+    // The integral removes the steady state error a P controller would leave
+    passed &= (y >= SETPOINT - 2) && (y <= SETPOINT + 2);
+    print_test_result("PID Step Response", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test that the integral does not wind up while the output is saturated
+*******************************************************************************/
+static void test_pid_integrator_clamp(void) {
+    struct pid pid;
+    struct pid_config config = {
+        .kp = 0, .ki = PID_GAIN(100.0), .kd = 0,
+        .rate_hz = RATE_HZ, .out_min = -OUT_LIMIT, .out_max = OUT_LIMIT,
+    };
+    bool passed = pid_init(&pid, &config) == 0;
+    
+    // A long stall would wind a plain integrator far past the output range
+    for (int i = 0; i < 10 * RATE_HZ; i++) {
+        pid_step(&pid, SETPOINT, 0);
+    }
+    int64_t limit = (int64_t)OUT_LIMIT << (PID_Q + PID_I_EXTRA_Q);
+    passed &= (pid.integral <= limit) && (pid.integral >= -limit);
+    
+    // Once the error reverses, the output has to leave saturation promptly
+    int steps = 0;
+    while (pid_step(&pid, 0, SETPOINT) >= OUT_LIMIT && steps < RATE_HZ) {
+        steps++;
+    }
+    passed &= steps < RATE_HZ / 10;
+    print_test_result("PID Integrator Clamp", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test that the output saturates at the configured limits
+*******************************************************************************/
+static void test_pid_saturation(void) {
+    struct pid pid;
+    struct pid_config config = {
+        .kp = PID_GAIN(100.0), .ki = PID_GAIN(1.0), .kd = PID_GAIN(1.0),
+        .rate_hz = RATE_HZ, .out_min = -200, .out_max = 300,
+    };
+    bool passed = pid_init(&pid, &config) == 0;
+    
+    passed &= pid_step(&pid, 100000, 0) == 300;
+    pid_reset(&pid);
+    passed &= pid_step(&pid, -100000, 0) == -200;
+    
+    // Full scale measurement jump, the derivative alone would overflow int32
+    pid_reset(&pid);
+    pid_step(&pid, 0, INT32_MIN / 2);
+    passed &= pid_step(&pid, 0, INT32_MAX / 2) == -200;
+    print_test_result("PID Saturation", passed);
+}
+
+/** ***************************************************************************
+ * @brief Run all PID tests
+ *
+ * @return int Number of failed tests
+*******************************************************************************/
+int run_pid_tests(void) {
+    printf("\r\n");
+    printf("========================================\r\n");
+    printf("           PID Test Suite              \r\n");
+    printf("========================================\r\n\r\n");
+    
+    tests_passed = 0;
+    tests_failed = 0;
+    
+    test_pid_init();
+    test_pid_step_response();
+    test_pid_integrator_clamp();
+    test_pid_saturation();
+    
+    printf("\r\n");
+    printf("========================================\r\n");
+    printf("Results: %d passed, %d failed\r\n", tests_passed, tests_failed);
+    printf("========================================\r\n\r\n");
+    return tests_failed;
+}
@@ -0,0 +1,307 @@
+/** ***************************************************************************
+ * @file ring_test.c
+ * @author Byggarane
+ * @brief Host test suite for the SPSC ring buffer
+ * @version 0.1
+ * @date 2025-11-29
+ * 
+ * @copyright Copyright (c) 2025 Byggarane
+ * 
+ * @details The stress tests run the producer and consumer in two threads, so
+ *          they hit the ring concurrently the way an interrupt and the main
+ *          loop do, and check that every element arrives once, in order and
+ *          not torn.
+ * 
+*******************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../inc/ring.h"
+
+#define TEST_PASSED "PASSED"
+#define TEST_FAILED "FAILED"
+
+#define RING_SIZE 64
+#ifndef STRESS_ELEMENTS
+#define STRESS_ELEMENTS 4000000UL
+#endif
+#define STRESS_MAX_BULK 24
+#define BYTE_RING_SIZE 256
+
+static uint8_t tests_passed = 0;
+static uint8_t tests_failed = 0;
+
+static void print_test_result(const char* test_name, bool passed) {
+    if (passed) {
+        printf("[%s] %s\r\n", TEST_PASSED, test_name);
+        tests_passed++;
+    } else {
+        printf("[%s] %s\r\n", TEST_FAILED, test_name);
+        tests_failed++;
+    }
+}
+
+/** ***************************************************************************
+ * @brief Element larger than a word, torn reads show as a check mismatch
+*******************************************************************************/
+struct element {
+    uint32_t seq;
+    uint32_t fill[4];
+    uint32_t check;
+};
+
+static struct element make_element(uint32_t seq) {
+    struct element e = {.seq = seq};
+    for (uint8_t i = 0; i < 4; i++) {
+        e.fill[i] = seq * 2654435761u + i;
+    }
+    e.check = ~seq;
+    return e;
+}
+
+static bool element_valid(const struct element* e, uint32_t seq) {
+    struct element expected = make_element(seq);
+    return memcmp(e, &expected, sizeof(*e)) == 0;
+}
+
+/** ***************************************************************************
+ * @brief Test init argument checks and the static initializer
+*******************************************************************************/
+static void test_ring_init(void) {
+    uint32_t buf[8];
+    struct ring ring;
+    struct ring fixed = RING_INIT(buf);
+    
+    bool passed = (ring_init(&ring, buf, sizeof(buf[0]), 6) == -EINVAL) &&
+                  (ring_init(&ring, buf, 0, 8) == -EINVAL) &&
+                  (ring_init(&ring, NULL, sizeof(buf[0]), 8) == -EINVAL) &&
+                  (ring_init(&ring, buf, sizeof(buf[0]), 8) == 0) &&
+                  (ring.mask == 7) && (fixed.mask == 7) &&
+                  (fixed.elem_size == sizeof(buf[0])) &&
+                  (ring_count(&ring) == 0) && (ring_free(&ring) == 8);
+    
+    print_test_result("Ring Init", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test full and empty, all slots usable
+*******************************************************************************/
+static void test_ring_full_empty(void) {
+    uint32_t buf[8];
+    struct ring ring = RING_INIT(buf);
+    uint32_t value = 0;
+    bool passed = !ring_pop(&ring, &value) && (ring_read_slot(&ring) == NULL);
+    
+    for (uint32_t i = 0; i < 8; i++) {
+        passed &= ring_push(&ring, &i);
+    }
+    passed &= !ring_push(&ring, &value) && (ring_write_slot(&ring) == NULL) &&
+              (ring_count(&ring) == 8) && (ring_free(&ring) == 0);
+    
+    for (uint32_t i = 0; i < 8; i++) {
+        passed &= ring_pop(&ring, &value) && (value == i);
+    }
+    passed &= !ring_pop(&ring, &value) && (ring_count(&ring) == 0);
+    
+    print_test_result("Ring Full Empty", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test bulk copies across the end of the buffer and index overflow
+*******************************************************************************/
+static void test_ring_wrap(void) {
+    uint32_t buf[8];
+    struct ring ring = RING_INIT(buf);
+    
+    // Start just below the 32-bit wrap of the free-running indices
+    ring.head = ring.tail = UINT32_MAX - 2;
+    
+    uint32_t in[6] = {1, 2, 3, 4, 5, 6};
+    uint32_t out[8] = {0};
+    bool passed = (ring_push_bulk(&ring, in, 6) == 6) &&
+                  (ring_push_bulk(&ring, in, 6) == 2) &&
+                  (ring_count(&ring) == 8);
+    
+    passed &= (ring_pop_bulk(&ring, out, 8) == 8);
+    uint32_t expected[8] = {1, 2, 3, 4, 5, 6, 1, 2};
+    passed &= (memcmp(out, expected, sizeof(out)) == 0) && (ring_count(&ring) == 0);
+    
+    print_test_result("Ring Wrap", passed);
+}
+
+/** ***************************************************************************
+ * @brief Test in-place access and the contiguous span used for DMA
+*******************************************************************************/
+static void test_ring_in_place(void) {
+    uint8_t buf[8];
+    struct ring ring = RING_INIT(buf);
+    ring.head = ring.tail = 5;
+    
+    for (uint8_t i = 0; i < 6; i++) {
+        uint8_t* slot = ring_write_slot(&ring);
+        *slot = i;
+        ring_write_commit(&ring, 1);
+    }
+    
+    void* span;
+    uint32_t first = ring_read_contiguous(&ring, &span);
+    bool passed = (first == 3) && (span == &buf[5]) && (buf[7] == 2);
+    ring_read_commit(&ring, first);
+    
+    uint32_t second = ring_read_contiguous(&ring, &span);
+    passed &= (second == 3) && (span == &buf[0]) && (*(uint8_t*)ring_read_slot(&ring) == 3);
+    ring_read_commit(&ring, second);
+    passed &= (ring_read_contiguous(&ring, &span) == 0) && (ring_count(&ring) == 0);
+    
+    print_test_result("Ring In Place", passed);
+}
+
+/** ***************************************************************************
+ * @brief Give the other thread the CPU when the ring is full or empty
+ *
+ * @details Keeps the tests fast on a single core, where spinning would only
+ *          burn the rest of the time slice
+*******************************************************************************/
+static void wait_for_other_side(void) {
+    struct timespec pause = {.tv_nsec = 1000};
+    nanosleep(&pause, NULL);
+}
+
+static struct element stress_buf[RING_SIZE];
+static struct ring stress_ring = RING_INIT(stress_buf);
+
+static void* stress_producer(void* arg) {
+    bool bulk = *(bool*)arg;
+    struct element batch[STRESS_MAX_BULK];
+    uint32_t seq = 0;
+    unsigned int seed = 1;
+    
+    while (seq < STRESS_ELEMENTS) {
+        if (!bulk) {
+            struct element e = make_element(seq);
+            if (ring_push(&stress_ring, &e)) {
+                seq++;
+            } else {
+                wait_for_other_side();
+            }
+            continue;
+        }
+        uint32_t count = 1 + rand_r(&seed) % STRESS_MAX_BULK;
+        if (count > STRESS_ELEMENTS - seq) {
+            count = STRESS_ELEMENTS - seq;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            batch[i] = make_element(seq + i);
+        }
+        // Whatever did not fit is rebuilt and offered again next round
+        uint32_t pushed = ring_push_bulk(&stress_ring, batch, count);
+        if (pushed < count) {
+            wait_for_other_side();
+        }
+        seq += pushed;
+    }
+    return NULL;
+}
+
+/** ***************************************************************************
+ * @brief Consume everything while the producer runs, in all read styles
+ *
+ * @return uint32_t Number of elements that were lost, repeated, reordered or torn
+*******************************************************************************/
+static uint32_t stress_consume(bool bulk) {
+    struct element batch[STRESS_MAX_BULK];
+    uint32_t seq = 0;
+    uint32_t errors = 0;
+    unsigned int seed = 2;
+    
+    while (seq < STRESS_ELEMENTS) {
+        uint32_t count;
+        if (!bulk) {
+            count = ring_pop(&stress_ring, batch);
+        } else if (rand_r(&seed) & 1) {
+            count = ring_pop_bulk(&stress_ring, batch, 1 + rand_r(&seed) % STRESS_MAX_BULK);
+        } else {
+            void* span;
+            count = ring_read_contiguous(&stress_ring, &span);
+            count = count > STRESS_MAX_BULK ? STRESS_MAX_BULK : count;
+            memcpy(batch, span, count * sizeof(batch[0]));
+            ring_read_commit(&stress_ring, count);
+        }
+        if (!count) {
+            wait_for_other_side();
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            if (!element_valid(&batch[i], seq + i)) {
+                errors++;
+            }
+        }
+        seq += count;
+    }
+    return errors;
+}
+
+static void run_stress(const char* test_name, bool bulk) {
+    pthread_t producer;
+    ring_reset(&stress_ring);
+    
+    if (pthread_create(&producer, NULL, stress_producer, &bulk)) {
+        print_test_result(test_name, false);
+        return;
+    }
+    uint32_t errors = stress_consume(bulk);
+    pthread_join(producer, NULL);
+    
+    if (errors) {
+        printf("  %u of %lu elements wrong\r\n", errors, STRESS_ELEMENTS);
+    }
+    print_test_result(test_name, errors == 0 && ring_count(&stress_ring) == 0);
+}
+
+/** ***************************************************************************
+ * @brief Stress test with single element push and pop
+*******************************************************************************/
+static void test_ring_stress_single(void) {
+    run_stress("Ring Stress Single", false);
+}
+
+/** ***************************************************************************
+ * @brief Stress test with random size bulk push, bulk pop and in-place reads
+*******************************************************************************/
+static void test_ring_stress_bulk(void) {
+    run_stress("Ring Stress Bulk", true);
+}
+
+/** ***************************************************************************
+ * @brief Run all ring buffer tests
+ *
+ * @return int Number of failed tests
+*******************************************************************************/
+int run_ring_tests(void) {
+    printf("\r\n");
+    printf("========================================\r\n");
+    printf("       Ring Buffer Test Suite          \r\n");
+    printf("========================================\r\n\r\n");
+    
+    tests_passed = 0;
+    tests_failed = 0;
+    
+    test_ring_init();
+    test_ring_full_empty();
+    test_ring_wrap();
+    test_ring_in_place();
+    test_ring_stress_single();
+    test_ring_stress_bulk();
+    
+    printf("\r\n");
+    printf("========================================\r\n");
+    printf("Results: %d passed, %d failed\r\n", tests_passed, tests_failed);
+    printf("========================================\r\n\r\n");
+    return tests_failed;
+}
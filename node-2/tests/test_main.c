@@ -0,0 +1,26 @@
+/** ***************************************************************************
+ * @file test_main.c
+ * @author Byggarane
+ * @brief Host test runner for the node 2 modules that do not touch hardware
+ * @version 0.1
+ * @date 2025-11-29
+ * 
+ * @copyright Copyright (c) 2025 Byggarane
+ * 
+ * @details Built and run on the development machine with `make -C tests`.
+ * 
+*******************************************************************************/
+
+#include <stdio.h>
+
+// Test suite function declarations
+extern int run_frame_tests(void);
+extern int run_ring_tests(void);
+extern int run_pid_tests(void);
+
+int main(void) {
+    int failed = run_frame_tests();
+    failed += run_ring_tests();
+    failed += run_pid_tests();
+    return failed ? 1 : 0;
+}
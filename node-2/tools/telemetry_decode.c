@@ -0,0 +1,217 @@
+/** ***************************************************************************
+ * @file telemetry_decode.c
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Host decoder for the node 2 telemetry frames
+ * @version 0.1
+ * @date 2025-11-30
+ *
+ * @copyright Copyright (c) 2025 Byggarane
+ *
+ * @details Reads the node 2 UART output, picks out the telemetry frames and
+ *          writes the samples as CSV to stdout. Text and trace records in
+ *          between are skipped. Step responses of the position loop are
+ *          measured as the samples arrive and reported on stderr. Build and
+ *          run on the host:
+ *
+ *              gcc -O2 -iquote inc -o telemetry_decode tools/telemetry_decode.c src/frame.c -lm
+ *              stty -F /dev/ttyACM0 250000 raw
+ *              ./telemetry_decode < /dev/ttyACM0 > run.csv
+ *
+ *******************************************************************************/
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../inc/frame.h"
+#include "../inc/telemetry.h"
+
+#define CHUNK_MAX 512
+#define STEP_MIN 50           /**< Setpoint change in permille that starts a new step */
+#define STEP_RISE_LOW 0.1     /**< Rise time is measured from 10 % ... */
+#define STEP_RISE_HIGH 0.9    /**< ... to 90 % of the step */
+#define STEP_SETTLE_BAND 0.05 /**< Settled when within 5 % of the step from the setpoint */
+#define STEP_SIZE_MIN 1.0     /**< Smaller moves, in permille, have no rise time or overshoot */
+
+/** ***************************************************************************
+ * @brief Response to one setpoint step, times in seconds from the step
+ *******************************************************************************/
+struct step
+{
+    bool active;
+    double start_time;
+    double from;       /**< Position when the step was seen */
+    double to;         /**< New setpoint */
+    double rise_low;   /**< Time of the 10 % crossing, negative until reached */
+    double rise_high;  /**< Time of the 90 % crossing, negative until reached */
+    double peak;       /**< Furthest position past the start, in the step direction */
+    double last_out;   /**< Time of the last sample outside the settling band */
+    double last_time;  /**< Time of the latest sample */
+};
+
+static struct step step;
+static unsigned long steps;
+
+/** ***************************************************************************
+ * @brief Extend the 32-bit sample time to 64 bits
+ *
+ * @note Assumes less than one wrap, 51 s, between samples
+ *******************************************************************************/
+static uint64_t unwrap_time(uint32_t time)
+{
+    static bool started = false;
+    static uint32_t last;
+    static uint64_t total;
+
+    if (started) {
+        total += (uint32_t)(time - last);
+    } else {
+        total = time;
+        started = true;
+    }
+    last = time;
+    return total;
+}
+
+static void step_report(void)
+{
+    if (!step.active) {
+        return;
+    }
+    step.active = false;
+    steps++;
+
+    double size = step.to - step.from;
+    fprintf(stderr, "step %lu at %.3f s: %.0f -> %.0f", steps, step.start_time, step.from, step.to);
+    if (fabs(size) < STEP_SIZE_MIN) {
+        // The position was already at the new setpoint
+        fprintf(stderr, ", no move");
+    } else {
+        if (step.rise_high >= 0) {
+            fprintf(stderr, ", rise %.1f ms", (step.rise_high - step.rise_low) * 1000);
+        } else {
+            fprintf(stderr, ", did not reach 90 %%");
+        }
+        double overshoot = (step.peak - step.to) / size * 100;
+        fprintf(stderr, ", overshoot %.1f %%", overshoot > 0 ? overshoot : 0);
+    }
+    if (step.last_out < step.last_time) {
+        fprintf(stderr, ", settled %.1f ms\n", step.last_out * 1000);
+    } else {
+        fprintf(stderr, ", not settled after %.1f ms\n", step.last_time * 1000);
+    }
+}
+
+/** ***************************************************************************
+ * @brief Feed one sample to the step analysis
+ *
+ * @details A setpoint change of at least STEP_MIN from the current step
+ *          starts a new one. Smaller changes, joystick noise, are ignored
+ *******************************************************************************/
+static void step_update(double time, int setpoint, int position)
+{
+    static bool started = false;
+    static int level;
+
+    if (!started) {
+        started = true;
+        level = setpoint;
+        return;
+    }
+    if (abs(setpoint - level) >= STEP_MIN) {
+        step_report();
+        level = setpoint;
+        step = (struct step){
+            .active = true,
+            .start_time = time,
+            .from = position,
+            .to = setpoint,
+            .rise_low = -1,
+            .rise_high = -1,
+            .peak = position,
+            .last_out = 0,
+        };
+    }
+    if (!step.active) {
+        return;
+    }
+
+    double t = time - step.start_time;
+    double size = step.to - step.from;
+
+    // The step starts from the measured position, which may already be at
+    // the new setpoint
+    if (fabs(size) >= STEP_SIZE_MIN) {
+        double progress = (position - step.from) / size;
+        if (step.rise_low < 0 && progress >= STEP_RISE_LOW) {
+            step.rise_low = t;
+        }
+        if (step.rise_high < 0 && progress >= STEP_RISE_HIGH) {
+            step.rise_high = t;
+        }
+    }
+    if ((position - step.peak) * size > 0) {
+        step.peak = position;
+    }
+    if (fabs(position - step.to) > STEP_SETTLE_BAND * fabs(size)) {
+        step.last_out = t;
+    }
+    step.last_time = t;
+}
+
+int main(void)
+{
+    static uint8_t chunk[CHUNK_MAX];
+    uint16_t len = 0;
+    bool overflow = false;
+    int c;
+
+    struct telemetry_sample sample;
+    bool have_seq = false;
+    uint8_t last_seq = 0;
+    unsigned long frames = 0, lost = 0, crc_errors = 0;
+
+    printf("time_s,seq,setpoint,position,duty,encoder,ir_adc,exec_us\n");
+
+    while ((c = getchar()) != EOF) {
+        if (c != FRAME_DELIMITER) {
+            if (len < CHUNK_MAX) {
+                chunk[len++] = c;
+            } else {
+                overflow = true;
+            }
+            continue;
+        }
+
+        // Text and trace records between frames end up here too and fail
+        int ret = overflow ? -EMSGSIZE : frame_decode(chunk, len, &sample, sizeof(sample));
+        bool sized = len == FRAME_MAX_ENCODED(sizeof(sample)) - 2;
+        len = 0;
+        overflow = false;
+        if (ret != sizeof(sample) || sample.type != TELEMETRY_FRAME_SAMPLE) {
+            // Only count what looks like a sample frame, text is expected
+            crc_errors += (ret == -EBADMSG && sized);
+            continue;
+        }
+
+        frames++;
+        if (have_seq) {
+            lost += (uint8_t)(sample.seq - last_seq - 1);
+        }
+        have_seq = true;
+        last_seq = sample.seq;
+
+        double time = (double)unwrap_time(sample.time) / TELEMETRY_CLOCK_HZ;
+        printf("%.6f,%u,%d,%d,%d,%ld,%u,%.2f\n", time, sample.seq, sample.setpoint,
+               sample.position, sample.duty, (long)sample.encoder, sample.ir_adc,
+               (double)sample.exec_cycles * 1e6 / TELEMETRY_CLOCK_HZ);
+        step_update(time, sample.setpoint, sample.position);
+    }
+
+    step_report();
+    fprintf(stderr, "%lu frames, %lu lost, %lu CRC errors\n", frames, lost, crc_errors);
+    return 0;
+}
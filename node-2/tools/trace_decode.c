@@ -0,0 +1,158 @@
+/** ***************************************************************************
+ * @file trace_decode.c
+ * @author Magnus Carlsen Haaland, Tryggve Klevstul-Jensen, Walter Brynildsen
+ * @brief Host decoder for the node 2 trace records
+ * @version 0.1
+ * @date 2025-11-28
+ *
+ * @copyright Copyright (c) 2025 Byggarane
+ *
+ * @details Reads the node 2 UART output and prints it with the binary trace
+ *          records turned into text lines. Normal printf() text is passed
+ *          through, telemetry frames are skipped, see telemetry_decode.c.
+ *          Build and run on the host:
+ *
+ *              gcc -O2 -iquote inc -o trace_decode tools/trace_decode.c src/frame.c
+ *              stty -F /dev/ttyACM0 250000 raw
+ *              ./trace_decode < /dev/ttyACM0
+ *
+ *******************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../inc/frame.h"
+#include "../inc/telemetry.h"
+#include "../inc/trace.h"
+
+// Longest span between two delimiters that can still be a telemetry frame
+#define FRAME_SPAN_MAX (FRAME_MAX_ENCODED(sizeof(struct telemetry_sample)) - 2)
+
+#define TRACE_EVENT_FORMAT(name, format) [name] = format,
+
+static const char *formats[TRACE_EVENT_COUNT] = {
+    TRACE_EVENTS(TRACE_EVENT_FORMAT)
+};
+
+/** ***************************************************************************
+ * @brief Extend the 32-bit record time to 64 bits
+ *
+ * @note Assumes less than one wrap, 51 s, between records
+ *******************************************************************************/
+static uint64_t unwrap_time(uint32_t time)
+{
+    static bool started = false;
+    static uint32_t last;
+    static uint64_t total;
+
+    if (started) {
+        total += (uint32_t)(time - last);
+    } else {
+        total = time;
+        started = true;
+    }
+    last = time;
+    return total;
+}
+
+static void print_record(const struct trace_record *record)
+{
+    double seconds = (double)unwrap_time(record->time) / TRACE_CLOCK_HZ;
+    printf("[%12.6f] ", seconds);
+    if (record->id < TRACE_EVENT_COUNT) {
+        printf(formats[record->id], (long)record->a, (long)record->b, (long)record->c);
+    } else {
+        printf("unknown event %u: %ld %ld %ld", record->id, (long)record->a,
+               (long)record->b, (long)record->c);
+    }
+    printf("\n");
+}
+
+// Bytes taken for a frame that turned out not to be one, read again as text
+static uint8_t replay[FRAME_SPAN_MAX + 1];
+static uint16_t replay_len;
+static uint16_t replay_pos;
+
+static int next_byte(void)
+{
+    if (replay_pos < replay_len) {
+        return replay[replay_pos++];
+    }
+    return getchar();
+}
+
+/** ***************************************************************************
+ * @brief Hand the bytes of a span back to be read again as text
+ *
+ * @note Only called once the previous replay is used up, the span and the
+ *       byte after it are all read from stdin
+ *******************************************************************************/
+static void replay_span(const uint8_t *span, uint16_t len, uint8_t last)
+{
+    memcpy(replay, span, len);
+    replay[len] = last;
+    replay_len = len + 1;
+    replay_pos = 0;
+}
+
+int main(void)
+{
+    int c;
+    bool line_start = true;
+    struct trace_record record;
+    uint8_t *record_bytes = (uint8_t *)&record;
+
+    // A delimiter opens a frame, which ends at the next delimiter. When
+    // attaching mid-stream, or after a lost byte, the delimiters pair up the
+    // wrong way round. A span that is too long or does not decode was text,
+    // so it is read again as such, and its closing delimiter opens the frame.
+    static uint8_t span[FRAME_SPAN_MAX];
+    uint16_t span_len = 0;
+    bool in_frame = false;
+    struct telemetry_sample sample;
+
+    while ((c = next_byte()) != EOF) {
+        if (in_frame) {
+            if (c != FRAME_DELIMITER && span_len < FRAME_SPAN_MAX) {
+                span[span_len++] = c;
+                continue;
+            }
+            if (c != FRAME_DELIMITER ||
+                frame_decode(span, span_len, &sample, sizeof(sample)) <= 0) {
+                replay_span(span, span_len, c);
+            }
+            span_len = 0;
+            in_frame = false;
+            continue;
+        }
+        if (c == FRAME_DELIMITER) {
+            in_frame = true;
+            continue;
+        }
+        if (c != TRACE_SYNC_BYTE) {
+            if (c != '\r') {
+                putchar(c);
+                line_start = (c == '\n');
+            }
+            continue;
+        }
+
+        size_t got = 0;
+        while (got < sizeof(record) && (c = next_byte()) != EOF) {
+            record_bytes[got++] = c;
+        }
+        if (got < sizeof(record)) {
+            break;
+        }
+        // Records can arrive in the middle of a printf() line
+        if (!line_start) {
+            putchar('\n');
+            line_start = true;
+        }
+        print_record(&record);
+        fflush(stdout);
+    }
+    return 0;
+}